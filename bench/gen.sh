@@ -0,0 +1,156 @@
+#!/bin/sh
+#
+# Generate synthetic AVR sources of a given kind and size into a
+# directory. Every .asm file written to <dir> is a source to assemble;
+# most kinds write only <dir>/bench.asm, the include kind also writes the
+# files it includes.
+#
+#   labels   n labels, each referenced by an expression
+#   equ      n .equ constants, each used twice
+#   macros   n invocations of a macro library nested depth deep
+#   includes a chain of n nested include files
+#   cond     n .if/.elif/.ifdef blocks testing device constants
+#   db       n .db table lines
+#   stabs    n avr-gcc style functions with .stabs/.stabn lines
+#            (assemble with --coff, otherwise they are skipped)
+#   encode   n blocks holding an instruction of every operand format
+#   devices  one source for each of the first n device definition files
+#            in includes/, almost entirely .equ/.def/.set lines
+#
+# usage: bench/gen.sh kind n dir [depth]
+
+KIND="$1"
+N="$2"
+DIR="$3"
+DEPTH="${4:-4}"
+
+if [ -z "${KIND}" ] || [ -z "${N}" ] || [ -z "${DIR}" ] || [ "${DEPTH}" -lt 1 ]; then
+	echo "usage: $0 labels|equ|macros|includes|cond|db|stabs|encode|devices n dir [depth]" >&2
+	exit 1
+fi
+top="$(cd "$(dirname "$0")/.." && pwd)"
+mkdir -p "${DIR}"
+
+case "${KIND}" in
+labels)
+	awk -v n="${N}" 'BEGIN {
+		print ".device atmega2560"
+		for (i = 0; i < n; i++) {
+			printf "l%d:\tldi\tr16, low(l%d)\n", i, (i * 7) % n
+			printf "\tldi\tr17, high(l%d + 2)\n", (i * 13) % n
+		}
+	}' > "${DIR}/bench.asm"
+	;;
+equ)
+	awk -v n="${N}" 'BEGIN {
+		print ".device atmega2560"
+		for (i = 0; i < n; i++)
+			printf ".equ\tc%d = %d\n", i, i % 256
+		for (i = 0; i < n; i++)
+			printf "\tldi\tr16, (c%d + c%d) & 0xff\n", i, (i * 7) % n
+	}' > "${DIR}/bench.asm"
+	;;
+macros)
+	awk -v n="${N}" -v depth="${DEPTH}" 'BEGIN {
+		print ".device atmega2560"
+		print ".macro m0\n\tinc\t@0\n\tdec\t@1\n.endm"
+		for (d = 1; d < depth; d++)
+			printf ".macro m%d\n\tm%d\t@0, @1\n\tmov\t@0, @1\n\tm%d\t@1, @0\n.endm\n", d, d - 1, d - 1
+		for (i = 0; i < n; i++)
+			printf "\tm%d\tr%d, r%d\n", depth - 1, 16 + i % 8, 24 + i % 8
+	}' > "${DIR}/bench.asm"
+	;;
+includes)
+	awk -v n="${N}" -v dir="${DIR}" 'BEGIN {
+		print ".device atmega2560" > (dir "/bench.asm")
+		print ".include \"inc0.inc\"" > (dir "/bench.asm")
+		for (i = 0; i < n; i++) {
+			f = dir "/inc" i ".inc"
+			for (j = 0; j < 10; j++)
+				printf ".equ\tinc%d_%d = %d\n", i, j, j > f
+			printf "\tldi\tr16, inc%d_9\n", i > f
+			if (i + 1 < n)
+				printf ".include \"inc%d.inc\"\n", i + 1 > f
+			close(f)
+		}
+	}'
+	;;
+cond)
+	awk -v n="${N}" 'BEGIN {
+		print ".device atmega2560"
+		for (i = 0; i < n; i++) {
+			print ".if __FLASH_SIZE__ > 0x10000"
+			print ".ifdef __ATmega2560__"
+			print "\tnop"
+			print ".else"
+			print "\tsleep"
+			print ".endif"
+			print ".elif __RAM_SIZE__ > 512"
+			print "\twdr"
+			print ".else"
+			print "\tbreak"
+			print ".endif"
+			print ".ifndef __ATtiny13__"
+			print "\tldi\tr16, __DEVICE__ & 0xff"
+			print ".endif"
+		}
+	}' > "${DIR}/bench.asm"
+	;;
+db)
+	awk -v n="${N}" 'BEGIN {
+		print ".device atmega2560"
+		for (i = 0; i < n; i++) {
+			if (i % 8 == 7)
+				printf "\t.db\t\"row %05d of tbl\"\n", i
+			else {
+				printf "\t.db\t"
+				for (j = 0; j < 16; j++)
+					printf "%s%d", j ? ", " : "", (i + j) % 256
+				printf "\n"
+			}
+		}
+	}' > "${DIR}/bench.asm"
+	;;
+stabs)
+	awk -v n="${N}" 'BEGIN {
+		print ".device atmega2560"
+		print ".stabs \"bench.c\",100,0,0,main"
+		print ".stabs \"int:t1=r1;-32768;32767;\",128,0,0,0"
+		for (i = 0; i < n; i++) {
+			printf ".stabs \"f%d:F1\",36,0,%d,f%d\n", i, i * 3 + 1, i
+			printf "f%d:\n", i
+			printf ".stabn 68,0,%d,LM%d_0-f%d\n", i * 3 + 1, i, i
+			printf "LM%d_0:\n\tldi\tr24, %d\n", i, i % 256
+			printf ".stabn 68,0,%d,LM%d_1-f%d\n", i * 3 + 2, i, i
+			printf "LM%d_1:\n\tret\n", i
+		}
+		print "main:\n\trjmp\tmain"
+	}' > "${DIR}/bench.asm"
+	;;
+encode)
+	awk -v n="${N}" 'BEGIN {
+		print ".device atmega2560"
+		for (i = 0; i < n; i++) {
+			printf "b%d:\n", i
+			print "\tnop\n\tlpm\tr1, z+\n\tbset\t3\n\tser\tr17\n\tcom\tr5\n\tclr\tr20"
+			printf "\tbrne\tb%d\n\trjmp\tb%d\n\tcall\tb%d\n\tbrbs\t1, b%d\n", i, i, i, i
+			print "\tadd\tr1, r31\n\tmovw\tr2, r30\n\tmuls\tr16, r31\n\tfmulsu\tr17, r23"
+			print "\tadiw\tr26, 33\n\tldi\tr18, 0x0f\n\tbld\tr3, 7\n\tin\tr6, 0x3f"
+			print "\tout\t0x21, r7\n\tsbi\t0x1f, 2\n\tlds\tr8, 0x1234\n\tsts\t0x0100, r9"
+			print "\tld\tr10, -x\n\tst\ty+, r11\n\tldd\tr12, z+5\n\tstd\ty+63, r13\n\txch\tz, r16"
+		}
+	}' > "${DIR}/bench.asm"
+	;;
+devices)
+	i=0
+	for inc in "${top}"/includes/*.inc; do
+		[ "${i}" -lt "${N}" ] || break
+		printf '.include "%s"\n' "${inc}" > "${DIR}/$(basename "${inc}" .inc).asm"
+		i=$((i + 1))
+	done
+	;;
+*)
+	echo "$0: unknown kind ${KIND}" >&2
+	exit 1
+	;;
+esac
@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Assemble sources made by bench/gen.sh at growing sizes and report the
+# median, minimum and maximum time of each size. A round assembles every
+# source of the size once. The last column is the median time relative to
+# the previous size: about 2.0 per doubling is linear scaling, about 4.0
+# quadratic. depth is the macro nesting depth of the macros kind.
+#
+# usage: bench/run.sh [avra binary] [rounds] [kinds] [depth]
+
+top="$(cd "$(dirname "$0")/.." && pwd)"
+AVRA="${1:-${top}/src/avra}"
+ROUNDS="${2:-5}"
+KINDS="${3:-labels equ macros includes cond db stabs encode devices}"
+DEPTH="${4:-4}"
+
+case "${AVRA}" in
+/*) ;;
+*) AVRA="$(pwd)/${AVRA}" ;;
+esac
+
+work="$(mktemp -d)"
+trap 'rm -rf "${work}"' EXIT
+
+now() {
+	date +%s%N
+}
+
+# Sizes of each kind, doubling
+sizes() {
+	case "$1" in
+	includes)	echo "25 50 100 200" ;;
+	devices)	echo "10 20 40" ;;
+	macros)		echo "250 500 1000 2000" ;;
+	encode)		echo "500 1000 2000 4000" ;;
+	*)		echo "2000 4000 8000 16000" ;;
+	esac
+}
+
+printf '%-10s %8s %10s %10s %10s %7s\n' kind size "median ms" "min ms" "max ms" scale
+for kind in ${KINDS}; do
+	flags=""
+	[ "${kind}" = stabs ] && flags="--coff"
+	previous=""
+	for size in $(sizes "${kind}"); do
+		rm -rf "${work}/src"
+		"${top}/bench/gen.sh" "${kind}" "${size}" "${work}/src" "${DEPTH}" || exit 1
+		round=1
+		: > "${work}/times"
+		while [ "${round}" -le "${ROUNDS}" ]; do
+			start="$(now)"
+			(cd "${work}/src" && for src in *.asm; do
+				"${AVRA}" ${flags} "${src}" > /dev/null 2>&1
+			done)
+			end="$(now)"
+			echo $(( (end - start) / 1000 )) >> "${work}/times"
+			round=$((round + 1))
+		done
+		sort -n "${work}/times" | awk -v kind="${kind}" -v size="${size}" -v prev="${previous}" '
+			{ t[NR] = $1 }
+			END {
+				median = (NR % 2) ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+				scale = (prev > 0) ? sprintf("%.2f", median / prev) : "-"
+				printf "%-10s %8d %10.2f %10.2f %10.2f %7s\n", kind, size,
+				       median / 1000, t[1] / 1000, t[NR] / 1000, scale
+				print median > "/dev/stderr"
+			}' 2> "${work}/median"
+		previous="$(cat "${work}/median")"
+	done
+done
@@ -98,8 +98,8 @@ process_optvalue(const char *optname, struct arg *cur, const char *optval)
 				ok = False;
 				break;
 			}
-			cur->data.i = (int)numeric;
 		}
+		cur->data.i = (int)numeric;
 		break;
 	case ARGTYPE_STRING:
 		cur->data.p = optval;
@@ -123,7 +123,8 @@ process_optvalue(const char *optname, struct arg *cur, const char *optval)
 int
 read_args(struct args *args, int argc, const char *argv[])
 {
-	int i, j, k, ok, i_old;
+	int i, j, k, ok, i_old, len;
+	const char *value;
 	struct data_list **last_data;
 
 	ok = True;
@@ -132,14 +133,15 @@ read_args(struct args *args, int argc, const char *argv[])
 	last_data = &args->first_data;
 
 	for (i = 1; (i < argc) && ok; i++) {
-		if (argv[i][0] == '-') {
+		if ((argv[i][0] == '-') && argv[i][1]) {	/* "-" alone is stdin */
 			last_data = &args->first_data;
-			if (argv[i][1] == 0) {
-				printf("Error: Unknown option: -\n");
-				ok = False;
-			} else if (argv[i][1] == '-') {
+			if (argv[i][1] == '-') {
+				/* --option value or --option=value */
+				value = strchr(&argv[i][2], '=');
+				len = value ? value - &argv[i][2] : (int)strlen(&argv[i][2]);
 				j = 0;
-				while ((j != args->count) && strcmp(&argv[i][2], args->arg[j].longarg)) {
+				while ((j != args->count)
+				        && (strncmp(&argv[i][2], args->arg[j].longarg, len) || args->arg[j].longarg[len])) {
 					j++;
 				}
 				if (j == args->count) {
@@ -152,7 +154,9 @@ read_args(struct args *args, int argc, const char *argv[])
 					case ARGTYPE_NUMERIC:
 					case ARGTYPE_CHOICE:
 						/* if argument is a string parameter we will do this: */
-						if ((i + 1) == argc) {
+						if (value) {
+							ok = process_optvalue(argv[i], &args->arg[j], value + 1);
+						} else if ((i + 1) == argc) {
 							printf("Error: No argument supplied with option: %s\n", argv[i]);
 							ok = False;
 						} else {
@@ -161,10 +165,14 @@ read_args(struct args *args, int argc, const char *argv[])
 						}
 						break;
 					case ARGTYPE_BOOLEAN:
-						args->arg[j].data.i = True;
-						break;
 					case ARGTYPE_STRING_MULTI:
-						last_data = &args->arg[j].data.dl;
+						if (value) {
+							printf("Error: Option --%s takes no value\n", args->arg[j].longarg);
+							ok = False;
+						} else if (args->arg[j].type == ARGTYPE_BOOLEAN)
+							args->arg[j].data.i = True;
+						else
+							last_data = &args->arg[j].data.dl;
 						break;
 					}
 				}
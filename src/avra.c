@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "misc.h"
 #include "args.h"
@@ -41,25 +42,63 @@ const char *title = "AVRA: advanced AVR macro assembler (version %s)\n";
 
 const char *usage =
     "usage: avra [-f][O|M|I|G] output file type\n"
-    "            [-o <filename>] output file name\n"
+    "            [-o <filename>] output file name (- for stdout)\n"
     "            [-d <filename>] debug file name\n"
     "            [-e <filename>] file name to output EEPROM contents\n"
     "            [-l <filename>] generate list file\n"
     "            [-m <mapfile>] generate map file\n"
+    "            [--mapsort none|addr|name] [--mapjson <filename>]\n"
+    "            [--stats] [--statsjson <filename>] [--profile <filename>]\n"
+    "            [--trace <filename>] [--trace_threshold <us>] [--check]\n"
+    "            [--delta <hexfile>] [--page_size <bytes>]\n"
+    "            [--hex_record <bytes>] [--hex_pages] [--hex_pad]\n"
+    "            [--device_matrix <device>[:<symbol>[=<value>]...],...]\n"
+    "            [--relax]\n"
     "            [--define <symbol>[=<value>]]\n"
     "            [-I <dir>] [--listmac]\n"
-    "            [--max_errors <number>] [--devices] [--version]\n"
+    "            [--max_errors <number>] [--max_macro_depth <number>]\n"
+    "            [--devices] [--version]\n"
     "            [-O e|w|i]\n"
     "            [-h] [--help] general help\n"
-    "            <file to assemble>\n"
+    "            <file to assemble, - for stdin>\n"
     "\n"
     "   --listfile    -l : Create list file\n"
     "   --mapfile     -m : Create map file\n"
+    "   --mapsort        : Order of the map file symbols: none (default),\n"
+    "                      addr (by value) or name.\n"
+    "   --mapjson        : Also write the map as JSON lines.\n"
+    "   --stats          : Print time and counters of each assembly phase.\n"
+    "   --statsjson      : Write the statistics as JSON (\"-\" for stdout).\n"
+    "   --profile        : Print the files and macros taking the most time and\n"
+    "                      write their call stacks for flamegraph tools.\n"
+    "   --trace          : Write a timeline as Chrome trace events.\n"
+    "   --trace_threshold: Shortest macro expansion traced in microseconds\n"
+    "                      (default: 100)\n"
+    "   --check          : Only report errors and warnings, as\n"
+    "                      file:line: error|warning|note: message.\n"
+    "                      No output files are written.\n"
+    "   --delta          : Also write the flash pages that differ from\n"
+    "                      the given HEX file to <name>.delta.hex.\n"
+    "   --page_size      : Flash page size in bytes (default: that of the\n"
+    "                      device, or 128).\n"
+    "   --hex_record     : Data bytes per HEX record, 1-255 (default: 16)\n"
+    "   --hex_pages      : Write the code HEX file by flash page, records\n"
+    "                      never crossing a page boundary.\n"
+    "   --hex_pad        : As --hex_pages, and fill the pages written with\n"
+    "                      0xFF.\n"
+    "   --device_matrix  : Assemble once for each device (and symbols to\n"
+    "                      define) of the list, in parallel. Output file\n"
+    "                      names get the device name before the extension.\n"
+    "   --relax          : Write JMP and CALL as RJMP and RCALL where the\n"
+    "                      target is in reach, and out of range branches\n"
+    "                      as an inverted branch over a jump.\n"
+    "   Options with a value also take the form --option=value.\n"
     "   --define      -D : Define symbol.\n"
     "   --includedir  -I : Additional include paths. Default: %s\n"
     "   --listmac        : List macro expansion in listfile.\n"
     "   --max_errors     : Maximum number of errors before exit\n"
     "                      (default: 10)\n"
+    "   --max_macro_depth: Maximum nesting of macro calls (default: 256)\n"
     "   --devices        : List out supported devices.\n"
     "   --version        : Version information.\n"
     "   -O e|w|i         : Issue error/warning/ignore overlapping code.\n"
@@ -72,6 +111,13 @@ const struct dataset overlap_choice[4] = {
 	{ -1, NULL}
 };
 
+const struct dataset mapsort_choice[4] = {
+	{ MAPSORT_NONE, "none"},
+	{ MAPSORT_ADDR, "addr"},
+	{ MAPSORT_NAME, "name"},
+	{ -1, NULL}
+};
+
 const int SEG_BSS_DATA = 0x01;
 
 static struct prog_info PROG_INFO;
@@ -106,9 +152,9 @@ int
 main(int argc, const char *argv[])
 {
 	int show_usage = False;
-	struct prog_info *pi;
 	struct args *args;
 	unsigned char c;
+	double started, parsed;
 
 #if debug == 1
 	int i;
@@ -118,7 +164,7 @@ main(int argc, const char *argv[])
 	}
 #endif
 
-	printf(title, VERSION);
+	started = stats_clock();
 
 	args = alloc_args(ARG_COUNT);
 	if (args) {
@@ -126,6 +172,7 @@ main(int argc, const char *argv[])
 		define_arg(args, ARG_INCLUDEPATH, ARGTYPE_STRING_MULTISINGLE,  'I', "includedir",  NULL, NULL);
 		define_arg(args, ARG_LISTMAC,     ARGTYPE_BOOLEAN,              0,  "listmac",     "1",  NULL);
 		define_arg_int(args, ARG_MAX_ERRORS,  ARGTYPE_NUMERIC,               0,  "max_errors",  10, NULL);
+		define_arg_int(args, ARG_MAX_MACRO_DEPTH, ARGTYPE_NUMERIC,          0,  "max_macro_depth", MAX_NESTED_MACROLOOPS, NULL);
 		define_arg(args, ARG_COFF,        ARGTYPE_BOOLEAN,              0,  "coff",        NULL, NULL);
 		define_arg(args, ARG_DEVICES,     ARGTYPE_BOOLEAN,              0,  "devices",     NULL, NULL);
 		define_arg(args, ARG_VER,         ARGTYPE_BOOLEAN,              0,  "version",     NULL, NULL);
@@ -139,22 +186,38 @@ main(int argc, const char *argv[])
 		define_arg(args, ARG_DEBUGFILE,   ARGTYPE_STRING,              'd', "debugfile",   NULL, NULL);
 		define_arg(args, ARG_EEPFILE,     ARGTYPE_STRING,              'e', "eepfile",     NULL, NULL);
 		define_arg_int(args, ARG_OVERLAP, ARGTYPE_CHOICE,              'O', "overlap",     OVERLAP_ERROR, overlap_choice);
+		define_arg_int(args, ARG_MAPSORT, ARGTYPE_CHOICE,               0,  "mapsort",     MAPSORT_NONE,  mapsort_choice);
+		define_arg(args, ARG_MAPJSON,     ARGTYPE_STRING,               0,  "mapjson",     NULL, NULL);
+		define_arg(args, ARG_STATS,       ARGTYPE_BOOLEAN,              0,  "stats",       NULL, NULL);
+		define_arg(args, ARG_STATSJSON,   ARGTYPE_STRING,               0,  "statsjson",   NULL, NULL);
+		define_arg(args, ARG_PROFILE,     ARGTYPE_STRING,               0,  "profile",     NULL, NULL);
+		define_arg(args, ARG_TRACE,       ARGTYPE_STRING,               0,  "trace",       NULL, NULL);
+		define_arg_int(args, ARG_TRACE_THRESHOLD, ARGTYPE_NUMERIC,      0,  "trace_threshold", 100, NULL);
+		define_arg(args, ARG_CHECK,       ARGTYPE_BOOLEAN,              0,  "check",       NULL, NULL);
+		define_arg(args, ARG_DELTA,       ARGTYPE_STRING,               0,  "delta",       NULL, NULL);
+		define_arg_int(args, ARG_PAGE_SIZE, ARGTYPE_NUMERIC,            0,  "page_size",   0, NULL);
+		define_arg_int(args, ARG_HEX_RECORD, ARGTYPE_NUMERIC,           0,  "hex_record",  16, NULL);
+		define_arg(args, ARG_HEX_PAGES,   ARGTYPE_BOOLEAN,              0,  "hex_pages",   NULL, NULL);
+		define_arg(args, ARG_HEX_PAD,     ARGTYPE_BOOLEAN,              0,  "hex_pad",     NULL, NULL);
+		define_arg(args, ARG_DEVICE_MATRIX, ARGTYPE_STRING_MULTISINGLE, 0,  "device_matrix", NULL, NULL);
+		define_arg(args, ARG_RELAX,       ARGTYPE_BOOLEAN,              0,  "relax",       NULL, NULL);
 
 
 		c = read_args(args, argc, argv);
+		parsed = stats_clock();
+		if (c != 0)
+			redirect_stdout(args);
+		printf(title, VERSION);
 
 		if (c != 0) {
 			if (!GET_ARG_I(args, ARG_HELP) && (argc != 1))	{
 				if (!GET_ARG_I(args, ARG_VER)) {
-					if (!GET_ARG_I(args, ARG_DEVICES)) {
-						pi = init_prog_info(&PROG_INFO, args);
-						if (pi) {
-							get_rootpath(pi, args);  /* get assembly root path */
-							if (assemble(pi) != 0) { /* the main assembly call */
-								exit(EXIT_FAILURE);
-							}
-							free_pi(pi);             /* free all allocated memory */
-						}
+					if (GET_ARG_LIST(args, ARG_DEVICE_MATRIX)) {
+						if (device_matrix(args, started, parsed) != EXIT_SUCCESS)
+							exit(EXIT_FAILURE);
+					} else if (!GET_ARG_I(args, ARG_DEVICES)) {
+						if (assemble_source(args, NULL, NULL, started, parsed) != EXIT_SUCCESS)
+							exit(EXIT_FAILURE);
 					} else {
 						list_devices();            /* list all supported devices */
 					}
@@ -165,6 +228,7 @@ main(int argc, const char *argv[])
 		free_args(args);
 	} else {
 		show_usage = True;
+		printf(title, VERSION);
 		printf("\n");
 	}
 	if (show_usage) {
@@ -178,6 +242,40 @@ main(int argc, const char *argv[])
 	return (0);
 }
 
+/* Assemble the source file of args. For --device_matrix, device replaces
+ * the device of the source and the output files are named after
+ * output_name instead of the source file. Returns EXIT_SUCCESS or
+ * EXIT_FAILURE. */
+int
+assemble_source(struct args *args, const char *device, const char *output_name, double started, double parsed)
+{
+	struct prog_info *pi;
+
+	pi = init_prog_info(&PROG_INFO, args);
+	if (!pi)
+		return (EXIT_SUCCESS);
+	if (output_name)
+		pi->output_name = output_name;
+	if (device) {
+		pi->device = get_device(pi, (char *)device);
+		if (!pi->device) {
+			printf("Error: Unknown device: %s\n", device);
+			return (EXIT_FAILURE);
+		}
+		pi->device_fixed = True;
+		init_segment_size(pi, pi->device);
+	}
+	if (pi->trace)
+		trace_start(pi, started, parsed);
+	get_rootpath(pi, args);  /* get assembly root path */
+	if (assemble(pi) != 0) { /* the main assembly call */
+		trace_close(pi);
+		return (EXIT_FAILURE);
+	}
+	free_pi(pi);             /* free all allocated memory */
+	return (EXIT_SUCCESS);
+}
+
 void
 get_rootpath(struct prog_info *pi, struct args *args)
 {
@@ -212,22 +310,53 @@ get_rootpath(struct prog_info *pi, struct args *args)
 }
 
 
+/* Second pass of --check: every expression and range check of a full
+ * build, but nothing is written */
+static int
+check(struct prog_info *pi)
+{
+	int ok;
+
+	printf("Pass 2...\n");
+	STAT_BEGIN(pi, STAT_PASS_2);
+	ok = parse_file(pi, pi->args->first_data->data);
+	STAT_END(pi, STAT_PASS_2);
+	printf("done\n\n");
+	if (!ok)
+		printf("Check aborted with %d errors and %d warnings.\n", pi->error_count, pi->warning_count);
+	else if (pi->error_count)
+		printf("Check failed with %d errors and %d warnings.\n", pi->error_count, pi->warning_count);
+	else if (pi->warning_count)
+		printf("Check complete with no errors (%d warnings).\n", pi->warning_count);
+	else
+		printf("Check complete with no errors.\n");
+	return (ok);
+}
+
 int
 assemble(struct prog_info *pi)
 {
-	unsigned char c;
+	unsigned char c = True;
 
 	if (pi->args->first_data) {
 		printf("Pass 1...\n");
 		if (load_arg_defines(pi)==False)
 			return -1;
+		TRACE_BEGIN(pi, "predef_dev", "setup");
 		if (predef_dev(pi)==False)
 			return -1;
+		TRACE_END(pi, "predef_dev", "setup");
 
 		/*** FIRST PASS ***/
-		def_orglist(pi->cseg);
+		if (!def_orglist(pi->cseg))
+			return -1;
+		STAT_BEGIN(pi, STAT_PASS_1);
 		c = parse_file(pi, pi->args->first_data->data);
-		fix_orglist(pi->segment);
+		STAT_END(pi, STAT_PASS_1);
+		if (!fix_orglist(pi->segment))
+			c = False;
+		if (pi->relax && (c != False) && (pi->error_count == 0))
+			relax(pi);
 		test_orglist(pi->cseg);
 		test_orglist(pi->dseg);
 		test_orglist(pi->eseg);
@@ -235,35 +364,37 @@ assemble(struct prog_info *pi)
 		if (c != False) {
 			/* if there are no further errors, we can continue with 2nd pass */
 			if (pi->error_count == 0) {
-				pi->segment = pi->cseg;
-				rewind_segments(pi);
-				/* Optimization: clear symbol lookup cache for new pass */
-				pi->cached_label = NULL;
-				pi->cached_constant = NULL;
-				pi->cached_variable = NULL;
-				pi->pass=PASS_2;
-				if (load_arg_defines(pi)==False)
-					return -1;
-				if (predef_dev(pi)==False)
+				if (start_pass_2(pi)==False)
 					return -1;
 				/*** SECOND PASS ***/
-				c = open_out_files(pi, pi->args->first_data->data,
-				                   GET_ARG_P(pi->args, ARG_OUTFILE),
-				                   GET_ARG_P(pi->args, ARG_DEBUGFILE),
-				                   GET_ARG_P(pi->args, ARG_EEPFILE));
-				if (c != 0) {
+				if (pi->check) {
+					c = check(pi);
+				} else if (open_out_files(pi, pi->output_name,
+				                          GET_ARG_P(pi->args, ARG_OUTFILE),
+				                          GET_ARG_P(pi->args, ARG_DEBUGFILE),
+				                          GET_ARG_P(pi->args, ARG_EEPFILE))) {
 					printf("Pass 2...\n");
+					STAT_BEGIN(pi, STAT_PASS_2);
 					parse_file(pi, pi->args->first_data->data);
+					STAT_END(pi, STAT_PASS_2);
 					printf("done\n\n");
-					if (pi->list_file)
+					if (pi->list_file) {
+						STAT_BEGIN(pi, STAT_LIST);
+						list_flush(pi);
 						fprint_segments(pi->list_file, pi);
+						STAT_END(pi, STAT_LIST);
+					}
 					if (pi->coff_file && pi->error_count == 0) {
+						STAT_BEGIN(pi, STAT_COFF);
 						write_coff_file(pi);
+						STAT_END(pi, STAT_COFF);
 					}
+					STAT_BEGIN(pi, STAT_MAP);
 					write_map_file(pi);
+					STAT_END(pi, STAT_MAP);
 					if (pi->error_count) {
 						printf("\nAssembly aborted with %d errors and %d warnings.\n", pi->error_count, pi->warning_count);
-						unlink_out_files(pi, pi->args->first_data->data);
+						unlink_out_files(pi, pi->output_name);
 					} else {
 						if (pi->warning_count)
 							printf("\nAssembly complete with no errors (%d warnings).\n", pi->warning_count);
@@ -272,17 +403,51 @@ assemble(struct prog_info *pi)
 						close_out_files(pi);
 					}
 				}
+			} else if (pi->check) {
+				printf("\nCheck failed with %d errors and %d warnings.\n", pi->error_count, pi->warning_count);
 			} else	{
-				unlink_out_files(pi, pi->args->first_data->data);
+				unlink_out_files(pi, pi->output_name);
 			}
 		}
+		stats_report(pi);
+		profile_report(pi);
 	} else {
 		printf("Error: You need to specify a file to assemble\n");
 	}
+	/* A --check that could not read all of the source failed */
+	if (pi->check && (c == False))
+		return -1;
 	return pi->error_count;
 }
 
 
+/* Rewind everything pass 2 replays, for pass 2 itself or a pass of relax() */
+int
+start_pass_2(struct prog_info *pi)
+{
+	struct include_file *include_file;
+
+	pi->segment = pi->cseg;
+	rewind_segments(pi);
+	/* Optimization: clear symbol lookup cache for new pass */
+	pi->cached_constant = NULL;
+	pi->cached_variable = NULL;
+	pi->next_macro_call = pi->first_macro_call;
+	pi->cond_next = 0;
+	pi->relax_next = 0;
+	pi->skip_before = False;
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next)
+		include_file->opens[PASS_2] = 0;
+	pi->pass=PASS_2;
+	if (load_arg_defines(pi)==False)
+		return (False);
+	TRACE_BEGIN(pi, "predef_dev", "setup");
+	if (predef_dev(pi)==False)
+		return (False);
+	TRACE_END(pi, "predef_dev", "setup");
+	return (True);
+}
+
 int
 load_arg_defines(struct prog_info *pi)
 {
@@ -358,17 +523,24 @@ init_prog_info(struct prog_info *pi, struct args *args)
 
 	memset(pi, 0, sizeof(struct prog_info));
 	pi->args = args;
+	pi->output_name = args->first_data ? args->first_data->data : NULL;
 	pi->device = get_device(pi,NULL);
 	if (GET_ARG_P(args, ARG_LISTFILE) == NULL) {
 		pi->list_on = False;
 	} else {
 		pi->list_on = True;
 	}
-	if (GET_ARG_P(args, ARG_MAPFILE) == NULL) {
+	/* --check writes no files at all */
+	pi->check = GET_ARG_I(args, ARG_CHECK);
+	if (pi->check)
+		pi->list_on = False;
+	if (pi->check || ((GET_ARG_P(args, ARG_MAPFILE) == NULL) && (GET_ARG_P(args, ARG_MAPJSON) == NULL))) {
 		pi->map_on = False;
 	} else {
 		pi->map_on = True;
 	}
+	if (!stats_open(pi) || !profile_open(pi) || !trace_open(pi))
+		return (NULL);
 	for (warnings = GET_ARG_LIST(args, ARG_WARNINGS); warnings; warnings = warnings->next) {
 		if (!nocase_strcmp(warnings->data, "NoRegDef"))
 			pi->NoRegDef = 1;
@@ -388,10 +560,12 @@ init_prog_info(struct prog_info *pi, struct args *args)
 	pi->segment = pi->cseg;
 
 	pi->max_errors = GET_ARG_I(args, ARG_MAX_ERRORS);
+	pi->max_macro_depth = GET_ARG_I(args, ARG_MAX_MACRO_DEPTH);
 	pi->pass=PASS_1;
 	pi->time=time(NULL);
 	pi->effective_overlap = GET_ARG_I(pi->args, ARG_OVERLAP);
 	pi->segment_overlap = SEG_DONT_OVERLAP;
+	pi->relax = GET_ARG_I(args, ARG_RELAX);
 	return (pi);
 }
 
@@ -402,9 +576,15 @@ free_pi(struct prog_info *pi)
 	free_labels(pi);
 	free_constants(pi);
 	free_variables(pi);
-	free_ifdef_blacklist(pi);
-	free_ifndef_blacklist(pi);
+	free_conditionals(pi);
+	free(pi->relax_sites);
+	pi->relax_sites = NULL;
+	free_macro_frames(pi);
+	free_include_paths(pi);
 	free_orglist(pi);
+	stats_close(pi);
+	profile_close(pi);
+	trace_close(pi);
 }
 
 void
@@ -419,6 +599,8 @@ void
 print_msg(struct prog_info *pi, int type, char *fmt, ...)
 {
 	char *pc;
+	if (pi->relaxing && (type != MSGTYPE_OUT_OF_MEM))
+		return;		/* Pass 2 reports them */
 	if (type == MSGTYPE_OUT_OF_MEM) {
 		fprintf(stderr, "Error: Unable to allocate memory!\n");
 	} else {
@@ -426,30 +608,34 @@ print_msg(struct prog_info *pi, int type, char *fmt, ...)
 			if ((pi->fi != NULL) && (pi->fi->include_file->name != NULL)) {
 				/* check if adding path name is needed */
 				pc = strstr(pi->fi->include_file->name, pi->root_path);
-				if (pc == NULL) {
-					fprintf(stderr, "%s%s(%d) : ", pi->root_path,pi->fi->include_file->name, pi->fi->line_number);
-				} else {
-					fprintf(stderr, "%s(%d) : ", pi->fi->include_file->name, pi->fi->line_number);
-				}
+				fprintf(stderr, pi->check ? "%s%s:%d: " : "%s%s(%d) : ",
+				        (pc == NULL) ? pi->root_path : "",
+				        pi->fi->include_file->name, pi->fi->line_number);
+			} else if (pi->check && pi->args->first_data) {
+				/* Not about a line, like the segment checks after pass 1 */
+				fprintf(stderr, "%s: ", (char *)pi->args->first_data->data);
 			}
 		}
+		/* --check prints "file:line: severity: [in macro file:line: ]message" */
 		switch (type) {
 		case MSGTYPE_ERROR:
 			pi->error_count++;
-			fprintf(stderr, "Error   : ");
+			fprintf(stderr, pi->check ? "error: " : "Error   : ");
 			break;
 		case MSGTYPE_WARNING:
 			pi->warning_count++;
-			fprintf(stderr, "Warning : ");
+			fprintf(stderr, pi->check ? "warning: " : "Warning : ");
 			break;
 		case MSGTYPE_MESSAGE:
-			/*			case MSGTYPE_MESSAGE_NO_LF:
-						case MSGTYPE_APPEND: */
+		case MSGTYPE_MESSAGE_NO_LF:
+			if (pi->check)
+				fprintf(stderr, "note: ");
 			break;
 		}
 		if (type != MSGTYPE_APPEND) {
 			if (pi->macro_call) {
-				fprintf(stderr, "[Macro: %s: %d:] ", pi->macro_call->macro->include_file->name,
+				fprintf(stderr, pi->check ? "in macro %s:%d: " : "[Macro: %s: %d:] ",
+				        pi->macro_call->macro->include_file->name,
 				        pi->macro_call->line_index + pi->macro_call->macro->first_line_number);
 			}
 		}
@@ -481,6 +667,7 @@ def_const(struct prog_info *pi, const char *name, int value)
 		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
 		return (False);
 	}
+	STAT_ALLOC(pi, 2, sizeof(struct label) + strlen(name) + 1);
 	strcpy(label->name, name);
 	label->value = value;
 	return (True);
@@ -507,6 +694,7 @@ def_var(struct prog_info *pi, char *name, int value)
 		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
 		return (False);
 	}
+	STAT_ALLOC(pi, 2, sizeof(struct label) + strlen(name) + 1);
 	strcpy(label->name, name);
 	label->value = value;
 	return (True);
@@ -519,6 +707,12 @@ def_orglist(struct segment_info *si)
 	struct orglist *orglist;
 
 	si->pi->segment = si;
+	if (si->pi->relaxing) {
+		/* Code moved by relax() moves the entries of pass 1 */
+		si->relax_orglist = si->relax_orglist ? si->relax_orglist->next : si->first_orglist;
+		if (si->relax_orglist)
+			si->relax_orglist->start = si->addr;
+	}
 	if (si->pi->pass != PASS_1)
 		return (True);
 	orglist = malloc(sizeof(struct orglist));
@@ -538,6 +732,8 @@ def_orglist(struct segment_info *si)
 int
 fix_orglist(struct segment_info *si)
 {
+	if (si->pi->relaxing && si->relax_orglist)
+		si->relax_orglist->length = si->addr - si->relax_orglist->start;
 	if (si->pi->pass != PASS_1)
 		return (True);
 	if ((si->last_orglist == NULL) || (si->last_orglist->length!=0)) {
@@ -592,8 +788,12 @@ test_orglist(struct segment_info *si)
 
 	int error_count=0;
 	if (si->pi->device->name == NULL) {
-		fprintf(stderr,"Warning : No .DEVICE definition found. Cannot make useful address range check !\n");
-		si->pi->warning_count++;
+		if (si->pi->check)
+			print_msg(si->pi, MSGTYPE_WARNING, "No .DEVICE definition found. Cannot make useful address range check !");
+		else {
+			fprintf(stderr,"Warning : No .DEVICE definition found. Cannot make useful address range check !\n");
+			si->pi->warning_count++;
+		}
 	}
 
 	for (orglist = si->first_orglist;
@@ -602,15 +802,25 @@ test_orglist(struct segment_info *si)
 		if (orglist->length > 0) {
 			/* Make sure address area is valid */
 			if (orglist->start < si->lo_addr) {
-				fprintf(stderr, "Segment start below allowed start address: 0x%04lX",
-				        si->lo_addr);
-				fprint_orglist(stderr, si, orglist);
+				if (si->pi->check)
+					print_msg(si->pi, MSGTYPE_ERROR, "Segment start below allowed start address: 0x%04lX (%s 0x%04X-0x%04X)",
+					          si->lo_addr, si->name, orglist->start, orglist->start + orglist->length - 1);
+				else {
+					fprintf(stderr, "Segment start below allowed start address: 0x%04lX",
+					        si->lo_addr);
+					fprint_orglist(stderr, si, orglist);
+				}
 				error_count ++;
 			}
 			if (orglist->start + orglist->length > si->hi_addr) {
-				fprintf(stderr, "Segment start above allowed high address: 0x%04lX",
-				        si->hi_addr);
-				fprint_orglist(stderr, si, orglist);
+				if (si->pi->check)
+					print_msg(si->pi, MSGTYPE_ERROR, "Segment start above allowed high address: 0x%04lX (%s 0x%04X-0x%04X)",
+					          si->hi_addr, si->name, orglist->start, orglist->start + orglist->length - 1);
+				else {
+					fprintf(stderr, "Segment start above allowed high address: 0x%04lX",
+					        si->hi_addr);
+					fprint_orglist(stderr, si, orglist);
+				}
 				error_count ++;
 			}
 
@@ -623,15 +833,22 @@ test_orglist(struct segment_info *si)
 
 						if ((orglist->start  < (orglist2->start + orglist2->length)) &&
 						        (orglist2->start < (orglist->start +  orglist->length))) {
-							fprintf(stderr,"%s: Overlapping %s segments:\n",
-							        si->pi->effective_overlap == OVERLAP_ERROR ? "Error" : "Warning",
-							        si->name);
-							fprint_orglist(stderr, si, orglist);
-							fprint_orglist(stderr, si, orglist2);
-							fprintf(stderr,"Please check your .ORG directives !\n");
+							if (si->pi->check) {
+								print_msg(si->pi, si->pi->effective_overlap == OVERLAP_ERROR ? MSGTYPE_ERROR : MSGTYPE_WARNING,
+								          "Overlapping %s segments 0x%04X-0x%04X and 0x%04X-0x%04X. Please check your .ORG directives !",
+								          si->name, orglist->start, orglist->start + orglist->length - 1,
+								          orglist2->start, orglist2->start + orglist2->length - 1);
+							} else {
+								fprintf(stderr,"%s: Overlapping %s segments:\n",
+								        si->pi->effective_overlap == OVERLAP_ERROR ? "Error" : "Warning",
+								        si->name);
+								fprint_orglist(stderr, si, orglist);
+								fprint_orglist(stderr, si, orglist2);
+								fprintf(stderr,"Please check your .ORG directives !\n");
+							}
 							if (si->pi->effective_overlap == OVERLAP_ERROR)
 								error_count++;
-							else
+							else if (!si->pi->check)
 								si->pi->warning_count++;
 						}
 					}
@@ -639,24 +856,86 @@ test_orglist(struct segment_info *si)
 			} /* Overlap-test */
 		}
 	}
-	si->pi->error_count += error_count;
+	if (!si->pi->check)	/* print_msg() counted them */
+		si->pi->error_count += error_count;
 	return (error_count > 0 ? False : True);
 }
 
-/* Get the value of a label. Return FALSE if label was not found */
+/* Bucket of label_hash for name in scope */
+static struct label **
+label_bucket(struct prog_info *pi, const char *name, const struct macro_call *scope)
+{
+	unsigned int hash = nocase_hash(name, strlen(name));
+
+	/* Every macro call is a scope of its own, mix in its address */
+	hash ^= (unsigned int)((uintptr_t)scope / sizeof(struct macro_call)) * 2654435761u;
+	return (&pi->label_hash[hash & (LABEL_HASH_SIZE - 1)]);
+}
+
+/* The label name defined in scope (NULL for the global labels), or NULL */
+struct label *
+find_label(struct prog_info *pi, const char *name, const struct macro_call *scope)
+{
+	struct label *label;
+
+	for (label = *label_bucket(pi, name, scope); label; label = label->hash_next)
+		if ((label->scope == scope) && !nocase_strcmp(label->name, name))
+			return (label);
+	return (NULL);
+}
+
+/* Add label to scope, a macro call or NULL for the global labels */
+void
+add_label(struct prog_info *pi, struct label *label, struct macro_call *scope)
+{
+	struct label **bucket = label_bucket(pi, label->name, scope);
+
+	label->next = NULL;
+	label->scope = scope;
+	if (scope) {
+		if (scope->last_label)
+			scope->last_label->next = label;
+		else
+			scope->first_label = label;
+		scope->last_label = label;
+	} else {
+		if (pi->last_label)
+			pi->last_label->next = label;
+		else
+			pi->first_label = label;
+		pi->last_label = label;
+	}
+	label->hash_next = *bucket;
+	*bucket = label;
+}
+
+/* Get the value of a global label. Return FALSE if label was not found */
 int
 get_label(struct prog_info *pi,char *name,int *value)
 {
-	struct label *label=search_symbol(pi,pi->first_label,name,NULL);
+	struct label *label=find_label(pi,name,NULL);
 	if (label==NULL) return False;
 	if (value!=NULL)	*value=label->value;
 	return True;
 }
 
+/* Search the constants, defining the device constants on first use */
+static struct label *
+search_constant(struct prog_info *pi,char *name,char *message)
+{
+	struct label *label=search_symbol(pi,pi->first_constant,name,message);
+	if ((label==NULL) && def_dev_const(pi,name)) {
+		label=pi->last_constant;
+		if (message)
+			print_msg(pi, MSGTYPE_ERROR, message, name);
+	}
+	return label;
+}
+
 int
 get_constant(struct prog_info *pi,char *name,int *value)
 {
-	struct label *label=search_symbol(pi,pi->first_constant,name,NULL);
+	struct label *label=search_constant(pi,name,NULL);
 	if (label==NULL) return False;
 	if (value!=NULL)	*value=label->value;
 	return True;
@@ -675,12 +954,16 @@ get_variable(struct prog_info *pi,char *name,int *value)
 /* If message != NULL print error message if symbol is defined */
 struct label *test_label(struct prog_info *pi,char *name,char *message)
 {
-	return search_symbol(pi,pi->first_label,name,message);
+	struct label *label = find_label(pi, name, NULL);
+
+	if (label && message)
+		print_msg(pi, MSGTYPE_ERROR, message, name);
+	return (label);
 }
 
 struct label *test_constant(struct prog_info *pi,char *name,char *message)
 {
-	return search_symbol(pi,pi->first_constant,name,message);
+	return search_constant(pi,name,message);
 }
 
 struct label *test_variable(struct prog_info *pi,char *name,char *message)
@@ -688,8 +971,8 @@ struct label *test_variable(struct prog_info *pi,char *name,char *message)
 	return search_symbol(pi,pi->first_variable,name,message);
 }
 
-/* Search in label,constant,variable,blacklist - list for a matching entry */
-/* Use first = pi->first_label,first_constant,first_variable,first_blacklist to select list */
+/* Search in constant,variable - list for a matching entry */
+/* Use first = pi->first_constant,first_variable to select list */
 /* If message != NULL Print error message if symbol is defined */
 struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,char *message)
 {
@@ -697,9 +980,7 @@ struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,
 
 	/* Performance optimization: check cache before linear search */
 	/* This significantly speeds up repeated lookups in the same assembly pass */
-	if (first == pi->first_label && pi->cached_label && !nocase_strcmp(pi->cached_label->name, name))
-		label = pi->cached_label;
-	else if (first == pi->first_constant && pi->cached_constant && !nocase_strcmp(pi->cached_constant->name, name))
+	if (first == pi->first_constant && pi->cached_constant && !nocase_strcmp(pi->cached_constant->name, name))
 		label = pi->cached_constant;
 	else if (first == pi->first_variable && pi->cached_variable && !nocase_strcmp(pi->cached_variable->name, name))
 		label = pi->cached_variable;
@@ -709,9 +990,7 @@ struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,
 		for (label = first; label; label = label->next)
 			if (!nocase_strcmp(label->name, name)) {
 				/* Cache this result for future lookups */
-				if (first == pi->first_label)
-					pi->cached_label = label;
-				else if (first == pi->first_constant)
+				if (first == pi->first_constant)
 					pi->cached_constant = label;
 				else if (first == pi->first_variable)
 					pi->cached_variable = label;
@@ -725,58 +1004,99 @@ struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,
 	return (label);
 }
 
+/* Record the outcome of a .IF, .IFDEF, .IFNDEF or .ELIF in pass 1, or
+ * replay it in pass 2. Pass 2 takes the same path through the source as
+ * pass 1, so its n-th conditional is the n-th one of pass 1, and a symbol
+ * defined after a conditional cannot change its outcome in pass 2. */
 int
-ifdef_blacklist(struct prog_info *pi)
+conditional_outcome(struct prog_info *pi, int *outcome)
 {
-	struct location *loc;
-	loc = malloc(sizeof(struct location));
-	if (!loc) {
-		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-		return False;
-	}
-	LIST_APPEND(loc, pi->first_ifdef_blacklist, pi->last_ifdef_blacklist);
-	loc->line_num = pi->fi->line_number;
-	loc->file_num = pi->fi->include_file->num;
-	return True;
-}
+	unsigned char *bits;
+	int size;
 
-int
-ifndef_blacklist(struct prog_info *pi)
-{
-	struct location *loc;
-	loc = malloc(sizeof(struct location));
-	if (!loc) {
-		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-		return False;
+	if (pi->pass == PASS_2) {
+		if (pi->cond_next >= pi->cond_count) {
+			print_msg(pi, MSGTYPE_ERROR, "Internal assembler error");
+			return (False);
+		}
+		*outcome = (pi->cond_outcome[pi->cond_next >> 3] >> (pi->cond_next & 7)) & 1;
+		pi->cond_next++;
+		return (True);
 	}
-	LIST_APPEND(loc, pi->first_ifndef_blacklist, pi->last_ifndef_blacklist);
-	loc->line_num = pi->fi->line_number;
-	loc->file_num = pi->fi->include_file->num;
-	return True;
+	if ((pi->cond_count >> 3) >= pi->cond_size) {
+		size = pi->cond_size ? pi->cond_size * 2 : 256;
+		bits = realloc(pi->cond_outcome, size);
+		if (!bits) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		memset(&bits[pi->cond_size], 0, size - pi->cond_size);
+		STAT_ALLOC(pi, 1, size - pi->cond_size);
+		pi->cond_outcome = bits;
+		pi->cond_size = size;
+	}
+	if (*outcome)
+		pi->cond_outcome[pi->cond_count >> 3] |= 1 << (pi->cond_count & 7);
+	pi->cond_count++;
+	return (True);
 }
 
-int
-ifdef_is_blacklisted(struct prog_info *pi)
+/* Find the .DEF alias of the n character name */
+struct def *
+get_def(struct prog_info *pi, const char *name, int len)
 {
-	return search_location(pi->first_ifdef_blacklist, pi->fi->line_number, pi->fi->include_file->num);
+	struct def *def;
+
+	for (def = pi->def_hash[nocase_hash(name, len) & (DEF_HASH_SIZE - 1)]; def; def = def->hash_next)
+		if (!nocase_strcmp_n(def->name, name, len))
+			return (def);
+	return (NULL);
 }
 
-int
-ifndef_is_blacklisted(struct prog_info *pi)
+struct def *
+add_def(struct prog_info *pi, const char *name, int reg)
 {
-	return search_location(pi->first_ifndef_blacklist, pi->fi->line_number, pi->fi->include_file->num);
+	struct def *def;
+	struct def **bucket;
+
+	def = malloc(sizeof(struct def));
+	if (!def)
+		return (NULL);
+	def->name = malloc_strcpy(name);
+	if (!def->name) {
+		free(def);
+		return (NULL);
+	}
+	STAT_ALLOC(pi, 2, sizeof(struct def) + strlen(name) + 1);
+	def->reg = reg;
+	LIST_APPEND(def, pi->first_def, pi->last_def);
+	bucket = &pi->def_hash[nocase_hash(name, strlen(name)) & (DEF_HASH_SIZE - 1)];
+	def->hash_next = *bucket;
+	*bucket = def;
+	if ((reg >= 0) && (reg < 32) && !pi->reg_def[reg])
+		pi->reg_def[reg] = def;
+	return (def);
 }
 
-int
-search_location(struct location *first, int line_num, int file_num)
+/* Point an existing alias at another register, keeping reg_def[] at the
+ * first alias of each register */
+void
+set_def_reg(struct prog_info *pi, struct def *def, int reg)
 {
-	struct location *loc;
-	for (loc = first; loc; loc = loc->next) {
-		if (loc->line_num == line_num && loc->file_num == file_num) {
-			return True;
-		}
+	struct def *other;
+	int old = def->reg;
+
+	def->reg = reg;
+	if ((old >= 0) && (old < 32) && (pi->reg_def[old] == def)) {
+		pi->reg_def[old] = NULL;
+		for (other = pi->first_def; other; other = other->next)
+			if (other->reg == old) {
+				pi->reg_def[old] = other;
+				break;
+			}
 	}
-	return False;
+	if ((reg >= 0) && (reg < 32) && !pi->reg_def[reg])
+		pi->reg_def[reg] = def;
 }
 
 void
@@ -791,6 +1111,8 @@ free_defs(struct prog_info *pi)
 	}
 	pi->first_def = NULL;
 	pi->last_def = NULL;
+	memset(pi->def_hash, 0, sizeof(pi->def_hash));
+	memset(pi->reg_def, 0, sizeof(pi->reg_def));
 }
 
 void
@@ -805,7 +1127,7 @@ free_labels(struct prog_info *pi)
 	}
 	pi->first_label = NULL;
 	pi->last_label = NULL;
-	pi->cached_label = NULL;  /* Clear label cache */
+	memset(pi->label_hash, 0, sizeof(pi->label_hash));
 }
 
 void
@@ -824,29 +1146,13 @@ free_constants(struct prog_info *pi)
 }
 
 void
-free_ifdef_blacklist(struct prog_info *pi)
+free_conditionals(struct prog_info *pi)
 {
-	struct location *loc, *temp_loc;
-	for (loc = pi->first_ifdef_blacklist; loc;) {
-		temp_loc = loc;
-		loc = loc->next;
-		free(temp_loc);
-	}
-	pi->first_ifdef_blacklist = NULL;
-	pi->last_ifdef_blacklist = NULL;
-}
-
-void
-free_ifndef_blacklist(struct prog_info *pi)
-{
-	struct location *loc, *temp_loc;
-	for (loc = pi->first_ifndef_blacklist; loc;) {
-		temp_loc = loc;
-		loc = loc->next;
-		free(temp_loc);
-	}
-	pi->first_ifndef_blacklist = NULL;
-	pi->last_ifndef_blacklist = NULL;
+	free(pi->cond_outcome);
+	pi->cond_outcome = NULL;
+	pi->cond_count = 0;
+	pi->cond_size = 0;
+	pi->cond_next = 0;
 }
 
 void
@@ -43,8 +43,14 @@
 
 #define LINEBUFFER_LENGTH 4096
 #define MAX_NESTED_MACROLOOPS 256
+#define DEFAULT_PAGE_SIZE 128	/* Flash page bytes of devices without pages */
 
 #define MAX_MACRO_ARGS 10
+#define LIST_INDENT 10		/* Source text column of the list file */
+#define LIST_INDENT_SHORT 9	/* ... for lines nothing else listed */
+#define DEF_HASH_SIZE 64	/* .DEF alias buckets, a power of two */
+#define LABEL_HASH_SIZE 4096	/* Label buckets, a power of two */
+#define INCLUDE_HASH_SIZE 64	/* Include file and include path buckets, a power of two */
 
 /* warning switches */
 
@@ -54,6 +60,7 @@ enum {
 	ARG_INCLUDEPATH,	/* --includedir, -I        */
 	ARG_LISTMAC,		/* --listmac               */
 	ARG_MAX_ERRORS,		/* --max_errors            */
+	ARG_MAX_MACRO_DEPTH,	/* --max_macro_depth       */
 	ARG_COFF,		/* --coff                  */
 	ARG_DEVICES,		/* --devices               */
 	ARG_VER,		/* --version               */
@@ -67,6 +74,21 @@ enum {
 	ARG_DEBUGFILE,		/* --debugfile */
 	ARG_EEPFILE,		/* --eepfile   */
 	ARG_OVERLAP,		/* -O [w|e|i]  */
+	ARG_MAPSORT,		/* --mapsort   */
+	ARG_MAPJSON,		/* --mapjson   */
+	ARG_STATS,		/* --stats     */
+	ARG_STATSJSON,		/* --statsjson */
+	ARG_PROFILE,		/* --profile   */
+	ARG_TRACE,		/* --trace     */
+	ARG_TRACE_THRESHOLD,	/* --trace_threshold */
+	ARG_CHECK,		/* --check     */
+	ARG_DELTA,		/* --delta     */
+	ARG_PAGE_SIZE,		/* --page_size */
+	ARG_HEX_RECORD,		/* --hex_record */
+	ARG_HEX_PAGES,		/* --hex_pages */
+	ARG_HEX_PAD,		/* --hex_pad   */
+	ARG_DEVICE_MATRIX,	/* --device_matrix */
+	ARG_RELAX,		/* --relax     */
 	ARG_COUNT
 };
 
@@ -98,6 +120,19 @@ enum {
 	OVERLAP_ERROR
 };
 
+enum {
+	MAPSORT_NONE = 0,
+	MAPSORT_ADDR,
+	MAPSORT_NAME
+};
+
+/* Repetitions of read_repeat() */
+enum {
+	REPEAT_REPT = 0,
+	REPEAT_IRP,
+	REPEAT_IRPC
+};
+
 enum {
 	SEG_DONT_OVERLAP = 0,
 	SEG_ALLOW_OVERLAP
@@ -113,9 +148,93 @@ enum {
 	TERM_COLON
 };
 
+/* Token kinds returned by get_token() */
+enum {
+	TOKEN_END = 0,		/* end of line or start of comment */
+	TOKEN_IDENT,		/* label, mnemonic, register or symbol name */
+	TOKEN_DIRECTIVE,	/* .name or #name */
+	TOKEN_NUMBER,		/* 12, $1f, 0x1f, 0b101 */
+	TOKEN_STRING,		/* "text", quotes included */
+	TOKEN_CHAR,		/* 'c', quotes included */
+	TOKEN_PUNCT		/* any other single character */
+};
+
+/* Character i of a token, or '\0' past its end */
+#define TOKEN_AT(tok, i)	((i) < (tok)->len ? (tok)->start[(i)] : '\0')
+
 /* Structures */
 
 struct prog_info;
+struct listing;
+struct profile;
+struct trace;
+
+/* Timed phases of --stats */
+enum {
+	STAT_PASS_1 = 0,
+	STAT_PASS_2,
+	STAT_HEX,
+	STAT_EEP,
+	STAT_OBJ,
+	STAT_COFF,
+	STAT_LIST,
+	STAT_MAP,
+	STAT_PHASES
+};
+
+/* Counters of --stats. Without --stats pi->stats is NULL and the STAT_*
+ * macros only test that pointer. */
+struct stats {
+	double wall[STAT_PHASES];	/* Seconds spent in each phase */
+	double cpu[STAT_PHASES];
+	double wall_start[STAT_PHASES];
+	clock_t cpu_start[STAT_PHASES];
+	long lines[2];			/* Lines parsed in pass 1 and 2 */
+	long *file_lines;		/* Source lines of each include file */
+	int file_count;
+	long macro_expansions[2];	/* Per pass, like lines */
+	long expressions[2];
+	long allocations;		/* Allocations made while assembling */
+	unsigned long alloc_bytes;
+};
+
+#define STAT_COUNT(pi, counter) \
+	do { if ((pi)->stats) (pi)->stats->counter++; } while (0)
+#define STAT_ALLOC(pi, count, size) \
+	do { if ((pi)->stats) { (pi)->stats->allocations += (count); (pi)->stats->alloc_bytes += (size); } } while (0)
+/* Phases are timed for --stats and traced for --trace */
+#define STAT_BEGIN(pi, phase) \
+	do { if ((pi)->stats || (pi)->trace) phase_begin((pi), (phase)); } while (0)
+#define STAT_END(pi, phase) \
+	do { if ((pi)->stats || (pi)->trace) phase_end((pi), (phase)); } while (0)
+
+/* Frames of --profile */
+enum {
+	PROFILE_FILE = 0,
+	PROFILE_MACRO
+};
+
+#define PROFILE_ENTER(pi, kind, num) \
+	do { if ((pi)->profile) profile_enter((pi), (kind), (num)); } while (0)
+#define PROFILE_EXIT(pi) \
+	do { if ((pi)->profile) profile_exit(pi); } while (0)
+#define PROFILE_LINE(pi) \
+	do { if ((pi)->profile) profile_line(pi); } while (0)
+
+#define TRACE_BEGIN(pi, name, cat) \
+	do { if ((pi)->trace) trace_event((pi), 'B', (name), (cat)); } while (0)
+#define TRACE_END(pi, name, cat) \
+	do { if ((pi)->trace) trace_event((pi), 'E', (name), (cat)); } while (0)
+#define TRACE_CLOCK(pi)	((pi)->trace ? stats_clock() : 0.0)
+#define TRACE_MACRO(pi, name, start) \
+	do { if ((pi)->trace) trace_macro((pi), (name), (start)); } while (0)
+
+/* A slice of a source line. The line itself is never modified. */
+struct token {
+	const char *start;
+	int len;
+	int kind;
+};
 
 extern const int SEG_BSS_DATA;
 
@@ -133,6 +252,7 @@ struct segment_info {
 	struct hex_file_info *hfi;
 	struct orglist *first_orglist;
 	struct orglist *last_orglist;
+	struct orglist *relax_orglist;	/* Entry resized by the current pass of relax() */
 
 	const char *cellname;  /* byte  / word  */
 	const char *cellnames; /* bytes / words */
@@ -145,11 +265,32 @@ struct prog_info {
 	struct macro_call *macro_call;
 	struct macro_line *macro_line;
 	FILE *list_file;
+	struct listing *listing;	/* Records waiting for the list file */
+	struct delta *delta;		/* --delta images, or NULL */
+	struct stats *stats;		/* --stats counters, or NULL */
+	struct profile *profile;	/* --profile frames, or NULL */
+	struct trace *trace;		/* --trace events, or NULL */
 	int list_on;
 	int map_on;
+	int check;			/* --check, both passes without output files */
 	char *list_line;
 	char *root_path;
+	const char *output_name;	/* Output files are named after it, normally the source */
+	int device_fixed;		/* --device_matrix chose the device, .DEVICE is ignored */
+	int relax;			/* --relax, JMP, CALL and branches sized by relax() */
+	int relaxing;			/* Pass 2 repeated by relax(), without messages */
+	int relax_changed;		/* A size, label or constant changed in this pass */
+	int skip_before;		/* The last instruction skips the next one */
+	struct relax_site *relax_sites;	/* In the order of pass 1, replayed in pass 2 */
+	int relax_count;
+	int relax_size;
+	int relax_next;
 	FILE *obj_file;
+	struct obj_record *obj_records;	/* Written to obj_file when it is closed */
+	int obj_count;
+	int obj_size;
+	int obj_sorted;		/* obj_records are in address order */
+	int obj_line_warned;
 	struct segment_info *segment;
 	struct segment_info *cseg;
 	struct segment_info *dseg;
@@ -168,20 +309,32 @@ struct prog_info {
 	struct label *first_variable;
 	struct label *last_variable;
 	/* Performance optimization: cache last lookup to avoid re-scanning for frequently accessed symbols */
-	struct label *cached_label;
 	struct label *cached_constant;
 	struct label *cached_variable;
-	/* Performance optimization: cache register definition lookups (r0-r31 used repeatedly) */
-	struct def *cached_register_def;
-	const char *cached_register_name;
-	struct location *first_ifdef_blacklist;
-	struct location *last_ifdef_blacklist;
-	struct location *first_ifndef_blacklist;
-	struct location *last_ifndef_blacklist;
+	/* .DEF aliases hashed by name, and the first alias of each register */
+	struct def *def_hash[DEF_HASH_SIZE];
+	struct def *reg_def[32];
+	/* Global and macro local labels, hashed by name and scope */
+	struct label *label_hash[LABEL_HASH_SIZE];
+	/* First include_file of each file name, and include paths tested so far */
+	struct include_file *include_hash[INCLUDE_HASH_SIZE];
+	struct include_path *include_path_hash[INCLUDE_HASH_SIZE];
+	/* Outcome of every conditional in pass 1, one bit each, replayed in pass 2 */
+	unsigned char *cond_outcome;
+	int cond_count;		/* Outcomes recorded */
+	int cond_size;		/* Bytes allocated */
+	int cond_next;		/* Next outcome to replay */
 	struct macro *first_macro;
 	struct macro *last_macro;
 	struct macro_call *first_macro_call;
 	struct macro_call *last_macro_call;
+	struct macro_call *next_macro_call;	/* Pass 2: record of the next call, see find_macro_call() */
+	/* Macro expansion stack, the top frame supplies the next source line */
+	struct macro_frame **macro_frames;
+	int macro_depth;	/* Frames in use */
+	int macro_frames_size;	/* Frames allocated */
+	int max_macro_depth;
+	int defer_expansion;	/* expand_macro() only pushes the call, see run_macros() */
 	struct orglist *first_orglist;	/* List of used memory segments. Needed for overlap-check */
 	struct orglist *last_orglist;
 	int effective_overlap; /* as specified by #pragma overlap */
@@ -205,22 +358,54 @@ struct file_info {
 	struct label *label;
 };
 
+/* A JMP, CALL or conditional branch sized by --relax */
+struct relax_site {
+	unsigned char words;	/* Only grows while relax() settles the code */
+	unsigned char jump;	/* JMP or CALL, else a branch */
+	unsigned char fixed;	/* Follows a skip instruction, never more than one word */
+};
+
+/* Memory image of --delta and of HEX files written by page */
+struct image {
+	unsigned char *bytes;	/* 0xFF where nothing was written */
+	unsigned char *written;	/* True for every byte written */
+	long size;		/* Bytes allocated */
+};
+
 struct hex_file_info {
 	FILE *fp;
 	int count;
 	int linestart_addr;
 	int segment;
-	unsigned char hex_line[16];
+	int record_size;	/* Data bytes per record, at most 255 */
+	int page_size;		/* Records do not cross pages of this many bytes, 0 if none */
+	int pad;		/* Write whole pages, 0xFF where nothing was written */
+	struct image *image;	/* Bytes waiting to be written by page, or NULL */
+	unsigned char hex_line[255];
 };
 
 struct include_file {
 	struct include_file *next;
 	char *name;
 	int num;
+	char *spool;		/* Contents of stdin or a pipe, read in pass 1 */
+	size_t spool_len;
+	struct include_file *hash_next;	/* Next file name in the same include_hash bucket */
+	int opens[2];		/* Times the file was opened in each pass */
+	char *guard;		/* Symbol of the .IFNDEF include guard around the file, or NULL */
+	int guard_opens;	/* opens[PASS_1] when the guard was found */
+};
+
+/* Result of testing a path for .INCLUDE and .INCBIN */
+struct include_path {
+	struct include_path *hash_next;
+	char *name;
+	int found;
 };
 
 struct def {
 	struct def *next;
+	struct def *hash_next;	/* Next alias in the same def_hash bucket */
 	char *name;
 	int reg;
 };
@@ -229,11 +414,15 @@ struct label {
 	struct label *next;
 	char *name;
 	int value;
+	/* Labels only: */
+	struct label *hash_next;	/* Next in the bucket of label_hash */
+	struct macro_call *scope;	/* Macro call defining a local label, NULL if global */
 };
 
 struct macro {
 	struct macro *next;
 	char *name;
+	int num;
 	struct include_file *include_file;
 	int first_line_number;
 	struct macro_line *first_macro_line;
@@ -262,6 +451,7 @@ struct macro_call {
 	int line_index;
 	int prev_line_index;
 	int nest_level;
+	int iteration;		/* Of a .REPT/.IRP/.IRPC, 0 for a macro call */
 	struct label *first_label;
 	struct label *last_label;
 };
@@ -274,12 +464,6 @@ struct orglist {
 	int segment_overlap;
 };
 
-struct location {
-	struct location *next;
-	int line_num;
-	int file_num;
-};
-
 /* Prototypes */
 /* avra.c */
 [[nodiscard]]
@@ -290,9 +474,12 @@ struct prog_info *init_prog_info(struct prog_info *,struct args *args);
 void free_pi(struct prog_info *pi);
 void print_msg(struct prog_info *pi, int type, char *fmt, ...);
 void get_rootpath(struct prog_info *pi, struct args *args);
+int assemble_source(struct args *args, const char *device, const char *output_name, double started, double parsed);
 
 void init_segment_size(struct prog_info *pi, struct device *device);
 void rewind_segments(struct prog_info *pi);
+[[nodiscard]]
+int start_pass_2(struct prog_info *pi);
 void advance_ip(struct segment_info *si, int offset);
 
 [[nodiscard]]
@@ -315,58 +502,62 @@ int get_constant(struct prog_info *pi,char *name,int *value);
 [[nodiscard]]
 int get_variable(struct prog_info *pi,char *name,int *value);
 struct label *test_label(struct prog_info *pi,char *name,char *message);
+struct label *find_label(struct prog_info *pi, const char *name, const struct macro_call *scope);
+void add_label(struct prog_info *pi, struct label *label, struct macro_call *scope);
 struct label *test_constant(struct prog_info *pi,char *name,char *message);
 struct label *test_variable(struct prog_info *pi,char *name,char *message);
 struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,char *message);
 [[nodiscard]]
-int ifdef_blacklist(struct prog_info *pi);
-[[nodiscard]]
-int ifndef_blacklist(struct prog_info *pi);
-[[nodiscard]]
-int ifdef_is_blacklisted(struct prog_info *pi);
-[[nodiscard]]
-int ifndef_is_blacklisted(struct prog_info *pi);
+int conditional_outcome(struct prog_info *pi, int *outcome);
+struct def *get_def(struct prog_info *pi, const char *name, int len);
 [[nodiscard]]
-int search_location(struct location *first, int line_num, int file_num);
+struct def *add_def(struct prog_info *pi, const char *name, int reg);
+void set_def_reg(struct prog_info *pi, struct def *def, int reg);
 void free_defs(struct prog_info *pi);
 void free_labels(struct prog_info *pi);
 void free_constants(struct prog_info *pi);
-void free_ifdef_blacklist(struct prog_info *pi);
-void free_ifndef_blacklist(struct prog_info *pi);
+void free_conditionals(struct prog_info *pi);
 void free_variables(struct prog_info *pi);
 void free_orglist(struct prog_info *pi);
 
 /* parser.c */
 [[nodiscard]]
 int parse_file(struct prog_info *pi, const char *filename);
+struct include_file *find_include_file(struct prog_info *pi, const char *filename);
 [[nodiscard]]
 int parse_line(struct prog_info *pi, char *line);
 char *get_next_token(char *scratch, int term);
+const char *get_token(const char *line, struct token *tok);
+const char *get_operand(const char *data, struct token *tok);
 char *fgets_new(struct prog_info *pi, char *s, int size, FILE *stream);
 
 /* expr.c */
 [[nodiscard]]
-int get_expr(struct prog_info *pi, char *data, int *value);
+int get_expr(struct prog_info *pi, const char *data, int *value);
+int get_literal(const char *data, int *value);
+[[nodiscard]]
+int get_expr_token(struct prog_info *pi, const struct token *tok, int *value);
 [[nodiscard]]
 int get_symbol(struct prog_info *pi, char *label_name, int *data);
 [[nodiscard]]
-int par_length(char *data);
+int par_length(const char *data, const char *end);
 
 /* mnemonic.c */
 [[nodiscard]]
-int parse_mnemonic(struct prog_info *pi);
-int get_mnemonic_type(struct prog_info *pi);
-int get_register(struct prog_info *pi, char *data);
+int parse_mnemonic(struct prog_info *pi, const char *line);
+int get_mnemonic_type(const char *name, int len);
+int encode_instruction(struct prog_info *pi, int mnemonic, const struct token operands[], int count, int words[2]);
+int get_register(struct prog_info *pi, const struct token *tok);
+int literal_register(const char *name, int len);
 [[nodiscard]]
-int get_bitnum(struct prog_info *pi, char *data, int *ret);
-int get_indirect(struct prog_info *pi, char *operand);
-int is_supported(struct prog_info *pi, char *name);
+int get_bitnum(struct prog_info *pi, const struct token *tok, int *ret);
+int get_indirect(struct prog_info *pi, const struct token *tok);
+int is_supported(struct prog_info *pi, const char *name, int len);
 int count_supported_instructions(int flags);
 
 /* directiv.c */
 [[nodiscard]]
-int parse_directive(struct prog_info *pi);
-int lookup_keyword(const char *const keyword_list[], const char *const keyword, int strict);
+int parse_directive(struct prog_info *pi, const char *line);
 char *term_string(struct prog_info *pi, char *string);
 [[nodiscard]]
 int parse_db(struct prog_info *pi, char *next);
@@ -376,16 +567,20 @@ int spool_conditional(struct prog_info *pi, int only_endif);
 [[nodiscard]]
 int check_conditional(struct prog_info *pi, char *buff, int *current_depth, int *do_next, int only_endif);
 [[nodiscard]]
-int test_include(const char *filename);
+int test_include(struct prog_info *pi, const char *filename);
+void free_include_paths(struct prog_info *pi);
 
 /* macro.c */
 [[nodiscard]]
 int read_macro(struct prog_info *pi, char *name);
-struct macro *get_macro(struct prog_info *pi, char *name);
+struct macro *get_macro(struct prog_info *pi, const char *name, int len);
 struct macro_label *get_macro_label(char *line, struct macro *macro);
 struct macro_label *get_macro_label_with_pos(char *line, struct macro *macro, char **out_pos);
 [[nodiscard]]
-int expand_macro(struct prog_info *pi, struct macro *macro, char *rest_line);
+int expand_macro(struct prog_info *pi, struct macro *macro, const char *rest_line);
+[[nodiscard]]
+int read_repeat(struct prog_info *pi, int kind, char *next);
+void free_macro_frames(struct prog_info *pi);
 
 
 /* file.c */
@@ -399,25 +594,91 @@ void close_hex_file(struct hex_file_info *hfi);
 void write_ee_byte(struct prog_info *pi, int address, unsigned char data);
 void write_prog_word(struct prog_info *pi, int address, int data);
 void do_hex_line(struct hex_file_info *hfi);
+void write_hex_byte(struct prog_info *pi, struct hex_file_info *hfi, int address, unsigned char data);
+int flash_page_size(struct prog_info *pi);
+int image_byte(struct prog_info *pi, struct image *image, long address, unsigned char data);
+int image_page_used(const struct image *image, long page, int page_size);
+void free_image(struct image *image);
 [[nodiscard]]
 FILE *open_obj_file(struct prog_info *pi, const char *filename);
 void close_obj_file(struct prog_info *pi, FILE *fp);
 void write_obj_record(struct prog_info *pi, int address, int data);
 void unlink_out_files(struct prog_info *pi, const char *filename);
+void redirect_stdout(struct args *args);
+FILE *open_output(const char *filename, const char *mode);
+FILE *open_source(struct prog_info *pi, struct include_file *include_file);
+long binary_size(const char *filename);
+const unsigned char *map_binary(const char *filename, long offset, long length);
+void unmap_binary(const unsigned char *data, long offset, long length);
+
+/* listing.c */
+[[nodiscard]]
+int list_open(struct prog_info *pi);
+void list_flush(struct prog_info *pi);
+void list_close(struct prog_info *pi);
+void list_text(struct prog_info *pi, int indent, const char *text);
+void list_source(struct prog_info *pi, int indent);
+void list_address(struct prog_info *pi, const struct segment_info *seg);
+void list_code(struct prog_info *pi, const struct segment_info *seg, int count, const int words[]);
+void list_macro_call(struct prog_info *pi, const struct segment_info *seg);
+void list_word(struct prog_info *pi, const struct segment_info *seg, int value);
+void list_bytes(struct prog_info *pi, const struct segment_info *seg);
+void list_byte(struct prog_info *pi, int value);
+void list_bytes_end(struct prog_info *pi, int padded);
+
+/* delta.c */
+[[nodiscard]]
+int delta_open(struct prog_info *pi, const char *previous, const char *basename);
+void delta_word(struct prog_info *pi, int address, int data);
+void delta_close(struct prog_info *pi, int write);
+
+/* matrix.c */
+int device_matrix(struct args *args, double started, double parsed);
+
+/* relax.c */
+struct relax_site *relax_site(struct prog_info *pi);
+void relax(struct prog_info *pi);
+void relax_report(struct prog_info *pi);
 
 /* map.c */
 void write_map_file(struct prog_info *pi);
-char *Space(char *n);
+
+/* stats.c */
+[[nodiscard]]
+int stats_open(struct prog_info *pi);
+void stats_close(struct prog_info *pi);
+double stats_clock(void);
+void phase_begin(struct prog_info *pi, int phase);
+void phase_end(struct prog_info *pi, int phase);
+void stats_file_line(struct prog_info *pi);
+void stats_report(struct prog_info *pi);
+[[nodiscard]]
+int profile_open(struct prog_info *pi);
+void profile_close(struct prog_info *pi);
+void profile_enter(struct prog_info *pi, int kind, int num);
+void profile_exit(struct prog_info *pi);
+void profile_line(struct prog_info *pi);
+void profile_report(struct prog_info *pi);
+[[nodiscard]]
+int trace_open(struct prog_info *pi);
+void trace_close(struct prog_info *pi);
+void trace_event(struct prog_info *pi, char ph, const char *name, const char *cat);
+void trace_start(struct prog_info *pi, double started, double parsed);
+void trace_macro(struct prog_info *pi, const char *name, double start);
 
 /* stdextra.c */
 int nocase_strcmp(const char *s, const char *t);
-int nocase_strncmp(char *s, char *t, int n);
+int nocase_strncmp(const char *s, const char *t, int n);
+int nocase_strcmp_n(const char *s, const char *t, int n);
+unsigned int nocase_hash(const char *s, int n);
 char *nocase_strstr(char *s, char *t);
 int atox(char *s);
-int atoi_n(char *s, int n);
-int atox_n(char *s, int n);
+int atoi_n(const char *s, int n);
+int atox_n(const char *s, int n);
 [[nodiscard]]
 char *malloc_strcpy(const char *src);
+[[nodiscard]]
+char *malloc_strncpy(const char *src, int n);
 char *my_strlwr(char *in);
 char *my_strupr(char *in);
 char *snprint_list(char *buf, size_t limit, const char *const list[]);
@@ -514,7 +514,7 @@ parse_stabs(struct prog_info *pi, char *p)
 	char *pString, *p2, *p3, *p4, *p5, *pType, *pp, *pJoined;
 
 
-	if (!GET_ARG_I(pi->args, ARG_COFF) || (pi->pass == PASS_1))
+	if (!pi->coff_file || (pi->pass == PASS_1))	/* No --coff, or --check */
 		return (True);
 
 	/* stabs debugging information is in the form:
@@ -676,7 +676,7 @@ parse_stabn(struct prog_info *pi, char *p)
 	N_SLINE	0x44		src line: 0,,0,linenumber,address
 	*/
 
-	if (!GET_ARG_I(pi->args, ARG_COFF) || (pi->pass == PASS_1))
+	if (!pi->coff_file || (pi->pass == PASS_1))	/* No --coff, or --check */
 		return (True);
 
 	/* Parse the tokens in the stabn line buffer */
@@ -0,0 +1,196 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/* --delta compares the flash image with the one of a previous HEX file and
+ * writes the flash pages that differ to <name>.delta.hex. Both images are
+ * kept in memory. A page that is only in the previous image is written
+ * erased (all 0xFF). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "misc.h"
+#include "avra.h"
+
+struct delta {
+	struct image old;
+	struct image new;
+	int page_size;		/* Bytes */
+	char *filename;		/* Delta HEX file */
+};
+
+static int
+hex_value(const char *s, int digits)
+{
+	int i, value = 0;
+
+	for (i = 0; i < digits; i++) {
+		if (!isxdigit((unsigned char)s[i]))
+			return (-1);
+		value = (value << 4) | (isdigit((unsigned char)s[i]) ? s[i] - '0' : (tolower((unsigned char)s[i]) - 'a' + 10));
+	}
+	return (value);
+}
+
+/* Read the data records of an Intel HEX file into image */
+static int
+read_hex(struct prog_info *pi, struct delta *d, const char *filename)
+{
+	FILE *fp;
+	char line[LINEBUFFER_LENGTH];
+	int line_number = 0, count, type, i, value;
+	unsigned char checksum;
+	long base = 0, address;
+
+	if ((fp = fopen(filename, "r")) == NULL) {
+		print_msg(pi, MSGTYPE_ERROR, "Cannot open previous HEX file %s", filename);
+		return (False);
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		line_number++;
+		if (line[0] != ':')
+			continue;
+		count = hex_value(&line[1], 2);
+		checksum = 0;
+		for (i = 0; (count >= 0) && (i < count + 5); i++) {
+			if ((value = hex_value(&line[1 + 2 * i], 2)) < 0)
+				break;
+			checksum += value;
+		}
+		if ((count < 0) || (i < count + 5) || checksum) {
+			print_msg(pi, MSGTYPE_ERROR, "Invalid record in line %d of %s", line_number, filename);
+			fclose(fp);
+			return (False);
+		}
+		address = hex_value(&line[3], 4);
+		type = hex_value(&line[7], 2);
+		if (type == 0x00) {
+			for (i = 0; i < count; i++) {
+				if (!image_byte(pi, &d->old, base + address + i, hex_value(&line[9 + 2 * i], 2))) {
+					fclose(fp);
+					return (False);
+				}
+			}
+		} else if (type == 0x01)
+			break;
+		else if ((type == 0x02) && (count == 2))
+			base = (long)hex_value(&line[9], 4) << 4;
+		else if ((type == 0x04) && (count == 2))
+			base = (long)hex_value(&line[9], 4) << 16;
+	}
+	fclose(fp);
+	return (True);
+}
+
+/* Start --delta against the HEX file previous, before the output files are
+ * opened, so the previous file may be the HEX file about to be written.
+ * basename is the output file name without extension. */
+int
+delta_open(struct prog_info *pi, const char *previous, const char *basename)
+{
+	struct delta *d;
+
+	if ((d = calloc(1, sizeof(struct delta))) == NULL) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	pi->delta = d;
+	d->page_size = flash_page_size(pi);
+	if ((d->filename = malloc(strlen(basename) + 11)) == NULL) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(d->filename, basename);
+	strcat(d->filename, ".delta.hex");
+	return (read_hex(pi, d, previous));
+}
+
+/* Program word data written at word address */
+void
+delta_word(struct prog_info *pi, int address, int data)
+{
+	struct delta *d = pi->delta;
+
+	if (image_byte(pi, &d->new, 2L * address, data & 0xff))
+		image_byte(pi, &d->new, 2L * address + 1, (data >> 8) & 0xff);
+}
+
+static const unsigned char *
+page_bytes(const struct image *image, long page, int page_size, const unsigned char *erased)
+{
+	return ((page * page_size < image->size) ? &image->bytes[page * page_size] : erased);
+}
+
+/* Write the changed pages and report how many there are. Nothing is written
+ * if write is False (the assembly failed). */
+void
+delta_close(struct prog_info *pi, int write)
+{
+	struct delta *d = pi->delta;
+	struct hex_file_info *hfi = NULL;
+	unsigned char *erased;
+	const unsigned char *new;
+	long page, pages, used = 0, changed = 0;
+	int i;
+
+	if (!d)
+		return;
+	pages = ((d->old.size > d->new.size) ? d->old.size : d->new.size) / d->page_size;
+	erased = malloc(d->page_size);
+	if (write && erased && !(hfi = open_hex_file(d->filename)))
+		print_msg(pi, MSGTYPE_ERROR, "Could not create delta hex file!");
+	if (hfi) {
+		hfi->record_size = pi->cseg->hfi->record_size;
+		hfi->page_size = d->page_size;
+		memset(erased, 0xff, d->page_size);
+		for (page = 0; page < pages; page++) {
+			if (image_page_used(&d->new, page, d->page_size))
+				used++;
+			if (!image_page_used(&d->new, page, d->page_size) && !image_page_used(&d->old, page, d->page_size))
+				continue;
+			new = page_bytes(&d->new, page, d->page_size, erased);
+			if (!memcmp(new, page_bytes(&d->old, page, d->page_size, erased), d->page_size))
+				continue;
+			changed++;
+			for (i = 0; i < d->page_size; i++)
+				write_hex_byte(pi, hfi, page * d->page_size + i, new[i]);
+		}
+		close_hex_file(hfi);
+		printf("Delta      :   %7ld of %ld pages changed (%d bytes per page), see %s\n",
+		       changed, used, d->page_size, d->filename);
+	}
+	free(erased);
+	free_image(&d->old);
+	free_image(&d->new);
+	free(d->filename);
+	free(d);
+	pi->delta = NULL;
+}
+
+/* end of delta.c */
@@ -53,6 +53,7 @@
 struct device {
 	char *name;
 	long flash_size;
+	int page_size;		/* Flash page in words, 0 if not written by page */
 	long ram_start;
 	long ram_size;
 	long eeprom_size;
@@ -62,4 +63,5 @@ struct device {
 /* device.c */
 struct device *get_device(struct prog_info *pi,char *name);
 int predef_dev(struct prog_info *pi);
+int def_dev_const(struct prog_info *pi, const char *name);
 void list_devices(void);
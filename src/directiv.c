@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
 
 #include "misc.h"
 #include "args.h"
@@ -72,49 +73,14 @@ enum {
 	DIRECTIVE_PRAGMA,
 	DIRECTIVE_OVERLAP,
 	DIRECTIVE_NOOVERLAP,
+	DIRECTIVE_INCBIN,
+	DIRECTIVE_REPT,
+	DIRECTIVE_IRP,
+	DIRECTIVE_IRPC,
+	DIRECTIVE_ENDR,
 	DIRECTIVE_COUNT
 };
 
-static const char *const directive_list[] = {
-	"BYTE",
-	"CSEG",
-	"CSEGSIZE",
-	"DB",
-	"DEF",
-	"DEVICE",
-	"DSEG",
-	"DW",
-	"ENDM",
-	"ENDMACRO",
-	"EQU",
-	"ESEG",
-	"EXIT",
-	"INCLUDE",
-	"INCLUDEPATH",
-	"LIST",
-	"LISTMAC",
-	"MACRO",
-	"NOLIST",
-	"ORG",
-	"SET",
-	"DEFINE",
-	"UNDEF",
-	"IFDEF",
-	"IFNDEF",
-	"IF",
-	"ELSE",
-	"ELSEIF",		/* The Atmel AVR Assembler version 1.71 and later use ELSEIF and not ELIF */
-	"ELIF",
-	"ENDIF",
-	"MESSAGE",
-	"WARNING",
-	"ERROR",
-	"PRAGMA",
-	"OVERLAP",
-	"NOOVERLAP",
-	NULL
-};
-
 enum {
 	PRAGMA_OVERLAP,
 	PRAGMA_COUNT
@@ -133,6 +99,14 @@ static const char *const overlap_value[] = {
 	NULL
 };
 
+/* Keywords are found with a perfect hash over the length and the first,
+ * third and last character, case folded by using only the low 5 bits.
+ * keywords.h holds the association values and the slot tables (list index
+ * + 1, 0 is an empty slot); a hit is confirmed with a string compare. It
+ * is generated by keywords.sh from the lists above and directive_table[],
+ * run it after adding a keyword. make check fails if it is out of date. */
+#include "keywords.h"
+
 /* caller has to free result */
 static char *
 joinpaths(const char *dirname, const char *fname)
@@ -152,622 +126,969 @@ joinpaths(const char *dirname, const char *fname)
 	return res;
 }
 
-int
-parse_directive(struct prog_info *pi)
+static int
+keyword_hash(const char *name, int len)
+{
+	int third = (len > 2) ? name[2] : name[len - 1];
+
+	return (len + keyword_asso[name[0] & 0x1f] + keyword_asso[third & 0x1f]
+	        + keyword_asso[name[len - 1] & 0x1f]);
+}
+
+/* Look up the len characters at name, case insensitive, in keyword_list
+ * using its slot table. Returns the keyword index or -1. */
+static int
+lookup_keyword(const char *const keyword_list[], const unsigned char slot[], int mask,
+               const char *name, int len)
 {
-	int directive, pragma;
-	int ok = True;
 	int i;
-	char *next, *data, buf[140];
-	struct file_info *fi_bak;
 
-	struct def *def;
-	struct data_list *incpath, *dl;
+	if (len <= 0)
+		return (-1);
+	i = slot[keyword_hash(name, len) & mask] - 1;
+	if ((i >= 0) && !nocase_strcmp_n(keyword_list[i], name, len))
+		return (i);
+	return (-1);
+}
 
-	next = get_next_token(pi->fi->scratch, TERM_SPACE);
+/* Directive handlers. next is the operand text (a private copy that may be
+ * split in place) or NULL if the directive has no operands. */
 
-	my_strupr(pi->fi->scratch);
-	directive = lookup_keyword(directive_list, pi->fi->scratch + 1, True);
-	if (directive == -1) {
-		print_msg(pi, MSGTYPE_ERROR, "Unknown directive: %s", pi->fi->scratch);
+static int
+directive_byte(struct prog_info *pi, char *next)
+{
+	int i;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".BYTE needs a size operand");
 		return (True);
 	}
-	switch (directive) {
-	case DIRECTIVE_BYTE:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".BYTE needs a size operand");
-			return (True);
-		}
-		if (pi->segment == pi->cseg) {
-			print_msg(pi, MSGTYPE_ERROR, ".BYTE directive cannot be used within the code segment (.CSEG)");
-			return False;
-		}
-		get_next_token(next, TERM_END);
-		if (!get_expr(pi, next, &i))
-			return (False);
-		if (i < 0) {
-			print_msg(pi, MSGTYPE_ERROR, ".BYTE directive must have nonnegative operand");
-			return False;
-		}
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "%c:%06lx    %s\n",
-			        pi->segment->ident, pi->segment->addr, pi->list_line);
-			pi->list_line = NULL;
-		}
-		advance_ip(pi->segment, i);
-		break;
-	case DIRECTIVE_CSEG:
-		fix_orglist(pi->segment);
-		def_orglist(pi->cseg);
-		break;
-	case DIRECTIVE_CSEGSIZE:
-		break;
-	case DIRECTIVE_DB:
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
-		}
-		return (parse_db(pi, next));
-	/* Directive .def */
-	case DIRECTIVE_DEF:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".DEF needs an operand");
-			return (True);
-		}
-		data = get_next_token(next, TERM_EQUAL);
-		if (!(data && (tolower(data[0]) == 'r') && isdigit(data[1]))) {
-			print_msg(pi, MSGTYPE_ERROR, "%s needs a register (e.g. .def BZZZT = r16)", next);
-			return (True);
-		}
-		i = atoi(&data[1]);
-		/* check range of given register */
-		if (i > 31)
-			print_msg(pi, MSGTYPE_ERROR, "R%d is not a valid register", i);
-		/* check if this reg is already assigned */
-		for (def = pi->first_def; def; def = def->next) {
-			if (def->reg == i && pi->pass == PASS_1 && !pi->NoRegDef) {
-				print_msg(pi, MSGTYPE_WARNING, "r%d is already assigned to '%s'!", i, def->name);
-				return (True);
-			}
-		}
-		/* check if this regname is already defined */
-		for (def = pi->first_def; def; def = def->next) {
-			if (!nocase_strcmp(def->name, next)) {
-				if (pi->pass == PASS_1 && !pi->NoRegDef) {
-					print_msg(pi, MSGTYPE_WARNING, "'%s' is already assigned as r%d but will now be set to r%i!", next, def->reg, i);
-				}
-				def->reg = i;
-				return (True);
-			}
-		}
-		/* Check, if symbol is already defined as a label or constant */
-		if (pi->pass == PASS_2) {
-			if (get_label(pi,next,NULL))
-				print_msg(pi, MSGTYPE_WARNING, "Name '%s' is used for a register and a label", next);
-			if (get_constant(pi,next,NULL))
-				print_msg(pi, MSGTYPE_WARNING, "Name '%s' is used for a register and a constant", next);
-		}
+	if (pi->segment == pi->cseg) {
+		print_msg(pi, MSGTYPE_ERROR, ".BYTE directive cannot be used within the code segment (.CSEG)");
+		return False;
+	}
+	get_next_token(next, TERM_END);
+	if (!get_expr(pi, next, &i))
+		return (False);
+	if (i < 0) {
+		print_msg(pi, MSGTYPE_ERROR, ".BYTE directive must have nonnegative operand");
+		return False;
+	}
+	list_address(pi, pi->segment);
+	advance_ip(pi->segment, i);
+	return (True);
+}
 
-		def = malloc(sizeof(struct def));
-		if (!def) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-			return (False);
-		}
-		LIST_APPEND(def, pi->first_def, pi->last_def);
-		def->name = malloc(strlen(next) + 1);
-		if (!def->name) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-			return (False);
-		}
-		strcpy(def->name, next);
-		def->reg = i;
-		break;
-	case DIRECTIVE_DEVICE:
-		if (pi->pass == PASS_2)
-			return (True);
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".DEVICE needs an operand");
-			return (True);
+static int
+directive_cseg(struct prog_info *pi, char *next)
+{
+	fix_orglist(pi->segment);
+	def_orglist(pi->cseg);
+	return (True);
+}
+
+static int
+directive_ignored(struct prog_info *pi, char *next)
+{
+	return (True);
+}
+
+static int
+directive_db(struct prog_info *pi, char *next)
+{
+	list_source(pi, LIST_INDENT);
+	return (parse_db(pi, next));
+}
+
+static int
+directive_def(struct prog_info *pi, char *next)
+{
+	int i;
+	char *data;
+	struct def *def;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".DEF needs an operand");
+		return (True);
+	}
+	data = get_next_token(next, TERM_EQUAL);
+	if (!(data && (tolower(data[0]) == 'r') && isdigit(data[1]))) {
+		print_msg(pi, MSGTYPE_ERROR, "%s needs a register (e.g. .def BZZZT = r16)", next);
+		return (True);
+	}
+	i = atoi(&data[1]);
+	/* check range of given register */
+	if (i > 31)
+		print_msg(pi, MSGTYPE_ERROR, "R%d is not a valid register", i);
+	/* literal registers are never looked up in the alias table */
+	if (literal_register(next, strlen(next)) != -1) {
+		print_msg(pi, MSGTYPE_ERROR, "Can't use register name %s as a register alias", next);
+		return (True);
+	}
+	/* check if this reg is already assigned */
+	if ((i < 32) && pi->reg_def[i] && pi->pass == PASS_1 && !pi->NoRegDef) {
+		print_msg(pi, MSGTYPE_WARNING, "r%d is already assigned to '%s'!", i, pi->reg_def[i]->name);
+		return (True);
+	}
+	/* check if this regname is already defined */
+	def = get_def(pi, next, strlen(next));
+	if (def) {
+		if (pi->pass == PASS_1 && !pi->NoRegDef) {
+			print_msg(pi, MSGTYPE_WARNING, "'%s' is already assigned as r%d but will now be set to r%i!", next, def->reg, i);
 		}
-		if (pi->device->name != NULL) { /* Check for multiple device definitions */
-			print_msg(pi, MSGTYPE_ERROR, "More than one .DEVICE definition");
+		set_def_reg(pi, def, i);
+		return (True);
+	}
+	/* Check, if symbol is already defined as a label or constant */
+	if (pi->pass == PASS_2) {
+		if (get_label(pi,next,NULL))
+			print_msg(pi, MSGTYPE_WARNING, "Name '%s' is used for a register and a label", next);
+		if (get_constant(pi,next,NULL))
+			print_msg(pi, MSGTYPE_WARNING, "Name '%s' is used for a register and a constant", next);
+	}
+
+	if (!add_def(pi, next, i)) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	return (True);
+}
+
+static int
+directive_device(struct prog_info *pi, char *next)
+{
+	if (pi->device_fixed)
+		return (True);
+	if (pi->pass == PASS_2) {
+		if (pi->relaxing && next) {
+			/* The orglist entries of pass 1, see relax() */
+			if (!fix_orglist(pi->segment) || !def_orglist(pi->segment))
+				return (False);
 		}
-		if (pi->cseg->count || pi->dseg->count || pi->eseg->count) {
+		return (True);
+	}
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".DEVICE needs an operand");
+		return (True);
+	}
+	if (pi->device->name != NULL) { /* Check for multiple device definitions */
+		print_msg(pi, MSGTYPE_ERROR, "More than one .DEVICE definition");
+	}
+	if (pi->cseg->count || pi->dseg->count || pi->eseg->count) {
+		/* Check if something was already assembled */
+		print_msg(pi, MSGTYPE_ERROR, ".DEVICE definition must be before any code lines");
+	} else {
+		if ((pi->cseg->addr != pi->cseg->lo_addr)
+		        || (pi->dseg->addr != pi->dseg->lo_addr)
+		        || (pi->eseg->addr != pi->eseg->lo_addr)) {
 			/* Check if something was already assembled */
-			print_msg(pi, MSGTYPE_ERROR, ".DEVICE definition must be before any code lines");
-		} else {
-			if ((pi->cseg->addr != pi->cseg->lo_addr)
-			        || (pi->dseg->addr != pi->dseg->lo_addr)
-			        || (pi->eseg->addr != pi->eseg->lo_addr)) {
-				/* Check if something was already assembled */
-				print_msg(pi, MSGTYPE_ERROR, ".DEVICE definition must be before any .ORG directive");
-			}
+			print_msg(pi, MSGTYPE_ERROR, ".DEVICE definition must be before any .ORG directive");
 		}
+	}
 
-		get_next_token(next, TERM_END);
-		pi->device = get_device(pi,next);
-		if (!pi->device) {
-			print_msg(pi, MSGTYPE_ERROR, "Unknown device: %s", next);
-			pi->device = get_device(pi,NULL); /* Fix segmentation fault if device is unknown */
-		}
+	get_next_token(next, TERM_END);
+	pi->device = get_device(pi,next);
+	if (!pi->device) {
+		print_msg(pi, MSGTYPE_ERROR, "Unknown device: %s", next);
+		pi->device = get_device(pi,NULL); /* Fix segmentation fault if device is unknown */
+	}
 
-		/* Now that we know the device type, we can
-		 * start memory allocation from the correct offsets.
-		 */
-		fix_orglist(pi->segment);
+	/* Now that we know the device type, we can
+	 * start memory allocation from the correct offsets.
+	 */
+	fix_orglist(pi->segment);
 
-		init_segment_size(pi, pi->device); 	/* Resync. ...->lo_addr variables */
-		def_orglist(pi->segment);
-		break;
-	case DIRECTIVE_DSEG:
-		fix_orglist(pi->segment);
-		def_orglist(pi->dseg);
-		if (pi->dseg->hi_addr == 0) {
-			/* XXX move to emit */
-			print_msg(pi, MSGTYPE_ERROR, "Can't use .DSEG directive because device has no RAM");
-		}
-		break;
-	case DIRECTIVE_DW:
-		if (pi->segment->flags & SEG_BSS_DATA) {
-			print_msg(pi, MSGTYPE_ERROR, "Can't use .DW directive in data segment (.DSEG)");
-			return (True);
+	init_segment_size(pi, pi->device); 	/* Resync. ...->lo_addr variables */
+	def_orglist(pi->segment);
+	return (True);
+}
+
+static int
+directive_dseg(struct prog_info *pi, char *next)
+{
+	fix_orglist(pi->segment);
+	def_orglist(pi->dseg);
+	if (pi->dseg->hi_addr == 0) {
+		/* XXX move to emit */
+		print_msg(pi, MSGTYPE_ERROR, "Can't use .DSEG directive because device has no RAM");
+	}
+	return (True);
+}
+
+static int
+directive_dw(struct prog_info *pi, char *next)
+{
+	int i;
+	char *data;
+
+	if (pi->segment->flags & SEG_BSS_DATA) {
+		print_msg(pi, MSGTYPE_ERROR, "Can't use .DW directive in data segment (.DSEG)");
+		return (True);
+	}
+	while (next) {
+		data = get_next_token(next, TERM_COMMA);
+		if (pi->pass == PASS_2) {
+			if (!get_literal(next, &i) && !get_expr(pi, next, &i))
+				return (False);
+			if ((i < -32768) || (i > 65535))
+				print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", i);
 		}
-		while (next) {
-			data = get_next_token(next, TERM_COMMA);
-			if (pi->pass == PASS_2) {
-				if (!get_expr(pi, next, &i))
-					return (False);
-				if ((i < -32768) || (i > 65535))
-					print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", i);
+		if (pi->pass == PASS_2) {
+			if (pi->list_line) {
+				list_source(pi, LIST_INDENT);
+				list_word(pi, pi->segment, i);
 			}
-			if (pi->pass == PASS_2) {
-				if (pi->list_line && pi->list_on) {
-					fprintf(pi->list_file, "          %s\n", pi->list_line);
-					pi->list_line = NULL;
-					fprintf(pi->list_file, "%c:%06lx %04x\n",
-					        pi->segment->ident, pi->segment->addr, i);
-				}
-				if (pi->segment == pi->eseg) {
-					write_ee_byte(pi, pi->eseg->addr, (unsigned char)i);
-					write_ee_byte(pi, pi->eseg->addr + 1, (unsigned char)(i >> 8));
-				}
-				if (pi->segment == pi->cseg) {
-					write_prog_word(pi, pi->cseg->addr, i);
-				}
+			if (pi->segment == pi->eseg) {
+				write_ee_byte(pi, pi->eseg->addr, (unsigned char)i);
+				write_ee_byte(pi, pi->eseg->addr + 1, (unsigned char)(i >> 8));
+			}
+			if (pi->segment == pi->cseg) {
+				write_prog_word(pi, pi->cseg->addr, i);
 			}
-			if (pi->segment == pi->eseg)
-				advance_ip(pi->eseg, 2);
-			if (pi->segment == pi->cseg)
-				advance_ip(pi->cseg, 1);
-			next = data;
-		}
-		break;
-	case DIRECTIVE_ENDM:
-		[[fallthrough]];
-	case DIRECTIVE_ENDMACRO:
-		print_msg(pi, MSGTYPE_ERROR, "No .MACRO found before .ENDMACRO");
-		break;
-	case DIRECTIVE_EQU:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".EQU needs an operand");
-			return (True);
 		}
-		data = get_next_token(next, TERM_EQUAL);
-		if (!data) {
-			print_msg(pi, MSGTYPE_ERROR, "%s needs an expression (e.g. .EQU BZZZT = 0x2a)", next);
+		if (pi->segment == pi->eseg)
+			advance_ip(pi->eseg, 2);
+		if (pi->segment == pi->cseg)
+			advance_ip(pi->cseg, 1);
+		next = data;
+	}
+	return (True);
+}
+
+static int
+directive_endm(struct prog_info *pi, char *next)
+{
+	print_msg(pi, MSGTYPE_ERROR, "No .MACRO found before .ENDMACRO");
+	return (True);
+}
+
+static int
+directive_endr(struct prog_info *pi, char *next)
+{
+	print_msg(pi, MSGTYPE_ERROR, "No .REPT or .IRP found before .ENDR");
+	return (True);
+}
+
+/* Define constant name with value i, checking it against pass 1 in pass 2 */
+static int
+define_constant(struct prog_info *pi, char *name, int i)
+{
+	if (test_label(pi,name,"%s have already been defined as a label")!=NULL)
+		return (True);
+	if (test_variable(pi,name,"%s have already been defined as a .SET variable")!=NULL)
+		return (True);
+	/* Forward references allowed. But check, if everything is ok ... */
+	if (pi->pass==PASS_1) { /* Pass 1 */
+		if (test_constant(pi,name,"Can't redefine constant %s, use .SET instead")!=NULL)
 			return (True);
+		if (def_const(pi, name, i)==False)
+			return (False);
+	} else { /* Pass 2 */
+		int j;
+		if (get_constant(pi, name, &j)==False) {  /* Defined in Pass 1 and now missing ? */
+			print_msg(pi, MSGTYPE_ERROR, "Constant %s is missing in pass 2", name);
+			return (False);
 		}
-		get_next_token(data, TERM_END);
-		if (!get_expr(pi, data, &i))
+		if ((i != j) && pi->relaxing) {
+			/* Computed from labels moved by relax() */
+			test_constant(pi, name, NULL)->value = i;
+			pi->relax_changed = True;
+		} else if (i != j) {
+			print_msg(pi, MSGTYPE_ERROR, "Constant %s changed value from %d in pass1 to %d in pass 2", name,j,i);
 			return (False);
-		if (test_label(pi,next,"%s have already been defined as a label")!=NULL)
-			return (True);
-		if (test_variable(pi,next,"%s have already been defined as a .SET variable")!=NULL)
-			return (True);
-		/* Forward references allowed. But check, if everything is ok ... */
-		if (pi->pass==PASS_1) { /* Pass 1 */
-			if (test_constant(pi,next,"Can't redefine constant %s, use .SET instead")!=NULL)
-				return (True);
-			if (def_const(pi, next, i)==False)
-				return (False);
-		} else { /* Pass 2 */
-			int j;
-			if (get_constant(pi, next, &j)==False) {  /* Defined in Pass 1 and now missing ? */
-				print_msg(pi, MSGTYPE_ERROR, "Constant %s is missing in pass 2", next);
-				return (False);
+		}
+		/* OK. Definition is unchanged */
+	}
+	list_source(pi, LIST_INDENT);
+	return (True);
+}
+
+static int
+directive_equ(struct prog_info *pi, char *next)
+{
+	int i;
+	char *data;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".EQU needs an operand");
+		return (True);
+	}
+	data = get_next_token(next, TERM_EQUAL);
+	if (!data) {
+		print_msg(pi, MSGTYPE_ERROR, "%s needs an expression (e.g. .EQU BZZZT = 0x2a)", next);
+		return (True);
+	}
+	get_next_token(data, TERM_END);
+	if (!get_expr(pi, data, &i))
+		return (False);
+	return (define_constant(pi, next, i));
+}
+
+static int
+directive_eseg(struct prog_info *pi, char *next)
+{
+	fix_orglist(pi->segment);
+	def_orglist(pi->eseg);
+	if (pi->device->eeprom_size == 0) { /* XXX */
+		print_msg(pi, MSGTYPE_ERROR, "Can't use .ESEG directive because device has no EEPROM");
+	}
+	return (True);
+}
+
+static int
+directive_exit(struct prog_info *pi, char *next)
+{
+	pi->fi->exit_file = True;
+	return (True);
+}
+
+/* Search filename in the current directory, the default include path and
+ * the include paths, in this order. Returns True if found, with *path set
+ * to the joined path to free, or NULL if filename itself was found. */
+static int
+find_include(struct prog_info *pi, const char *filename, char **path)
+{
+	int ok;
+	char *data;
+	struct data_list *incpath;
+
+	/* Test if include is in local directory */
+	ok = test_include(pi, filename);
+	data = NULL;
+	if (!ok) {
+#ifdef DEFAULT_INCLUDE_PATH
+		data = joinpaths(DEFAULT_INCLUDE_PATH, filename);
+		ok = test_include(pi, data);
+#endif
+		for (incpath = GET_ARG_LIST(pi->args, ARG_INCLUDEPATH); incpath && !ok; incpath = incpath->next) {
+			if (data != NULL) {
+				free(data);
 			}
-			if (i != j) {
-				print_msg(pi, MSGTYPE_ERROR, "Constant %s changed value from %d in pass1 to %d in pass 2", next,j,i);
+			data = joinpaths(incpath->data, filename);
+			if (data == NULL) {
+				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
 				return (False);
 			}
-			/* OK. Definition is unchanged */
-		}
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
-		}
-		break;
-	case DIRECTIVE_ESEG:
-		fix_orglist(pi->segment);
-		def_orglist(pi->eseg);
-		if (pi->device->eeprom_size == 0) { /* XXX */
-			print_msg(pi, MSGTYPE_ERROR, "Can't use .ESEG directive because device has no EEPROM");
-		}
-		break;
-	case DIRECTIVE_EXIT:
-		pi->fi->exit_file = True;
-		break;
-	case DIRECTIVE_INCLUDE:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, "Nothing to include");
-			return (True);
-		}
-		next = term_string(pi, next);
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
+			ok = test_include(pi, data);
 		}
-		/* Test if include is in local directory */
-		ok = test_include(next);
+	}
+	if (!ok && data) {
+		free(data);
 		data = NULL;
-		if (!ok) {
-#ifdef DEFAULT_INCLUDE_PATH
-			data = joinpaths(DEFAULT_INCLUDE_PATH, next);
-			ok = test_include(data);
-#endif
-			for (incpath = GET_ARG_LIST(pi->args, ARG_INCLUDEPATH); incpath && !ok; incpath = incpath->next) {
-				if (data != NULL) {
-					free(data);
-				}
-				data = joinpaths(incpath->data, next);
-				if (data == NULL) {
-					print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-					return (False);
-				}
-				ok = test_include(data);
+	}
+	*path = data;
+	return (ok);
+}
+
+static int
+directive_include(struct prog_info *pi, char *next)
+{
+	int ok, undefined;
+	char *data;
+	struct file_info *fi_bak;
+	struct include_file *include_file;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, "Nothing to include");
+		return (True);
+	}
+	next = term_string(pi, next);
+	list_source(pi, LIST_INDENT);
+	ok = find_include(pi, next, &data);
+	if (ok) {
+		/* A file wrapped in an include guard that was read before in this
+		 * pass is skipped without opening it when the guard is defined. The
+		 * test is replayed in pass 2 like a .IFNDEF. */
+		include_file = find_include_file(pi, data ? data : next);
+		if (include_file && include_file->guard
+		    && (include_file->opens[pi->pass] >= include_file->guard_opens)) {
+			undefined = False;
+			if (pi->pass == PASS_1)
+				undefined = !get_symbol(pi, include_file->guard, NULL);
+			if (!conditional_outcome(pi, &undefined)) {
+				free(data);
+				return (False);
+			}
+			if (!undefined) {
+				free(data);
+				return (True);
 			}
 		}
-		if (ok) {
-			fi_bak = pi->fi;
-			ok = parse_file(pi, data ? data : next);
-			pi->fi = fi_bak;
-		} else
-			print_msg(pi, MSGTYPE_ERROR, "Cannot find include file: %s", next);
-		if (data)
-			free(data);
-		break;
-	case DIRECTIVE_INCLUDEPATH:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".INCLUDEPATH needs an operand");
-			return (True);
-		}
-		data = get_next_token(next, TERM_SPACE);
-		if (data) {
-			print_msg(pi, MSGTYPE_ERROR, ".INCLUDEPATH needs an operand!!!");
-			get_next_token(data, TERM_END);
-			if (!get_expr(pi, data, &i))
+		fi_bak = pi->fi;
+		ok = parse_file(pi, data ? data : next);
+		pi->fi = fi_bak;
+	} else
+		print_msg(pi, MSGTYPE_ERROR, "Cannot find include file: %s", next);
+	if (data)
+		free(data);
+	return (ok);
+}
+
+/* .INCBIN "file"[, offset[, length]] copies the bytes of a binary file into
+ * the code or EEPROM segment. Pass 1 only needs the file size; pass 2 maps
+ * the file and writes its bytes without parsing them. An odd number of bytes
+ * in the code segment is padded with a zero byte. */
+static int
+directive_incbin(struct prog_info *pi, char *next)
+{
+	char *rest, *data, *path;
+	long size;
+	int i, offset, length, has_length;
+	const unsigned char *bytes;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCBIN needs a file name");
+		return (True);
+	}
+	if (pi->segment->flags & SEG_BSS_DATA) {
+		print_msg(pi, MSGTYPE_ERROR, "Can't use .INCBIN directive in data segment (.DSEG) !");
+		return (True);
+	}
+	rest = (next[0] == '\"') ? strchr(&next[1], '\"') : NULL;
+	next = term_string(pi, next);
+	offset = 0;
+	length = 0;
+	has_length = False;
+	if (rest) {
+		for (rest++; IS_HOR_SPACE(*rest); rest++);
+		if (*rest == ',') {
+			data = get_next_token(++rest, TERM_COMMA);
+			if (!get_expr(pi, rest, &offset))
 				return (False);
-		}
-		next = term_string(pi, next);
-		/* get arg list start pointer */
-		incpath = GET_ARG_LIST(pi->args, ARG_INCLUDEPATH);
-
-		data = malloc(strlen(next)+1);
-
-		if (data) {
-			strcpy(data, next);
-
-			/* search for last element */
-			if (incpath == NULL) {
-				dl = malloc(sizeof(struct data_list));
-				
-				if (dl) {
-					dl->next = NULL;
-					dl->data = data;
-					SET_ARG_LIST(pi->args, ARG_INCLUDEPATH, dl);
-				} else {
-					printf("Error: Unable to allocate memory\n");
-					return (False);
+			if (data) {
+				if (get_next_token(data, TERM_COMMA)) {
+					print_msg(pi, MSGTYPE_ERROR, ".INCBIN expects a file name, an offset and a length");
+					return (True);
 				}
-			} else {
-				add_arg(&incpath, data);
+				if (!get_expr(pi, data, &length))
+					return (False);
+				has_length = True;
 			}
-		} else {
-			printf("Error: Unable to allocate memory\n");
-			return (False);
-		}
-		break;
-	case DIRECTIVE_LIST:
-		if (pi->pass == PASS_2)
-			if (pi->list_file)
-				pi->list_on = True;
-		break;
-	case DIRECTIVE_LISTMAC:
-		if (pi->pass == PASS_2)
-			SET_ARG_I(pi->args, ARG_LISTMAC, True);
-		break;
-	case DIRECTIVE_MACRO:
-		return (read_macro(pi, next));
-	case DIRECTIVE_NOLIST:
-		if (pi->pass == PASS_2)
-			pi->list_on = False;
-		break;
-	case DIRECTIVE_ORG:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".ORG needs an operand");
+		} else if (!IS_END_OR_COMMENT(*rest)) {
+			print_msg(pi, MSGTYPE_ERROR, ".INCBIN expects a file name, an offset and a length");
 			return (True);
 		}
-		get_next_token(next, TERM_END);
-		if (!get_expr(pi, next, &i))
+	}
+	if (!find_include(pi, next, &path)) {
+		print_msg(pi, MSGTYPE_ERROR, "Cannot find binary file: %s", next);
+		return (True);
+	}
+	size = binary_size(path ? path : next);
+	if (size < 0) {
+		print_msg(pi, MSGTYPE_ERROR, "Cannot read binary file: %s", next);
+		free(path);
+		return (True);
+	}
+	if ((offset < 0) || (offset > size)) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCBIN offset %d is outside of %s (%ld bytes)",
+		          offset, next, size);
+		free(path);
+		return (True);
+	}
+	if (!has_length)
+		length = size - offset;
+	if (length < 0) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCBIN length must be nonnegative");
+		free(path);
+		return (True);
+	}
+	if (length > size - offset) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCBIN range %d+%d is outside of %s (%ld bytes)",
+		          offset, length, next, size);
+		free(path);
+		return (True);
+	}
+	list_address(pi, pi->segment);
+	if ((pi->pass == PASS_2) && length) {
+		bytes = map_binary(path ? path : next, offset, length);
+		if (!bytes) {
+			perror(path ? path : next);
+			free(path);
 			return (False);
-		fix_orglist(pi->segment);
-		pi->segment->addr = i; /* XXX advance */
-		def_orglist(pi->segment);
-		if (pi->fi->label)
-			pi->fi->label->value = i;
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
-		}
-		break;
-	case DIRECTIVE_SET:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".SET needs an operand");
-			return (True);
 		}
-		data = get_next_token(next, TERM_EQUAL);
-		if (!data) {
-			print_msg(pi, MSGTYPE_ERROR, "%s needs an expression (e.g. .SET BZZZT = 0x2a)", next);
-			return (True);
+		if (pi->segment == pi->cseg) {
+			for (i = 0; i + 1 < length; i += 2)
+				write_prog_word(pi, pi->cseg->addr + i / 2, bytes[i] | (bytes[i + 1] << 8));
+			if (length & 1)
+				write_prog_word(pi, pi->cseg->addr + i / 2, bytes[i]);
+		} else {
+			for (i = 0; i < length; i++)
+				write_ee_byte(pi, pi->eseg->addr + i, bytes[i]);
 		}
+		unmap_binary(bytes, offset, length);
+	}
+	if (pi->segment == pi->cseg)
+		advance_ip(pi->cseg, (length + 1) / 2);
+	else
+		advance_ip(pi->eseg, length);
+	free(path);
+	return (True);
+}
+
+static int
+directive_includepath(struct prog_info *pi, char *next)
+{
+	int i;
+	char *data;
+	struct data_list *incpath, *dl;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCLUDEPATH needs an operand");
+		return (True);
+	}
+	data = get_next_token(next, TERM_SPACE);
+	if (data) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCLUDEPATH needs an operand!!!");
 		get_next_token(data, TERM_END);
 		if (!get_expr(pi, data, &i))
 			return (False);
+	}
+	next = term_string(pi, next);
+	/* get arg list start pointer */
+	incpath = GET_ARG_LIST(pi->args, ARG_INCLUDEPATH);
 
-		if (test_label(pi,next,"%s have already been defined as a label")!=NULL)
-			return (True);
-		if (test_constant(pi,next,"%s have already been defined as a .EQU constant")!=NULL)
-			return (True);
-		return (def_var(pi, next, i));
-	case DIRECTIVE_DEFINE:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".DEFINE needs an operand");
-			return (True);
-		}
-		data = get_next_token(next, TERM_SPACE);
-		if (data) {
-			get_next_token(data, TERM_END);
-			if (!get_expr(pi, data, &i))
-				return (False);
-		} else
-			i = 1;
-		if (test_label(pi,next,"%s have already been defined as a label")!=NULL)
-			return (True);
-		if (test_variable(pi,next,"%s have already been defined as a .SET variable")!=NULL)
-			return (True);
-		/* Forward references allowed. But check, if everything is ok ... */
-		if (pi->pass==PASS_1) { /* Pass 1 */
-			if (test_constant(pi,next,"Can't redefine constant %s, use .SET instead")!=NULL)
-				return (True);
-			if (def_const(pi, next, i)==False)
-				return (False);
-		} else { /* Pass 2 */
-			int j;
-			if (get_constant(pi, next, &j)==False) {  /* Defined in Pass 1 and now missing ? */
-				print_msg(pi, MSGTYPE_ERROR, "Constant %s is missing in pass 2", next);
-				return (False);
-			}
-			if (i != j) {
-				print_msg(pi, MSGTYPE_ERROR, "Constant %s changed value from %d in pass1 to %d in pass 2", next,j,i);
+	data = malloc(strlen(next)+1);
+
+	if (data) {
+		strcpy(data, next);
+
+		/* search for last element */
+		if (incpath == NULL) {
+			dl = malloc(sizeof(struct data_list));
+			
+			if (dl) {
+				dl->next = NULL;
+				dl->data = data;
+				SET_ARG_LIST(pi->args, ARG_INCLUDEPATH, dl);
+			} else {
+				printf("Error: Unable to allocate memory\n");
 				return (False);
 			}
-			/* OK. Definition is unchanged */
-		}
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
-		}
-		break;
-	case DIRECTIVE_NOOVERLAP:
-		if (pi->pass == PASS_1) {
-			fix_orglist(pi->segment);
-			pi->segment_overlap = SEG_DONT_OVERLAP;
-			def_orglist(pi->segment);
-		}
-		break;
-	case DIRECTIVE_OVERLAP:
-		if (pi->pass == PASS_1) {
-			fix_orglist(pi->segment);
-			pi->segment_overlap = SEG_ALLOW_OVERLAP;
-			def_orglist(pi->segment);
-		}
-		break;
-	case DIRECTIVE_PRAGMA:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, "PRAGMA needs an operand, %s should be specified",
-			          snprint_list(buf, sizeof(buf), pragma_list));
-			return (True);
-		}
-		my_strupr(next);
-		data = get_next_token(next, TERM_SPACE);
-		pragma = lookup_keyword(pragma_list, next, False);
-		switch (pragma) {
-
-		case PRAGMA_OVERLAP:
-			if (pi->pass == PASS_1) {
-				int overlap_setting = OVERLAP_UNDEFINED;
-				if (data) {
-					my_strupr(data);
-					overlap_setting = lookup_keyword(overlap_value, data, False);
-				};
-				switch (overlap_setting) {
-				case OVERLAP_DEFAULT:
-					pi->effective_overlap = GET_ARG_I(pi->args, ARG_OVERLAP);
-					break;
-
-				case OVERLAP_IGNORE:
-				case OVERLAP_WARNING:
-					[[fallthrough]];
-				case OVERLAP_ERROR:
-					pi->effective_overlap = overlap_setting;
-					break;
-
-				default:
-					print_msg(pi, MSGTYPE_ERROR, "For PRAGMA %s directive"
-					          " %s should be specified as the parameter", next,
-					          snprint_list(buf, sizeof(buf), overlap_value));
-					return (False);
-				}
-			}
-			return (True);
-			break;
-		default:
-			/* PRAGMA directives are silently ignored */
-			return (True);
-		}
-		break;
-	case DIRECTIVE_UNDEF: /* TODO */
-		break;
-	case DIRECTIVE_IFDEF:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".IFDEF needs an operand");
-			return True;
-		}
-		get_next_token(next, TERM_END);
-		/* Store location of ifdef (line number and file number) if the condition
-		 * fails on pass 1 so that we do not reinterpret it as succeeding on pass 2. */
-		if ((pi->pass==PASS_1 && get_symbol(pi, next, NULL)) || (pi->pass==PASS_2 && !ifdef_is_blacklisted(pi))) {
-			pi->conditional_depth++;
-		} else {
-			if (pi->pass==PASS_1) {
-				/* Blacklist this ifdef. */
-				if (!ifdef_blacklist(pi)) {
-					return False;
-				}
-			}
-			if (!spool_conditional(pi, False)) {
-				return False;
-			}
-		}
-		break;
-	case DIRECTIVE_IFNDEF:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".IFNDEF needs an operand");
-			return True;
-		}
-		get_next_token(next, TERM_END);
-		/* Store location of ifndef (line number and file number) if the condition
-		 * fails on pass 1 so that we do not reinterpret it as succeeding on pass 2. */
-		if ((pi->pass==PASS_1 && !get_symbol(pi, next, NULL)) || (pi->pass==PASS_2 && !ifndef_is_blacklisted(pi))) {
-			pi->conditional_depth++;
 		} else {
-			if (pi->pass==PASS_1) {
-				/* Blacklist this ifndef. */
-				if (!ifndef_blacklist(pi)) {
-					return False;
-				}
-			}
-			if (!spool_conditional(pi, False)) {
-				return False;
-			}
+			add_arg(&incpath, data);
 		}
-		break;
-	case DIRECTIVE_IF:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, ".IF needs an expression");
-			return (True);
-		}
-		get_next_token(next, TERM_END);
-		if (!get_expr(pi, next, &i))
+	} else {
+		printf("Error: Unable to allocate memory\n");
+		return (False);
+	}
+	return (True);
+}
+
+static int
+directive_list(struct prog_info *pi, char *next)
+{
+	if (pi->pass == PASS_2)
+		if (pi->list_file)
+			pi->list_on = True;
+	return (True);
+}
+
+static int
+directive_listmac(struct prog_info *pi, char *next)
+{
+	if (pi->pass == PASS_2)
+		SET_ARG_I(pi->args, ARG_LISTMAC, True);
+	return (True);
+}
+
+static int
+directive_macro(struct prog_info *pi, char *next)
+{
+	return (read_macro(pi, next));
+}
+
+static int
+directive_rept(struct prog_info *pi, char *next)
+{
+	return (read_repeat(pi, REPEAT_REPT, next));
+}
+
+static int
+directive_irp(struct prog_info *pi, char *next)
+{
+	return (read_repeat(pi, REPEAT_IRP, next));
+}
+
+static int
+directive_irpc(struct prog_info *pi, char *next)
+{
+	return (read_repeat(pi, REPEAT_IRPC, next));
+}
+
+static int
+directive_nolist(struct prog_info *pi, char *next)
+{
+	if (pi->pass == PASS_2)
+		pi->list_on = False;
+	return (True);
+}
+
+static int
+directive_org(struct prog_info *pi, char *next)
+{
+	int i;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".ORG needs an operand");
+		return (True);
+	}
+	get_next_token(next, TERM_END);
+	if (!get_expr(pi, next, &i))
+		return (False);
+	fix_orglist(pi->segment);
+	pi->segment->addr = i; /* XXX advance */
+	def_orglist(pi->segment);
+	if (pi->fi->label)
+		pi->fi->label->value = i;
+	list_source(pi, LIST_INDENT);
+	return (True);
+}
+
+static int
+directive_set(struct prog_info *pi, char *next)
+{
+	int i;
+	char *data;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".SET needs an operand");
+		return (True);
+	}
+	data = get_next_token(next, TERM_EQUAL);
+	if (!data) {
+		print_msg(pi, MSGTYPE_ERROR, "%s needs an expression (e.g. .SET BZZZT = 0x2a)", next);
+		return (True);
+	}
+	get_next_token(data, TERM_END);
+	if (!get_expr(pi, data, &i))
+		return (False);
+
+	if (test_label(pi,next,"%s have already been defined as a label")!=NULL)
+		return (True);
+	if (test_constant(pi,next,"%s have already been defined as a .EQU constant")!=NULL)
+		return (True);
+	return (def_var(pi, next, i));
+}
+
+static int
+directive_define(struct prog_info *pi, char *next)
+{
+	int i;
+	char *data;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".DEFINE needs an operand");
+		return (True);
+	}
+	data = get_next_token(next, TERM_SPACE);
+	if (data) {
+		get_next_token(data, TERM_END);
+		if (!get_expr(pi, data, &i))
 			return (False);
-		if (i)
-			pi->conditional_depth++;
-		else {
-			if (!spool_conditional(pi, False))
+	} else
+		i = 1;
+	return (define_constant(pi, next, i));
+}
+
+static int
+directive_nooverlap(struct prog_info *pi, char *next)
+{
+	if ((pi->pass == PASS_1) || pi->relaxing) {
+		fix_orglist(pi->segment);
+		pi->segment_overlap = SEG_DONT_OVERLAP;
+		def_orglist(pi->segment);
+	}
+	return (True);
+}
+
+static int
+directive_overlap(struct prog_info *pi, char *next)
+{
+	if ((pi->pass == PASS_1) || pi->relaxing) {
+		fix_orglist(pi->segment);
+		pi->segment_overlap = SEG_ALLOW_OVERLAP;
+		def_orglist(pi->segment);
+	}
+	return (True);
+}
+
+static int
+directive_pragma(struct prog_info *pi, char *next)
+{
+	int pragma;
+	char *data, buf[140];
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, "PRAGMA needs an operand, %s should be specified",
+		          snprint_list(buf, sizeof(buf), pragma_list));
+		return (True);
+	}
+	data = get_next_token(next, TERM_SPACE);
+	pragma = lookup_keyword(pragma_list, pragma_slot, PRAGMA_HASH_MASK, next, strlen(next));
+	switch (pragma) {
+
+	case PRAGMA_OVERLAP:
+		if (pi->pass == PASS_1) {
+			int overlap_setting = OVERLAP_UNDEFINED;
+			if (data) {
+				get_next_token(data, TERM_SPACE);
+				overlap_setting = lookup_keyword(overlap_value, overlap_slot, OVERLAP_HASH_MASK,
+				                                 data, strlen(data));
+			};
+			switch (overlap_setting) {
+			case OVERLAP_DEFAULT:
+				pi->effective_overlap = GET_ARG_I(pi->args, ARG_OVERLAP);
+				break;
+
+			case OVERLAP_IGNORE:
+			case OVERLAP_WARNING:
+				[[fallthrough]];
+			case OVERLAP_ERROR:
+				pi->effective_overlap = overlap_setting;
+				break;
+
+			default:
+				print_msg(pi, MSGTYPE_ERROR, "For PRAGMA %s directive"
+				          " %s should be specified as the parameter", my_strupr(next),
+				          snprint_list(buf, sizeof(buf), overlap_value));
 				return (False);
-		}
-		break;
-	case DIRECTIVE_ELSE:
-	case DIRECTIVE_ELIF:
-		[[fallthrough]];
-	case DIRECTIVE_ELSEIF:
-		if (!spool_conditional(pi, True))
-			return (False);
-		break;
-	case DIRECTIVE_ENDIF:
-		if (pi->conditional_depth == 0)
-			print_msg(pi, MSGTYPE_ERROR, "Too many .ENDIF");
-		else
-			pi->conditional_depth--;
-		break;
-	case DIRECTIVE_MESSAGE:
-		if (pi->pass == PASS_1)
-			return (True);
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, "No message parameter supplied");
-			return (True);
-		}
-		print_msg(pi, MSGTYPE_MESSAGE_NO_LF, NULL); 	/* Prints Line Header (filename, linenumber) without trailing \n */
-		while (next) {
-			data = get_next_token(next, TERM_COMMA);
-			if (next[0] == '\"') { 	/* string parsing */
-				next = term_string(pi, next);
-				print_msg(pi, MSGTYPE_APPEND,"%s",next);
-				while (*next != '\0') {
-					next++;
-				}
-			} else {
-				if (!get_expr(pi, next, &i)) {
-					print_msg(pi, MSGTYPE_APPEND,"\n"); /* Add newline */
-					return (False);
-				}
-				print_msg(pi, MSGTYPE_APPEND,"0x%02X",i);
 			}
-			next = data;
 		}
-		print_msg(pi, MSGTYPE_APPEND,"\n"); /* Add newline */
-		break;
-	case DIRECTIVE_WARNING:
-		if (pi->pass == PASS_1)
-			return (True);
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, "No warning string supplied");
-			return (True);
+		return (True);
+	default:
+		/* PRAGMA directives are silently ignored */
+		return (True);
+	}
+}
+
+static int
+directive_ifdef(struct prog_info *pi, char *next)
+{
+	int defined = False;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".IFDEF needs an operand");
+		return True;
+	}
+	get_next_token(next, TERM_END);
+	if (pi->pass == PASS_1)
+		defined = (get_symbol(pi, next, NULL) != 0);
+	if (!conditional_outcome(pi, &defined))
+		return (False);
+	if (defined) {
+		pi->conditional_depth++;
+	} else {
+		if (!spool_conditional(pi, False)) {
+			return False;
 		}
-		next = term_string(pi, next);
-		print_msg(pi, MSGTYPE_WARNING, next);
-		break;
-	case DIRECTIVE_ERROR:
-		if (!next) {
-			print_msg(pi, MSGTYPE_ERROR, "No error string supplied");
-			return (True);
+	}
+	return (True);
+}
+
+static int
+directive_ifndef(struct prog_info *pi, char *next)
+{
+	int undefined = False;
+
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".IFNDEF needs an operand");
+		return True;
+	}
+	get_next_token(next, TERM_END);
+	if (pi->pass == PASS_1)
+		undefined = !get_symbol(pi, next, NULL);
+	if (!conditional_outcome(pi, &undefined))
+		return (False);
+	if (undefined) {
+		pi->conditional_depth++;
+	} else {
+		if (!spool_conditional(pi, False)) {
+			return False;
 		}
-		next = term_string(pi, next);
-		print_msg(pi, MSGTYPE_ERROR, "%s", next);
-		pi->error_count = pi->max_errors;
-		if (pi->pass == PASS_1)
-			return (True);
-		break;
 	}
-	return (ok);
+	return (True);
 }
 
+static int
+directive_if(struct prog_info *pi, char *next)
+{
+	int i;
 
-int
-lookup_keyword(const char *const keyword_list[], const char *const keyword, int strict)
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, ".IF needs an expression");
+		return (True);
+	}
+	get_next_token(next, TERM_END);
+	/* Pass 2 replays the outcome of pass 1 without evaluating */
+	if ((pi->pass == PASS_1) && !get_expr(pi, next, &i))
+		return (False);
+	if (!conditional_outcome(pi, &i))
+		return (False);
+	if (i)
+		pi->conditional_depth++;
+	else {
+		if (!spool_conditional(pi, False))
+			return (False);
+	}
+	return (True);
+}
+
+/* .ELSE, .ELIF and .ELSEIF reached while the .IF part was assembled */
+static int
+directive_else(struct prog_info *pi, char *next)
+{
+	if (!spool_conditional(pi, True))
+		return (False);
+	return (True);
+}
+
+static int
+directive_endif(struct prog_info *pi, char *next)
+{
+	if (pi->conditional_depth == 0)
+		print_msg(pi, MSGTYPE_ERROR, "Too many .ENDIF");
+	else
+		pi->conditional_depth--;
+	return (True);
+}
+
+static int
+directive_message(struct prog_info *pi, char *next)
 {
 	int i;
+	char *data;
 
-	for (i = 0; keyword_list[i] != NULL; i++) {
-		if (strict) {
-			if (!strcmp(keyword, keyword_list[i]))
-				return (i);
+	if (pi->pass == PASS_1)
+		return (True);
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, "No message parameter supplied");
+		return (True);
+	}
+	print_msg(pi, MSGTYPE_MESSAGE_NO_LF, NULL); 	/* Prints Line Header (filename, linenumber) without trailing \n */
+	while (next) {
+		data = get_next_token(next, TERM_COMMA);
+		if (next[0] == '\"') { 	/* string parsing */
+			next = term_string(pi, next);
+			print_msg(pi, MSGTYPE_APPEND,"%s",next);
+			while (*next != '\0') {
+				next++;
+			}
 		} else {
-			if (!strncmp(keyword, keyword_list[i], strlen(keyword_list[i])))
-				return (i);
+			if (!get_expr(pi, next, &i)) {
+				print_msg(pi, MSGTYPE_APPEND,"\n"); /* Add newline */
+				return (False);
+			}
+			print_msg(pi, MSGTYPE_APPEND,"0x%02X",i);
 		}
+		next = data;
 	}
-	return (-1);
+	print_msg(pi, MSGTYPE_APPEND,"\n"); /* Add newline */
+	return (True);
+}
+
+static int
+directive_warning(struct prog_info *pi, char *next)
+{
+	if (pi->pass == PASS_1)
+		return (True);
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, "No warning string supplied");
+		return (True);
+	}
+	next = term_string(pi, next);
+	print_msg(pi, MSGTYPE_WARNING, next);
+	return (True);
+}
+
+static int
+directive_error(struct prog_info *pi, char *next)
+{
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, "No error string supplied");
+		return (True);
+	}
+	next = term_string(pi, next);
+	print_msg(pi, MSGTYPE_ERROR, "%s", next);
+	pi->error_count = pi->max_errors;
+	return (True);
+}
+
+struct directive {
+	const char *name;
+	int (*handler)(struct prog_info *pi, char *next);
+};
+
+static const struct directive directive_table[DIRECTIVE_COUNT] = {
+	[DIRECTIVE_BYTE]        = { "BYTE",        directive_byte },
+	[DIRECTIVE_CSEG]        = { "CSEG",        directive_cseg },
+	[DIRECTIVE_CSEGSIZE]    = { "CSEGSIZE",    directive_ignored },
+	[DIRECTIVE_DB]          = { "DB",          directive_db },
+	[DIRECTIVE_DEF]         = { "DEF",         directive_def },
+	[DIRECTIVE_DEVICE]      = { "DEVICE",      directive_device },
+	[DIRECTIVE_DSEG]        = { "DSEG",        directive_dseg },
+	[DIRECTIVE_DW]          = { "DW",          directive_dw },
+	[DIRECTIVE_ENDM]        = { "ENDM",        directive_endm },
+	[DIRECTIVE_ENDMACRO]    = { "ENDMACRO",    directive_endm },
+	[DIRECTIVE_EQU]         = { "EQU",         directive_equ },
+	[DIRECTIVE_ESEG]        = { "ESEG",        directive_eseg },
+	[DIRECTIVE_EXIT]        = { "EXIT",        directive_exit },
+	[DIRECTIVE_INCLUDE]     = { "INCLUDE",     directive_include },
+	[DIRECTIVE_INCLUDEPATH] = { "INCLUDEPATH", directive_includepath },
+	[DIRECTIVE_LIST]        = { "LIST",        directive_list },
+	[DIRECTIVE_LISTMAC]     = { "LISTMAC",     directive_listmac },
+	[DIRECTIVE_MACRO]       = { "MACRO",       directive_macro },
+	[DIRECTIVE_NOLIST]      = { "NOLIST",      directive_nolist },
+	[DIRECTIVE_ORG]         = { "ORG",         directive_org },
+	[DIRECTIVE_SET]         = { "SET",         directive_set },
+	[DIRECTIVE_DEFINE]      = { "DEFINE",      directive_define },
+	[DIRECTIVE_UNDEF]       = { "UNDEF",       directive_ignored }, /* TODO */
+	[DIRECTIVE_IFDEF]       = { "IFDEF",       directive_ifdef },
+	[DIRECTIVE_IFNDEF]      = { "IFNDEF",      directive_ifndef },
+	[DIRECTIVE_IF]          = { "IF",          directive_if },
+	[DIRECTIVE_ELSE]        = { "ELSE",        directive_else },
+	[DIRECTIVE_ELSEIF]      = { "ELSEIF",      directive_else },
+	[DIRECTIVE_ELIF]        = { "ELIF",        directive_else },
+	[DIRECTIVE_ENDIF]       = { "ENDIF",       directive_endif },
+	[DIRECTIVE_MESSAGE]     = { "MESSAGE",     directive_message },
+	[DIRECTIVE_WARNING]     = { "WARNING",     directive_warning },
+	[DIRECTIVE_ERROR]       = { "ERROR",       directive_error },
+	[DIRECTIVE_PRAGMA]      = { "PRAGMA",      directive_pragma },
+	[DIRECTIVE_OVERLAP]     = { "OVERLAP",     directive_overlap },
+	[DIRECTIVE_NOOVERLAP]   = { "NOOVERLAP",   directive_nooverlap },
+	[DIRECTIVE_INCBIN]      = { "INCBIN",      directive_incbin },
+	[DIRECTIVE_REPT]        = { "REPT",        directive_rept },
+	[DIRECTIVE_IRP]         = { "IRP",         directive_irp },
+	[DIRECTIVE_IRPC]        = { "IRPC",        directive_irpc },
+	[DIRECTIVE_ENDR]        = { "ENDR",        directive_endr }
+};
+
+/* Parse the directive line (starting with '.' or '#') */
+int
+parse_directive(struct prog_info *pi, const char *line)
+{
+	int directive, len;
+	const char *name, *rest;
+	char *next = NULL;
+
+	name = line + 1;
+	for (len = 0; !IS_HOR_SPACE(name[len]) && !IS_END_OR_COMMENT(name[len]); len++);
+	directive = -1;
+	if (len > 0) {
+		directive = directive_slot[keyword_hash(name, len) & DIRECTIVE_HASH_MASK] - 1;
+		if ((directive >= 0) && nocase_strcmp_n(directive_table[directive].name, name, len))
+			directive = -1;
+	}
+	if (directive == -1) {
+		print_msg(pi, MSGTYPE_ERROR, "Unknown directive: %.*s", len + 1, line);
+		return (True);
+	}
+	/* The handlers split their operands in place, so they get a copy */
+	for (rest = &name[len]; IS_HOR_SPACE(*rest); rest++);
+	if (!IS_END_OR_COMMENT(*rest)) {
+		strcpy(pi->fi->scratch, rest);
+		next = pi->fi->scratch;
+	}
+	return (directive_table[directive].handler(pi, next));
 }
 
 char *
@@ -795,6 +1116,7 @@ parse_db(struct prog_info *pi, char *next)
 {
 	int i;
 	int count;
+	int padded;
 	char *data;
 	char prev = 0;
 
@@ -805,9 +1127,7 @@ parse_db(struct prog_info *pi, char *next)
 	}
 
 	count = 0;
-	if (pi->pass == PASS_2 && pi->list_on) {
-		fprintf(pi->list_file, "%c:%06lX ", pi->segment->ident, pi->segment->addr);
-	}
+	list_bytes(pi, pi->segment);
 	/* get each db token */
 	while (next) {
 		data = get_next_token(next, TERM_COMMA);
@@ -817,40 +1137,37 @@ parse_db(struct prog_info *pi, char *next)
 			while (*next != '\0') {
 				count++;
 				write_db(pi, *next, &prev, count);
-				if (pi->pass == PASS_2 && pi->list_on)
-					fprintf(pi->list_file, "%02X", (unsigned char)*next);
+				list_byte(pi, (unsigned char)*next);
 				if ((unsigned char)*next > 127 && pi->pass == PASS_2)
 					print_msg(pi, MSGTYPE_WARNING, "Found .DB string with characters > code 127. Be careful !"); /* Print warning for codes > 127 */
 				next++;
 			}
 		} else {
 			if (pi->pass == PASS_2) {
-				if (!get_expr(pi, next, &i))
+				if (!get_literal(next, &i) && !get_expr(pi, next, &i))
 					return (False);
 				if ((i < -128) || (i > 255))
 					print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-128 <= k <= 255). Will be masked", i);
-				if (pi->list_on) fprintf(pi->list_file, "%02X", i);
+				list_byte(pi, i);
 			}
 			count++;
 			write_db(pi, (char)i, &prev, count);
 		}
 		next = data;
 	}
+	padded = False;
 	if (pi->segment == pi->cseg) { /* XXX PAD */
 		/* Optimization: use bitwise AND for parity check instead of modulo */
 		if ((count & 1) == 1) {
+			padded = True;
 			if (pi->pass == PASS_2)  {
-				if (pi->list_on) fprintf(pi->list_file, "00 ; zero byte added");
 				write_prog_word(pi, pi->segment->addr, prev & 0xFF);
 				print_msg(pi, MSGTYPE_WARNING, "A .DB segment with an odd number of bytes is detected. A zero byte is added.");
 			}
 			advance_ip(pi->cseg, 1);
 		}
 	}
-	if (pi->pass == PASS_2 && pi->list_on) {
-		fprintf(pi->list_file, "\n");
-		pi->list_line = NULL;
-	}
+	list_bytes_end(pi, padded);
 	return True;
 }
 
@@ -894,8 +1211,8 @@ spool_conditional(struct prog_info *pi, int only_endif)
 		}
 		print_msg(pi, MSGTYPE_ERROR, "Found no closing .ENDIF in macro");
 	} else {
-		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on)
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
+		/* the line that ends the spool is listed by parse_line() */
+		list_text(pi, LIST_INDENT, pi->list_line);
 		while (fgets_new(pi,pi->fi->buff, LINEBUFFER_LENGTH, pi->fi->fp)) {
 			pi->fi->line_number++;
 			if (check_conditional(pi, pi->fi->buff, &current_depth,  &do_next, only_endif)) {
@@ -920,33 +1237,33 @@ int
 check_conditional(struct prog_info *pi, char *pbuff, int *current_depth, int *do_next, int only_endif)
 {
 	int i = 0;
-	char *next;
-	char linebuff[LINEBUFFER_LENGTH];
-
-	strcpy(linebuff, pbuff); /* avoid cutting of the end of .elif line */
+	const char *name, *next;
+	struct token tok, expr;
 
 	*do_next = False;
-	while (IS_HOR_SPACE(linebuff[i]) && !IS_END_OR_COMMENT(linebuff[i])) i++;
-	if ((linebuff[i] == '.') || (linebuff[i] == '#')) {
-		i++;
-		if (!nocase_strncmp(&linebuff[i], "if", 2))
+	next = get_token(pbuff, &tok);
+	if (tok.kind == TOKEN_DIRECTIVE) {
+		name = tok.start + 1;
+		if (!nocase_strncmp(name, "if", 2))
 			(*current_depth)++;
-		else if (!nocase_strncmp(&linebuff[i], "endif", 5)) {
+		else if (!nocase_strncmp(name, "endif", 5)) {
 			if (*current_depth == 0)
 				return (True);
 			(*current_depth)--;
 		} else if (!only_endif && (*current_depth == 0)) {
-			if ((!nocase_strncmp(&linebuff[i], "else", 4)) && (nocase_strncmp(&linebuff[i], "elseif", 6))) {
+			if ((!nocase_strncmp(name, "else", 4)) && (nocase_strncmp(name, "elseif", 6))) {
 				pi->conditional_depth++;
 				return (True);
-			}	else if ((!nocase_strncmp(&linebuff[i], "elif", 4)) || (!nocase_strncmp(&linebuff[i], "elseif", 6))) {
-				next = get_next_token(&linebuff[i], TERM_SPACE);
-				if (!next) {
+			}	else if ((!nocase_strncmp(name, "elif", 4)) || (!nocase_strncmp(name, "elseif", 6))) {
+				while (IS_HOR_SPACE(*next)) next++;
+				if (IS_END_OR_COMMENT(*next)) {
 					print_msg(pi, MSGTYPE_ERROR, ".ELSEIF / .ELIF needs an operand");
 					return (True);
 				}
-				get_next_token(next, TERM_END);
-				if (!get_expr(pi, next, &i))
+				get_operand(next, &expr);
+				if ((pi->pass == PASS_1) && !get_expr_token(pi, &expr, &i))
+					return (False);
+				if (!conditional_outcome(pi, &i))
 					return (False);
 				if (i)
 					pi->conditional_depth++;
@@ -962,16 +1279,46 @@ check_conditional(struct prog_info *pi, char *pbuff, int *current_depth, int *do
 	return (True);
 }
 
+/* True if filename exists and is not a directory. Both passes and every
+ * include of the same file test the same paths, so the result of each path
+ * is kept, whether it was found or not. */
 int
-test_include(const char *filename)
+test_include(struct prog_info *pi, const char *filename)
 {
-	FILE *fp;
-	fp = fopen(filename, "r");
-	if (fp) {
-		fclose(fp);
-		return (True);
-	} else
-		return (False);
+	struct include_path **bucket, *path;
+	struct stat st;
+	int found, len = strlen(filename);
+
+	bucket = &pi->include_path_hash[nocase_hash(filename, len) & (INCLUDE_HASH_SIZE - 1)];
+	for (path = *bucket; path; path = path->hash_next) {
+		if (!strcmp(path->name, filename))
+			return (path->found);
+	}
+	found = !stat(filename, &st) && !S_ISDIR(st.st_mode);
+	if ((path = malloc(sizeof(struct include_path) + len + 1)) == NULL)
+		return (found);	/* Just not cached */
+	path->name = (char *)(path + 1);
+	strcpy(path->name, filename);
+	path->found = found;
+	path->hash_next = *bucket;
+	*bucket = path;
+	STAT_ALLOC(pi, 1, sizeof(struct include_path) + len + 1);
+	return (found);
+}
+
+void
+free_include_paths(struct prog_info *pi)
+{
+	struct include_path *path, *next;
+	int i;
+
+	for (i = 0; i < INCLUDE_HASH_SIZE; i++) {
+		for (path = pi->include_path_hash[i]; path; path = next) {
+			next = path->hash_next;
+			free(path);
+		}
+		pi->include_path_hash[i] = NULL;
+	}
 }
 
 /* end of directiv.c */
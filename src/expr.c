@@ -106,7 +106,7 @@ log_2(int value)
 }
 
 int
-get_operator(char *op)
+get_operator(const char *op)
 {
 	switch (op[0]) {
 	case '*':
@@ -251,7 +251,7 @@ calc(struct prog_info *pi, int left, int operator, int right) /* TODO: Sjekk lit
 
 /* If found, return the ID of the internal function */
 int
-get_function(char *function)
+get_function(const char *function)
 {
 	int i;
 
@@ -259,8 +259,8 @@ get_function(char *function)
 		if (!nocase_strncmp(function, function_list[i], strlen(function_list[i]))) {
 			/* some more checks to allow whitespace between function name
 			 * and opening brace... */
-			char *tmp = function + strlen(function_list[i]);
-			while (*tmp <= ' ')
+			const char *tmp = function + strlen(function_list[i]);
+			while ((*tmp != '\0') && (*tmp <= ' '))
 				tmp++;
 			if (*tmp != '(')
 				continue;
@@ -310,43 +310,48 @@ get_symbol(struct prog_info *pi, char *label_name, int *data)
 	if (get_constant(pi,label_name,data)) return (True);
 	if (get_variable(pi,label_name,data)) return (True);
 
-	for (macro_call = pi->macro_call; macro_call; macro_call = macro_call->prev_on_stack) {
-		for (label = pi->macro_call->first_label; label; label = label->next)
-			if (!nocase_strcmp(label->name, label_name)) {
-				if (data)
-					*data = label->value;
-				return (True);
-			}
+	/* Local labels of the macro calls being expanded, innermost first,
+	 * then the global labels */
+	for (macro_call = pi->macro_call; ; macro_call = macro_call->prev_on_stack) {
+		label = find_label(pi, label_name, macro_call);
+		if (label) {
+			if (data)
+				*data = label->value;
+			return (True);
+		}
+		if (!macro_call)
+			return (False);
 	}
-
-	if (get_label(pi,label_name,data)) return (True);
-	return (False);
 }
 
 
+/* Length of the text up to the ')' matching an already consumed '(',
+ * or -1 if it is not found before end (or the end of the string). */
 int
-par_length(char *data)
+par_length(const char *data, const char *end)
 {
 	int i = 0, b_count = 1;
 
 	for (;;) {
-		if (data[i] == ')') {
+		if ((end && (&data[i] >= end)) || (data[i] == '\0'))
+			return (-1);
+		else if (data[i] == ')') {
 			b_count--;
 			if (!b_count)
 				return (i);
 		} else if (data[i] == '(')
 			b_count++;
-		else if (data[i] == '\0')
-			return (-1);
 		i++;
 	}
 }
 
-[[nodiscard]] int
-get_expr(struct prog_info *pi, char *data, int *value)
+/* Evaluate the expression at data. The expression ends at end (if not NULL),
+ * at the end of the line or at the start of a comment. data is not modified. */
+static int
+eval_expr(struct prog_info *pi, const char *data, const char *end, int *value)
 {
 	/* Definition */
-	int ok, end, i, count, first_flag, length, function;
+	int ok, done, i, count, first_flag, length, function;
 	char unary, *label;
 	struct element *element, *first_element = NULL, *temp_element;
 	struct element **last_element = &first_element;
@@ -354,20 +359,21 @@ get_expr(struct prog_info *pi, char *data, int *value)
 	/* Initialisation */
 	first_flag  = True;
 	ok          = True;
-	end         = False;
+	done        = False;
 	count       = 0;
+	STAT_COUNT(pi, expressions[pi->pass]);
 	unary       = 0;
 	/* the expression parser loop */
 	for (i = 0; ; i++) {
 		/* horizontal space is just skipped */
-		if (IS_HOR_SPACE(data[i]));
+		if (!(end && (&data[i] >= end)) && IS_HOR_SPACE(data[i]));
 		/* test for clean or premature end */
-		else if (IS_END_OR_COMMENT(data[i])) {
+		else if ((end && (&data[i] >= end)) || IS_END_OR_COMMENT(data[i])) {
 			/* Optimization: use bitwise AND instead of modulo for parity check */
 			if ((count & 1) != 1)
 				print_msg(pi, MSGTYPE_ERROR, "Missing value in expression");
 			else
-				end = True;
+				done = True;
 			break;
 		} else if (first_flag && IS_UNARY(data[i])) {
 			unary = data[i];
@@ -383,6 +389,7 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				ok = False;
 				break;
 			}
+			STAT_ALLOC(pi, 1, sizeof(struct element));
 			element->next = NULL;
 			element->data = get_operator(&data[i]);
 			if (element->data == OPERATOR_ERROR) {
@@ -390,6 +397,7 @@ get_expr(struct prog_info *pi, char *data, int *value)
 					print_msg(pi, MSGTYPE_ERROR, "Unknown operator %c%c", data[i], data[i + 1]);
 				else
 					print_msg(pi, MSGTYPE_ERROR, "Unknown operator %c", data[i]);
+				free(element);
 				break;
 			}
 			*last_element = element;
@@ -406,7 +414,10 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				ok = False;
 				break;
 			}
+			STAT_ALLOC(pi, 1, sizeof(struct element));
 			element->next = NULL;
+			*last_element = element;
+			last_element = &element->next;
 			length = 0;
 			if (isdigit(data[i])) {
 				if (tolower(data[i + 1]) == 'x') {
@@ -438,13 +449,12 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				length = 2;
 			} else if (data[i] == '(') {
 				i++;
-				length = par_length(&data[i]);
+				length = par_length(&data[i], end);
 				if (length == -1) {
 					print_msg(pi, MSGTYPE_ERROR, "Missing ')'");
 					break;
 				}
-				data[i + length++] = '\0';
-				ok = get_expr(pi, &data[i], &element->data);
+				ok = eval_expr(pi, &data[i], &data[i + length++], &element->data);
 				if (!ok)
 					break;
 			}
@@ -453,37 +463,42 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				while (data[i] != '(')
 					i++;
 				i++;
-				length = par_length(&data[i]);
+				length = par_length(&data[i], end);
 				if (length == -1) {
 					print_msg(pi, MSGTYPE_ERROR, "Missing ')'");
 					break;
 				}
-				data[i + length++] = '\0';
-				ok = get_expr(pi, &data[i], &element->data);
+				ok = eval_expr(pi, &data[i], &data[i + length++], &element->data);
 				if (!ok)
 					break;
 				element->data = do_function(function, element->data);
 			} else if (!nocase_strncmp(&data[i], "defined(", 8)) {
 				i += 8;
-				length = par_length(&data[i]);
+				length = par_length(&data[i], end);
 				if (length == -1) {
 					print_msg(pi, MSGTYPE_ERROR, "Missing ')'");
 					break;
 				}
-				data[i + length++] = '\0';
-				if (get_symbol(pi, &data[i], NULL))
+				label = malloc_strncpy(&data[i], length++);
+				if (!label) {
+					print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+					ok = False;
+					break;
+				}
+				STAT_ALLOC(pi, 1, length);
+				if (get_symbol(pi, label, NULL))
 					element->data = 1;
 				else
 					element->data = 0;
+				free(label);
 			} else if (!nocase_strncmp(&data[i], "supported(", 10)) {
 				i += 10;
-				length = par_length(&data[i]);
+				length = par_length(&data[i], end);
 				if (length == -1) {
 					print_msg(pi, MSGTYPE_ERROR, "Missing ')'");
 					break;
 				}
-				data[i + length++] = '\0';
-				element->data=is_supported(pi, &data[i]);
+				element->data=is_supported(pi, &data[i], length);
 				if (element->data<0) {
 					if (toupper(data[i])=='X') {
 						if (pi->device->flag&DF_NO_XREG) element->data = 0;
@@ -494,23 +509,23 @@ get_expr(struct prog_info *pi, char *data, int *value)
 					} else if (toupper(data[i])=='Z')
 						element->data = 1;
 					else {
-						print_msg(pi, MSGTYPE_ERROR, "Unknown mnemonic: %s",&data[i]);
+						print_msg(pi, MSGTYPE_ERROR, "Unknown mnemonic: %.*s", length, &data[i]);
 						element->data = 0;
 					}
 				}
+				length++;
 			} else {
 				while (IS_LABEL(data[i + length])) length++;
 				if ((length == 2) && !nocase_strncmp(&data[i], "PC", 2))
 					element->data = pi->cseg->addr;
 				else {
-					label = malloc(length + 1);
+					label = malloc_strncpy(&data[i], length);
 					if (!label) {
 						print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
 						ok = False;
 						break;
 					}
-					strncpy(label, &data[i], length);
-					label[length] = '\0';
+					STAT_ALLOC(pi, 1, length + 1);
 					if (get_symbol(pi, label, &element->data))
 						free(label);
 					else {
@@ -533,13 +548,11 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				element->data = ~element->data;
 				break;
 			}
-			*last_element = element;
-			last_element = &element->next;
 			count++;
 			first_flag = False;
 		}
 	}
-	if (end) {
+	if (done) {
 		for (i = 13; (i >= 4) && (count != 1); i--) {
 			for (element = first_element; element->next;) {
 				if (test_operator_at_precedence(element->next->data, i)) { /* TODO: Vurder en hi_i for kjapphet */
@@ -563,6 +576,66 @@ get_expr(struct prog_info *pi, char *data, int *value)
 	return (ok);
 }
 
+[[nodiscard]] int
+get_expr(struct prog_info *pi, const char *data, int *value)
+{
+	return (eval_expr(pi, data, NULL, value));
+}
+
+/* If data is a single literal (decimal, $ or 0x hex, 0b binary or a 'c'
+ * character, optionally negated) store its value and return True. The
+ * value is the one eval_expr() would compute, but without allocations.
+ * Anything else returns False and needs get_expr(). */
+int
+get_literal(const char *data, int *value)
+{
+	int i, length, negate;
+
+	for (i = 0; IS_HOR_SPACE(data[i]); i++);
+	negate = (data[i] == '-');
+	if (negate)
+		for (i++; IS_HOR_SPACE(data[i]); i++);
+	length = 0;
+	if (isdigit(data[i])) {
+		if (tolower(data[i + 1]) == 'x') {
+			i += 2;
+			while (isxdigit(data[i + length])) length++;
+			*value = atox_n(&data[i], length);
+		} else if (tolower(data[i + 1]) == 'b') {
+			i += 2;
+			*value = 0;
+			while ((data[i + length] == '1') || (data[i + length] == '0')) {
+				*value <<= 1;
+				*value |= data[i + length++] - '0';
+			}
+		} else {
+			while (isdigit(data[i + length])) length++;
+			*value = atoi_n(&data[i], length);
+		}
+	} else if (data[i] == '$') {
+		i++;
+		while (isxdigit(data[i + length])) length++;
+		*value = atox_n(&data[i], length);
+	} else if ((data[i] == '\'') && data[i + 1] && (data[i + 2] == '\'')) {
+		*value = (char)data[i + 1];
+		length = 3;
+	} else
+		return (False);
+	for (i += length; IS_HOR_SPACE(data[i]); i++);
+	if (!IS_END_OR_COMMENT(data[i]))
+		return (False);
+	if (negate)
+		*value = -*value;
+	return (True);
+}
+
+/* Evaluate an operand slice returned by get_operand() */
+[[nodiscard]] int
+get_expr_token(struct prog_info *pi, const struct token *tok, int *value)
+{
+	return (eval_expr(pi, tok->start, tok->start + tok->len, value));
+}
+
 
 /* end of expr.c */
 
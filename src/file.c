@@ -25,16 +25,197 @@
  *     www: https://github.com/Ro5bert/avra
  */
 
+#define _POSIX_C_SOURCE 200809L	/* fmemopen(), fdopen(), fileno() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 
 #include "misc.h"
 #include "avra.h"
 #include "args.h"
+#include "device.h"
+
+static int stdout_fd = -1;	/* The real stdout while an output file is "-" */
+
+/* If an output file is "-", send everything printed to stdout to stderr
+ * instead, so that stdout carries nothing but that file. Must be called
+ * before anything is printed. */
+void
+redirect_stdout(struct args *args)
+{
+	static const int outputs[] = {
+		ARG_OUTFILE, ARG_EEPFILE, ARG_DEBUGFILE, ARG_LISTFILE, ARG_MAPFILE, ARG_MAPJSON
+	};
+	const char *name;
+	size_t i;
+
+	for (i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++) {
+		name = GET_ARG_P(args, outputs[i]);
+		if (name && !strcmp(name, "-")) {
+			fflush(stdout);
+			stdout_fd = dup(STDOUT_FILENO);
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+			return;
+		}
+	}
+}
+
+/* fopen() an output file, "-" is stdout. Only one file can go to stdout. */
+FILE *
+open_output(const char *filename, const char *mode)
+{
+	FILE *fp;
+
+	if (strcmp(filename, "-"))
+		return (fopen(filename, mode));
+	if (stdout_fd < 0)
+		return (NULL);
+	fp = fdopen(stdout_fd, mode);
+	stdout_fd = -1;
+	return (fp);
+}
+
+/* Read all of fp into include_file->spool */
+static int
+spool_source(struct prog_info *pi, struct include_file *include_file, FILE *fp)
+{
+	char *buff = NULL, *p;
+	size_t len = 0, size = 0, n;
+
+	do {
+		if (len == size) {
+			size = size ? size * 2 : 64 * 1024;
+			if (!(p = realloc(buff, size))) {
+				free(buff);
+				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+				return (False);
+			}
+			buff = p;
+		}
+		n = fread(&buff[len], 1, size - len, fp);
+		len += n;
+	} while (n);
+	if (ferror(fp)) {
+		perror(include_file->name);
+		free(buff);
+		return (False);
+	}
+	include_file->spool = buff;
+	include_file->spool_len = len;
+	STAT_ALLOC(pi, 1, size);
+	return (True);
+}
+
+/* Open a source file for reading. Sources that cannot be read twice (stdin
+ * as "-", pipes, character devices) are read once in pass 1 and replayed
+ * from memory in pass 2. */
+FILE *
+open_source(struct prog_info *pi, struct include_file *include_file)
+{
+	struct stat st;
+	FILE *fp;
+
+	if (include_file->spool)
+		return (fmemopen(include_file->spool, include_file->spool_len, "r"));
+	if (!strcmp(include_file->name, "-"))
+		fp = stdin;
+	else if (!(fp = fopen(include_file->name, "r")))
+		return (NULL);
+	if ((fp != stdin) && !fstat(fileno(fp), &st) && S_ISREG(st.st_mode))
+		return (fp);
+	if (!spool_source(pi, include_file, fp)) {
+		if (fp != stdin)
+			fclose(fp);
+		return (NULL);
+	}
+	if (fp != stdin)
+		fclose(fp);
+	return (fmemopen(include_file->spool, include_file->spool_len, "r"));
+}
+
+/* Size of a binary file (.INCBIN), or -1 */
+long
+binary_size(const char *filename)
+{
+	struct stat st;
+
+	if (stat(filename, &st) || !S_ISREG(st.st_mode))
+		return (-1);
+	return ((long)st.st_size);
+}
+
+/* Map length (> 0) bytes at offset of a binary file read only. Returns a
+ * pointer to the first byte, or NULL. */
+const unsigned char *
+map_binary(const char *filename, long offset, long length)
+{
+	FILE *fp;
+	unsigned char *data;
+
+	if (!(fp = fopen(filename, "rb")))
+		return (NULL);
+#ifndef _WIN32
+	/* Map from the start of the file, offset need not be page aligned */
+	data = mmap(NULL, offset + length, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	fclose(fp);
+	return ((data == MAP_FAILED) ? NULL : data + offset);
+#else
+	data = malloc(length);
+	if (data && (fseek(fp, offset, SEEK_SET) || (fread(data, 1, length, fp) != (size_t)length))) {
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+	return (data);
+#endif
+}
+
+void
+unmap_binary(const unsigned char *data, long offset, long length)
+{
+#ifndef _WIN32
+	munmap((void *)(data - offset), offset + length);
+#else
+	free((void *)data);
+#endif
+}
+
+/* Record size and flash page layout of the HEX files */
+static int
+set_hex_layout(struct prog_info *pi)
+{
+	int record = GET_ARG_I(pi->args, ARG_HEX_RECORD);
+	int page = flash_page_size(pi);
+	int paged = GET_ARG_I(pi->args, ARG_HEX_PAGES) || GET_ARG_I(pi->args, ARG_HEX_PAD);
+
+	if ((record < 1) || (record > 255)) {
+		print_msg(pi, MSGTYPE_ERROR, "HEX record size %d is not between 1 and 255", record);
+		return (False);
+	}
+	if ((paged || GET_ARG_P(pi->args, ARG_DELTA)) && ((page < 2) || (page > 65536) || (page & (page - 1)))) {
+		print_msg(pi, MSGTYPE_ERROR, "Flash page size %d is not a power of two up to 65536", page);
+		return (False);
+	}
+	pi->cseg->hfi->record_size = record;
+	pi->eseg->hfi->record_size = record;
+	if (paged) {
+		pi->cseg->hfi->page_size = page;
+		pi->cseg->hfi->pad = GET_ARG_I(pi->args, ARG_HEX_PAD);
+		if ((pi->cseg->hfi->image = calloc(1, sizeof(struct image))) == NULL) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+	}
+	return (True);
+}
 
 int
 open_out_files(struct prog_info *pi, const char *basename, const char *outputfile,
@@ -44,6 +225,8 @@ open_out_files(struct prog_info *pi, const char *basename, const char *outputfil
 	char *buff;
 	int ok = True; /* flag for coff results */
 
+	if (!strcmp(basename, "-"))
+		basename = "stdin";
 	length = strlen(basename);
 	buff = malloc(length + 9);
 	if (buff == NULL) {
@@ -59,6 +242,10 @@ open_out_files(struct prog_info *pi, const char *basename, const char *outputfil
 		buff[length] = '\0';
 	}
 
+	/* The previous image is read before its HEX file may be overwritten */
+	if (GET_ARG_P(pi->args, ARG_DELTA) && !delta_open(pi, GET_ARG_P(pi->args, ARG_DELTA), buff))
+		ok = False;
+
 	/* open files for code output */
 	strcpy(&buff[length], ".hex");
 	if (!(pi->cseg->hfi = open_hex_file((outputfile == NULL) ? buff : outputfile))) {
@@ -78,6 +265,8 @@ open_out_files(struct prog_info *pi, const char *basename, const char *outputfil
 		print_msg(pi, MSGTYPE_ERROR, "Could not create eeprom hex file!");
 		ok = False;
 	}
+	if (ok && !set_hex_layout(pi))
+		ok = False;
 
 	if (GET_ARG_I(pi->args, ARG_COFF) == True) {
 		strcpy(&buff[length], ".cof");
@@ -87,15 +276,19 @@ open_out_files(struct prog_info *pi, const char *basename, const char *outputfil
 
 	/* open list file */
 	if (pi->list_on) {
-		pi->list_file = fopen(GET_ARG_P(pi->args, ARG_LISTFILE), "w");
+		pi->list_file = open_output(GET_ARG_P(pi->args, ARG_LISTFILE), "w");
 		if (pi->list_file == NULL) {
 			print_msg(pi, MSGTYPE_ERROR, "Could not create list file!");
 			ok = False;
 		}
 		/* write list file header */
-		fprintf(pi->list_file,
-		        "\nAVRA   Ver. %s %s %s\n\n",
-		        VERSION, basename, ctime(&pi->time));
+		if (pi->list_file) {
+			fprintf(pi->list_file,
+			        "\nAVRA   Ver. %s %s %s\n\n",
+			        VERSION, basename, ctime(&pi->time));
+			if (!list_open(pi))
+				ok = False;
+		}
 	} else {
 		pi->list_file = NULL;
 	}
@@ -118,8 +311,10 @@ unlink_out_files(struct prog_info *pi, const char *filename)
 
 	close_out_files(pi);
 
+	if (!strcmp(filename, "-"))
+		filename = "stdin";
 	length = strlen(filename);
-	buff = malloc(length + 9);
+	buff = malloc(length + 11);
 	if (buff == NULL) {
 		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
 		return;
@@ -135,6 +330,8 @@ unlink_out_files(struct prog_info *pi, const char *filename)
 	unlink(buff);
 	strcpy(&buff[length], ".eep.hex");
 	unlink(buff);
+	strcpy(&buff[length], ".delta.hex");
+	unlink(buff);
 	strcpy(&buff[length], ".cof");
 	unlink(buff);
 	strcpy(&buff[length], ".lst");
@@ -156,21 +353,38 @@ close_out_files(struct prog_info *pi)
 		         "   EEPROM    :   %7ld bytes\n",
 		         pi->cseg->count, pi->cseg->count * 2, pi->dseg->count, pi->eseg->count);
 		printf("%s", stmp);
+		relax_report(pi);
 	}
-	if (pi->cseg->hfi)
+	delta_close(pi, pi->error_count == 0);
+	if (pi->cseg->hfi) {
+		STAT_BEGIN(pi, STAT_HEX);
 		close_hex_file(pi->cseg->hfi);
-	if (pi->eseg->hfi)
+		STAT_END(pi, STAT_HEX);
+	}
+	if (pi->eseg->hfi) {
+		STAT_BEGIN(pi, STAT_EEP);
 		close_hex_file(pi->eseg->hfi);
+		STAT_END(pi, STAT_EEP);
+	}
 	if (pi->list_file) {
+		STAT_BEGIN(pi, STAT_LIST);
+		list_close(pi);
 		fprintf(pi->list_file, "\n\n%s", stmp);
 		if (pi->error_count == 0)
 			fprintf(pi->list_file, "\nAssembly completed with no errors.\n");
 		fclose(pi->list_file);
+		STAT_END(pi, STAT_LIST);
 	}
-	if (pi->obj_file)
+	if (pi->obj_file) {
+		STAT_BEGIN(pi, STAT_OBJ);
 		close_obj_file(pi, pi->obj_file);
-	if (pi->coff_file)
+		STAT_END(pi, STAT_OBJ);
+	}
+	if (pi->coff_file) {
+		STAT_BEGIN(pi, STAT_COFF);
 		close_coff_file(pi, pi->coff_file);
+		STAT_END(pi, STAT_COFF);
+	}
 }
 
 [[nodiscard]] struct hex_file_info *
@@ -181,7 +395,8 @@ open_hex_file(const char *filename)
 	hfi = calloc(1, sizeof(struct hex_file_info));
 	if (hfi) {
 		hfi->segment = -1;
-		hfi->fp = fopen(filename, "wb");
+		hfi->record_size = 16;
+		hfi->fp = open_output(filename, "wb");
 		if (!hfi->fp) {
 			close_hex_file(hfi);
 			hfi = NULL;
@@ -190,22 +405,118 @@ open_hex_file(const char *filename)
 	return hfi;
 }
 
+static void hex_byte(struct hex_file_info *hfi, int address, unsigned char data);
+
+/* Write the bytes of every page of the image that holds any, either all of
+ * the page or only the bytes written */
+static void
+write_hex_pages(struct hex_file_info *hfi)
+{
+	const struct image *image = hfi->image;
+	long page, address, end;
+
+	for (page = 0; page < image->size / hfi->page_size; page++) {
+		if (!image_page_used(image, page, hfi->page_size))
+			continue;
+		end = (page + 1) * hfi->page_size;
+		for (address = page * hfi->page_size; address < end; address++) {
+			if (hfi->pad || image->written[address])
+				hex_byte(hfi, address, image->bytes[address]);
+		}
+	}
+}
+
 void
 close_hex_file(struct hex_file_info *hfi)
 {
 	if (hfi->fp) {
+		if (hfi->image)
+			write_hex_pages(hfi);
 		if (hfi->count != 0)
 			do_hex_line(hfi);
 		fprintf(hfi->fp, ":00000001FF\x0d\x0a");
 		fclose(hfi->fp);
 	}
+	if (hfi->image) {
+		free_image(hfi->image);
+		free(hfi->image);
+	}
 	free(hfi);
 }
 
+/* Make address a valid index into image */
+static int
+image_grow(struct prog_info *pi, struct image *image, long address)
+{
+	unsigned char *bytes, *written;
+	long size;
+
+	if (address < image->size)
+		return (True);
+	for (size = image->size ? image->size : 64 * 1024; size <= address; size *= 2);
+	bytes = realloc(image->bytes, size);
+	if (bytes)
+		image->bytes = bytes;
+	written = realloc(image->written, size);
+	if (written)
+		image->written = written;
+	if (!bytes || !written) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	memset(&bytes[image->size], 0xff, size - image->size);
+	memset(&written[image->size], 0, size - image->size);
+	STAT_ALLOC(pi, 1, 2 * (size - image->size));
+	image->size = size;
+	return (True);
+}
+
+int
+image_byte(struct prog_info *pi, struct image *image, long address, unsigned char data)
+{
+	if (!image_grow(pi, image, address))
+		return (False);
+	image->bytes[address] = data;
+	image->written[address] = True;
+	return (True);
+}
+
+/* True if any byte of the page was written */
+int
+image_page_used(const struct image *image, long page, int page_size)
+{
+	if ((page + 1) * page_size > image->size)
+		return (False);
+	return (memchr(&image->written[page * page_size], True, page_size) != NULL);
+}
+
+void
+free_image(struct image *image)
+{
+	free(image->bytes);
+	free(image->written);
+	image->bytes = image->written = NULL;
+	image->size = 0;
+}
+
+/* Flash page size in bytes: --page_size, else the page size of the device,
+ * else DEFAULT_PAGE_SIZE for devices that are not written by page */
+int
+flash_page_size(struct prog_info *pi)
+{
+	if (GET_ARG_I(pi->args, ARG_PAGE_SIZE) > 0)
+		return (GET_ARG_I(pi->args, ARG_PAGE_SIZE));
+	if (pi->device->page_size > 0)
+		return (pi->device->page_size * 2);
+	return (DEFAULT_PAGE_SIZE);
+}
+
 void
 write_ee_byte(struct prog_info *pi, int address, unsigned char data)
 {
-	if ((pi->eseg->hfi->count == 16)
+	if (!pi->eseg->hfi)	/* --check */
+		return;
+	if ((pi->eseg->hfi->count == pi->eseg->hfi->record_size)
 	        || ((address != (pi->eseg->hfi->linestart_addr + pi->eseg->hfi->count))
 	            && (pi->eseg->hfi->count != 0)))
 		do_hex_line(pi->eseg->hfi);
@@ -217,12 +528,12 @@ write_ee_byte(struct prog_info *pi, int address, unsigned char data)
 		write_coff_eeprom(pi, address, data);
 }
 
-void
-write_prog_word(struct prog_info *pi, int address, int data)
+/* Add the byte at address to a HEX file, with an extended address record
+ * first when address is in another 64K segment than the last byte. Records
+ * of a file written by page are laid out from the start of each page. */
+static void
+hex_byte(struct hex_file_info *hfi, int address, unsigned char data)
 {
-	struct hex_file_info *hfi = pi->cseg->hfi;
-	write_obj_record(pi, address, data);
-	address *= 2;
 	if (hfi->segment != (address >> 16))	{
 		if (hfi->count != 0)
 			do_hex_line(hfi);
@@ -234,12 +545,34 @@ write_prog_word(struct prog_info *pi, int address, int data)
 			fprintf(hfi->fp, ":02000002%04X%02X\x0d\x0a", (hfi->segment << 12) & 0xffff,
 			        (0 - 2 - 2 - ((hfi->segment << 4) & 0xf0)) & 0xff);
 	}
-	if ((hfi->count == 16) || ((address != (hfi->linestart_addr + hfi->count)) && (hfi->count != 0)))
+	if ((hfi->count == hfi->record_size) || ((address != (hfi->linestart_addr + hfi->count)) && (hfi->count != 0))
+	        || (hfi->page_size && hfi->count && !((address & (hfi->page_size - 1)) % hfi->record_size)))
 		do_hex_line(hfi);
 	if (hfi->count == 0)
 		hfi->linestart_addr = address;
-	hfi->hex_line[hfi->count++] = data & 0xff;
-	hfi->hex_line[hfi->count++] = (data >> 8) & 0xff;
+	hfi->hex_line[hfi->count++] = data;
+}
+
+void
+write_hex_byte(struct prog_info *pi, struct hex_file_info *hfi, int address, unsigned char data)
+{
+	if (hfi->image)
+		image_byte(pi, hfi->image, address, data);
+	else
+		hex_byte(hfi, address, data);
+}
+
+void
+write_prog_word(struct prog_info *pi, int address, int data)
+{
+	if (!pi->cseg->hfi)	/* --check */
+		return;
+	write_obj_record(pi, address, data);
+	if (pi->delta)
+		delta_word(pi, address, data);
+	address *= 2;
+	write_hex_byte(pi, pi->cseg->hfi, address, data & 0xff);
+	write_hex_byte(pi, pi->cseg->hfi, address + 1, (data >> 8) & 0xff);
 
 	if (pi->coff_file)
 		write_coff_program(pi, address, data);
@@ -263,72 +596,127 @@ do_hex_line(struct hex_file_info *hfi)
 }
 
 
+/* The AVR object file is a 26 byte header, one 9 byte record for every
+ * program word and the names of the source files. Records are collected in
+ * pass 2 and the whole file is written by close_obj_file(). */
+
+#define OBJ_HEADER	26
+#define OBJ_RECORD	9
+
+struct obj_record {
+	int seq;		/* Order written, keeps equal addresses in order */
+	unsigned char bytes[OBJ_RECORD];
+};
+
 [[nodiscard]] FILE *
 open_obj_file(struct prog_info *pi, const char *filename)
 {
-	int i;
-	FILE *fp;
-	struct include_file *include_file;
+	pi->obj_records = NULL;
+	pi->obj_count = 0;
+	pi->obj_size = 0;
+	pi->obj_sorted = True;
+	pi->obj_line_warned = False;
+	return (open_output(filename, "wb"));
+}
 
-	fp = fopen(filename, "wb");
-	if (fp) {
-		/* Optimization: buffer writes instead of individual fputc calls */
-		unsigned char buf[64];
-		int buf_pos = 0;
-
-		i = pi->cseg->count * 9 + 26;
-		buf[buf_pos++] = (i >> 24) & 0xff;
-		buf[buf_pos++] = (i >> 16) & 0xff;
-		buf[buf_pos++] = (i >> 8) & 0xff;
-		buf[buf_pos++] = i & 0xff;
-		i = 26;
-		buf[buf_pos++] = (i >> 24) & 0xff;
-		buf[buf_pos++] = (i >> 16) & 0xff;
-		buf[buf_pos++] = (i >> 8) & 0xff;
-		buf[buf_pos++] = i & 0xff;
-		buf[buf_pos++] = 9;
-		i = 0;
-		for (include_file = pi->first_include_file; include_file; include_file = include_file->next)
-			i++;
-		buf[buf_pos++] = i;
-		fwrite(buf, 1, buf_pos, fp);
-
-		fprintf(fp, "AVR Object File");
-		fputc('\0', fp);
-	}
-	return (fp);
+static void
+put_be32(unsigned char *p, int i)
+{
+	p[0] = (i >> 24) & 0xff;
+	p[1] = (i >> 16) & 0xff;
+	p[2] = (i >> 8) & 0xff;
+	p[3] = i & 0xff;
+}
+
+static int
+obj_address(const struct obj_record *r)
+{
+	return ((r->bytes[0] << 16) | (r->bytes[1] << 8) | r->bytes[2]);
 }
 
+static int
+compare_obj_records(const void *a, const void *b)
+{
+	const struct obj_record *ra = a, *rb = b;
+	int diff = obj_address(ra) - obj_address(rb);
+
+	return (diff ? diff : ra->seq - rb->seq);
+}
 
 void
 close_obj_file(struct prog_info *pi, FILE *fp)
 {
 	struct include_file *include_file;
+	unsigned char *buf, *p;
+	size_t size;
+	int i, files = 0;
 
+	size = OBJ_HEADER + (size_t)pi->obj_count * OBJ_RECORD + 1;
 	for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
-		fprintf(fp, "%s", include_file->name);
-		fputc('\0', fp);
+		size += strlen(include_file->name) + 1;
+		files++;
+	}
+	if (!pi->obj_sorted)
+		qsort(pi->obj_records, pi->obj_count, sizeof(struct obj_record), compare_obj_records);
+	if ((buf = malloc(size)) == NULL) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+	} else {
+		put_be32(buf, OBJ_HEADER + pi->obj_count * OBJ_RECORD);
+		put_be32(&buf[4], OBJ_HEADER);
+		buf[8] = OBJ_RECORD;
+		buf[9] = files & 0xff;
+		memcpy(&buf[10], "AVR Object File", 16);
+		p = &buf[OBJ_HEADER];
+		for (i = 0; i < pi->obj_count; i++, p += OBJ_RECORD)
+			memcpy(p, pi->obj_records[i].bytes, OBJ_RECORD);
+		for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
+			strcpy((char *)p, include_file->name);
+			p += strlen(include_file->name) + 1;
+		}
+		*p = '\0';
+		fwrite(buf, 1, size, fp);
+		free(buf);
 	}
-	fputc('\0', fp);
 	fclose(fp);
+	free(pi->obj_records);
+	pi->obj_records = NULL;
 }
 
-
 void
 write_obj_record(struct prog_info *pi, int address, int data)
 {
-	/* Optimization: batch writes into buffer instead of individual fputc calls */
-	unsigned char buf[10];
-	buf[0] = (address >> 16) & 0xff;
-	buf[1] = (address >> 8) & 0xff;
-	buf[2] = address & 0xff;
-	buf[3] = (data >> 8) & 0xff;
-	buf[4] = data & 0xff;
-	buf[5] = pi->fi->include_file->num & 0xff;
-	buf[6] = (pi->fi->line_number >> 8) & 0xff;
-	buf[7] = pi->fi->line_number & 0xff;
-	buf[8] = (pi->macro_call) ? 1 : 0;
-	fwrite(buf, 1, 9, pi->obj_file);
+	struct obj_record *r;
+	int size, line = pi->fi->line_number;
+
+	if (pi->obj_count == pi->obj_size) {
+		size = pi->obj_size ? pi->obj_size * 2 : 4096;
+		if ((r = realloc(pi->obj_records, size * sizeof(struct obj_record))) == NULL) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
+		}
+		STAT_ALLOC(pi, 1, (size - pi->obj_size) * sizeof(struct obj_record));
+		pi->obj_records = r;
+		pi->obj_size = size;
+	}
+	if (line > 0xffff) {
+		if (!pi->obj_line_warned)
+			print_msg(pi, MSGTYPE_WARNING, "Line numbers above 65535 do not fit in the object file, using 65535");
+		pi->obj_line_warned = True;
+		line = 0xffff;
+	}
+	r = &pi->obj_records[pi->obj_count];
+	if (pi->obj_count && (address < obj_address(r - 1)))
+		pi->obj_sorted = False;
+	r->seq = pi->obj_count++;
+	r->bytes[0] = (address >> 16) & 0xff;
+	r->bytes[1] = (address >> 8) & 0xff;
+	r->bytes[2] = address & 0xff;
+	r->bytes[3] = (data >> 8) & 0xff;
+	r->bytes[4] = data & 0xff;
+	r->bytes[5] = pi->fi->include_file->num & 0xff;
+	r->bytes[6] = (line >> 8) & 0xff;
+	r->bytes[7] = line & 0xff;
+	r->bytes[8] = (pi->macro_call) ? 1 : 0;
 }
 
 /* end of file.c */
@@ -0,0 +1,65 @@
+/* Generated by keywords.sh from the keyword lists in directiv.c, do not edit */
+
+static const unsigned char keyword_asso[32] = {
+	0, 53, 44, 48, 55, 18, 4, 20, 46, 1, 0, 0, 2, 59, 21, 14,
+	50, 0, 25, 31, 41, 20, 48, 27, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#define DIRECTIVE_HASH_MASK	63
+#define OVERLAP_HASH_MASK	7
+#define PRAGMA_HASH_MASK	0
+
+static const unsigned char directive_slot[DIRECTIVE_HASH_MASK + 1] = {
+	[0] = DIRECTIVE_EXIT + 1,
+	[1] = DIRECTIVE_IFDEF + 1,
+	[2] = DIRECTIVE_DEF + 1,
+	[6] = DIRECTIVE_NOLIST + 1,
+	[7] = DIRECTIVE_ELSE + 1,
+	[8] = DIRECTIVE_ENDM + 1,
+	[9] = DIRECTIVE_ERROR + 1,
+	[10] = DIRECTIVE_INCLUDE + 1,
+	[11] = DIRECTIVE_IF + 1,
+	[12] = DIRECTIVE_INCBIN + 1,
+	[14] = DIRECTIVE_LIST + 1,
+	[15] = DIRECTIVE_WARNING + 1,
+	[17] = DIRECTIVE_DB + 1,
+	[18] = DIRECTIVE_ENDIF + 1,
+	[19] = DIRECTIVE_DEFINE + 1,
+	[20] = DIRECTIVE_UNDEF + 1,
+	[24] = DIRECTIVE_LISTMAC + 1,
+	[25] = DIRECTIVE_OVERLAP + 1,
+	[26] = DIRECTIVE_CSEG + 1,
+	[27] = DIRECTIVE_ELIF + 1,
+	[28] = DIRECTIVE_CSEGSIZE + 1,
+	[30] = DIRECTIVE_NOOVERLAP + 1,
+	[31] = DIRECTIVE_ENDMACRO + 1,
+	[32] = DIRECTIVE_IFNDEF + 1,
+	[33] = DIRECTIVE_DSEG + 1,
+	[34] = DIRECTIVE_PRAGMA + 1,
+	[38] = DIRECTIVE_ENDR + 1,
+	[39] = DIRECTIVE_IRPC + 1,
+	[40] = DIRECTIVE_IRP + 1,
+	[42] = DIRECTIVE_INCLUDEPATH + 1,
+	[43] = DIRECTIVE_BYTE + 1,
+	[47] = DIRECTIVE_DW + 1,
+	[51] = DIRECTIVE_MESSAGE + 1,
+	[52] = DIRECTIVE_SET + 1,
+	[56] = DIRECTIVE_REPT + 1,
+	[57] = DIRECTIVE_ORG + 1,
+	[59] = DIRECTIVE_ELSEIF + 1,
+	[60] = DIRECTIVE_ESEG + 1,
+	[61] = DIRECTIVE_EQU + 1,
+	[62] = DIRECTIVE_MACRO + 1,
+	[63] = DIRECTIVE_DEVICE + 1
+};
+
+static const unsigned char overlap_slot[OVERLAP_HASH_MASK + 1] = {
+	[1] = OVERLAP_ERROR + 1,
+	[3] = OVERLAP_DEFAULT + 1,
+	[6] = OVERLAP_IGNORE + 1,
+	[7] = OVERLAP_WARNING + 1
+};
+
+static const unsigned char pragma_slot[PRAGMA_HASH_MASK + 1] = {
+	[0] = PRAGMA_OVERLAP + 1
+};
@@ -0,0 +1,188 @@
+#!/bin/sh
+#
+# Generate keywords.h, the perfect hash tables of the directive, .PRAGMA
+# and .OVERLAP keywords, from the keyword lists in directiv.c: the names of
+# directive_table[], pragma_list[] and overlap_value[].
+#
+# keyword_hash() adds the length and the association values of the first,
+# third and last character (low 5 bits). The association values of the
+# current keywords.h are kept while they give every keyword a slot of its
+# own, otherwise new ones are searched for. A table has the smallest power
+# of two slots above its number of keywords.
+#
+# usage: src/keywords.sh [--check]
+#
+# --check writes nothing and fails if keywords.h is not what would be
+# generated (run by make check).
+
+dir="$(cd "$(dirname "$0")" && pwd)"
+header="${dir}/keywords.h"
+out="${header}"
+if [ "$1" = "--check" ]; then
+	out="$(mktemp)"
+	trap 'rm -f "${out}"' EXIT
+fi
+
+asso="${header}"
+[ -f "${asso}" ] || asso=/dev/null
+if ! awk -v header="${asso}" '
+function fail(msg) {
+	print "keywords.sh: " msg > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+function add(table, name, id,   up, i, c, n) {
+	up = toupper(name)
+	if ((table, up) in seen)
+		fail("duplicate keyword " name)
+	seen[table, up] = 1
+	n = ++count[table]
+	key_id[table, n] = id
+	key_name[table, n] = up
+	len[table, n] = length(up)
+	for (i = 1; i <= length(up); i++) {
+		c = index("@ABCDEFGHIJKLMNOPQRSTUVWXYZ", substr(up, i, 1)) - 1
+		if (c < 1)
+			fail("keyword " name " is not all letters")
+	}
+	first[table, n] = index("@ABCDEFGHIJKLMNOPQRSTUVWXYZ", substr(up, 1, 1)) - 1
+	third[table, n] = index("@ABCDEFGHIJKLMNOPQRSTUVWXYZ", substr(up, length(up) > 2 ? 3 : length(up), 1)) - 1
+	last[table, n] = index("@ABCDEFGHIJKLMNOPQRSTUVWXYZ", substr(up, length(up), 1)) - 1
+	used[first[table, n]] = used[third[table, n]] = used[last[table, n]] = 1
+}
+
+function slot(table, n) {
+	return (len[table, n] + asso[first[table, n]] + asso[third[table, n]] + asso[last[table, n]]) % size[table]
+}
+
+# Number of keywords that share a slot with an earlier one
+function collisions(   t, n, s, cost) {
+	cost = 0
+	for (t = 1; t <= tables; t++) {
+		split("", taken)
+		for (n = 1; n <= count[t]; n++) {
+			s = slot(t, n)
+			if (s in taken)
+				cost++
+			taken[s] = 1
+		}
+	}
+	return (cost)
+}
+
+# Change one association value at a time to the value with the fewest
+# collisions, and shake two values up when no change helps
+function search(   cost, best, tries, nbest, l, v, c, round, i) {
+	srand(1)
+	cost = collisions()
+	for (round = 0; cost && (round < 5000); round++) {
+		best = cost
+		for (l = 1; l < 32; l++) {
+			if (!(l in used))
+				continue
+			nbest = 0
+			for (v = 0; v < 64; v++) {
+				asso[l] = v
+				c = collisions()
+				if (c < cost) {
+					cost = c
+					nbest = 0
+				}
+				if (c == cost)
+					tries[++nbest] = v
+			}
+			asso[l] = tries[int(rand() * nbest) + 1]
+			cost = collisions()
+		}
+		if (cost >= best)
+			for (i = 0; i < 2; i++) {
+				do l = int(rand() * 31) + 1; while (!(l in used))
+				asso[l] = int(rand() * 64)
+			}
+		cost = collisions()
+	}
+	if (cost)
+		fail("found no perfect hash")
+}
+
+FILENAME == header {
+	if (/^static const unsigned char keyword_asso/)
+		in_asso = 1
+	else if (in_asso && /^}/)
+		in_asso = 0
+	else if (in_asso) {
+		gsub(/[\t ]/, "")
+		n = split($0, v, ",")
+		for (i = 1; i <= n; i++)
+			if (v[i] != "")
+				asso[nasso++] = v[i] + 0
+	}
+	next
+}
+
+/^static const struct directive directive_table/	{ list = "directive"; next }
+/^static const char \*const pragma_list/	{ list = "pragma"; next }
+/^static const char \*const overlap_value/	{ list = "overlap"; next }
+list != "" && /^}/	{ list = ""; next }
+list == "directive" && match($0, /\[DIRECTIVE_[A-Z]+\]/) {
+	id = substr($0, RSTART + 1, RLENGTH - 2)
+	match($0, /"[A-Za-z]+"/)
+	add(1, substr($0, RSTART + 1, RLENGTH - 2), id)
+	next
+}
+(list == "pragma" || list == "overlap") && match($0, /"[A-Za-z]+"/) {
+	name = substr($0, RSTART + 1, RLENGTH - 2)
+	add(list == "pragma" ? 3 : 2, name, toupper(list) "_" toupper(name))
+}
+
+END {
+	if (failed)
+		exit 1
+	tables = 3
+	table_name[1] = "directive"
+	table_name[2] = "overlap"
+	table_name[3] = "pragma"
+	for (t = 1; t <= tables; t++) {
+		if (!count[t])
+			fail("no " table_name[t] " keywords found in directiv.c")
+		for (size[t] = 1; size[t] < count[t] + (count[t] > 1); size[t] *= 2);
+	}
+	if (nasso != 32)
+		for (l = 0; l < 32; l++)
+			asso[l] = 0
+	search()
+
+	print "/* Generated by keywords.sh from the keyword lists in directiv.c, do not edit */"
+	print ""
+	print "static const unsigned char keyword_asso[32] = {"
+	for (l = 0; l < 32; l++)
+		printf "%s%d%s", (l % 16) ? " " : "\t", asso[l], (l == 31) ? "\n" : (l % 16 == 15) ? ",\n" : ","
+	print "};"
+	print ""
+	for (t = 1; t <= tables; t++)
+		printf "#define %s_HASH_MASK\t%d\n", toupper(table_name[t]), size[t] - 1
+	for (t = 1; t <= tables; t++) {
+		split("", by_slot)
+		for (n = 1; n <= count[t]; n++)
+			by_slot[slot(t, n)] = key_id[t, n]
+		printf "\nstatic const unsigned char %s_slot[%s_HASH_MASK + 1] = {\n", table_name[t], toupper(table_name[t])
+		sep = ""
+		for (s = 0; s < size[t]; s++)
+			if (s in by_slot) {
+				printf "%s\t[%d] = %s + 1", sep, s, by_slot[s]
+				sep = ",\n"
+			}
+		print "\n};"
+	}
+}' "${asso}" "${dir}/directiv.c" > "${out}.tmp"; then
+	rm -f "${out}.tmp"
+	exit 1
+fi
+mv "${out}.tmp" "${out}"
+
+if [ "$1" = "--check" ] && ! cmp -s "${out}" "${header}"; then
+	echo "keywords.sh: keywords.h is out of date, run make keywords" >&2
+	exit 1
+fi
+exit 0
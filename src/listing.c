@@ -0,0 +1,394 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/* The parser does not write the list file itself. It records what each
+ * source line produced (segment, address, words, source location) and
+ * list_flush() formats a batch of records into one buffer and writes it
+ * with a single fwrite(). Without -l nothing is recorded. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "avra.h"
+
+#define LIST_RECORDS	1024		/* Records per batch */
+#define LIST_BUFFER	(64 * 1024)	/* Output buffer size */
+
+enum {
+	LIST_TEXT,	/* Source text only */
+	LIST_ADDR,	/* Address and source text (.BYTE) */
+	LIST_CODE,	/* Address, one or two words and source text */
+	LIST_MACRO,	/* Address of a macro call and source text */
+	LIST_WORD,	/* Address and one data word (.DW) */
+	LIST_BYTES	/* Address and the data bytes of a .DB */
+};
+
+struct list_record {
+	unsigned char kind;	/* LIST_* */
+	unsigned char indent;	/* Columns before the text of LIST_TEXT */
+	unsigned char count;	/* Words of LIST_CODE, padding byte flag of LIST_BYTES */
+	char ident;		/* Segment */
+	long addr;
+	int words[2];
+	int text;		/* Offset of the text (or .DB bytes) in the arena, -1 if none */
+	int len;
+	int file_num;		/* Source location */
+	int line_number;
+	int macro_depth;
+};
+
+struct listing {
+	struct list_record records[LIST_RECORDS];
+	int count;
+	char *arena;		/* Source text of the records */
+	int arena_len;
+	int arena_size;
+	char out[LIST_BUFFER];
+	int out_len;
+};
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+int
+list_open(struct prog_info *pi)
+{
+	pi->listing = calloc(1, sizeof(struct listing));
+	if (!pi->listing) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	return (True);
+}
+
+static void
+out_flush(struct prog_info *pi)
+{
+	struct listing *l = pi->listing;
+
+	if (l->out_len)
+		fwrite(l->out, 1, l->out_len, pi->list_file);
+	l->out_len = 0;
+}
+
+/* Make room for n more characters of output */
+static char *
+out_reserve(struct prog_info *pi, int n)
+{
+	struct listing *l = pi->listing;
+
+	if (l->out_len + n > LIST_BUFFER) {
+		out_flush(pi);
+		if (n > LIST_BUFFER) {
+			/* Can only be an overlong source line, write it as is */
+			return (NULL);
+		}
+	}
+	return (&l->out[l->out_len]);
+}
+
+static void
+out_text(struct prog_info *pi, const char *text, int len)
+{
+	struct listing *l = pi->listing;
+	char *p = out_reserve(pi, len);
+
+	if (!p) {
+		fwrite(text, 1, len, pi->list_file);
+		return;
+	}
+	memcpy(p, text, len);
+	l->out_len += len;
+}
+
+static void
+out_char(struct prog_info *pi, char c)
+{
+	out_text(pi, &c, 1);
+}
+
+/* At least digits hex digits of value, like %0*lx */
+static void
+out_hex(struct prog_info *pi, unsigned long value, int digits, const char *hex)
+{
+	char buf[2 * sizeof(unsigned long)];
+	int n = 0;
+
+	do {
+		buf[sizeof(buf) - 1 - n++] = hex[value & 0x0f];
+		value >>= 4;
+	} while (value || (n < digits));
+	out_text(pi, &buf[sizeof(buf) - n], n);
+}
+
+static void
+out_spaces(struct prog_info *pi, int n)
+{
+	static const char spaces[] = "                ";
+
+	out_text(pi, spaces, n);
+}
+
+static void
+out_address(struct prog_info *pi, const struct list_record *r, const char *hex)
+{
+	out_char(pi, r->ident);
+	out_char(pi, ':');
+	out_hex(pi, (unsigned long)r->addr, 6, hex);
+}
+
+static void
+format_record(struct prog_info *pi, const struct list_record *r)
+{
+	const char *text = pi->listing->arena + r->text;
+	int i;
+
+	switch (r->kind) {
+	case LIST_TEXT:
+		out_spaces(pi, r->indent);
+		break;
+	case LIST_ADDR:
+		out_address(pi, r, hex_lower);
+		out_spaces(pi, 4);
+		break;
+	case LIST_CODE:
+		out_address(pi, r, hex_lower);
+		out_char(pi, ' ');
+		out_hex(pi, (unsigned int)r->words[0], 4, hex_lower);
+		if (r->count == 2) {
+			out_char(pi, ' ');
+			out_hex(pi, (unsigned int)r->words[1], 4, hex_lower);
+			out_char(pi, ' ');
+		} else
+			out_spaces(pi, 6);
+		break;
+	case LIST_MACRO:
+		out_address(pi, r, hex_lower);
+		out_text(pi, "   +  ", 6);
+		break;
+	case LIST_WORD:
+		out_address(pi, r, hex_lower);
+		out_char(pi, ' ');
+		out_hex(pi, (unsigned int)r->words[0], 4, hex_lower);
+		out_char(pi, '\n');
+		return;
+	case LIST_BYTES:
+		out_address(pi, r, hex_upper);
+		out_char(pi, ' ');
+		for (i = 0; i < r->len; i++)
+			out_hex(pi, (unsigned char)text[i], 2, hex_upper);
+		if (r->count)
+			out_text(pi, "00 ; zero byte added", 20);
+		out_char(pi, '\n');
+		return;
+	}
+	if (r->text >= 0)
+		out_text(pi, text, r->len);
+	out_char(pi, '\n');
+}
+
+/* Format and write all recorded lines */
+void
+list_flush(struct prog_info *pi)
+{
+	struct listing *l = pi->listing;
+	int i;
+
+	if (!l)
+		return;
+	for (i = 0; i < l->count; i++)
+		format_record(pi, &l->records[i]);
+	out_flush(pi);
+	l->count = 0;
+	l->arena_len = 0;
+}
+
+void
+list_close(struct prog_info *pi)
+{
+	if (!pi->listing)
+		return;
+	list_flush(pi);
+	free(pi->listing->arena);
+	free(pi->listing);
+	pi->listing = NULL;
+}
+
+/* Copy n characters into the arena. Returns their offset, or -1 */
+static int
+arena_add(struct prog_info *pi, const char *text, int n)
+{
+	struct listing *l = pi->listing;
+	char *arena;
+	int size;
+
+	if (l->arena_len + n > l->arena_size) {
+		for (size = l->arena_size ? l->arena_size : LIST_BUFFER; size < l->arena_len + n; size *= 2);
+		arena = realloc(l->arena, size);
+		if (!arena) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (-1);
+		}
+		l->arena = arena;
+		l->arena_size = size;
+	}
+	memcpy(&l->arena[l->arena_len], text, n);
+	l->arena_len += n;
+	return (l->arena_len - n);
+}
+
+static struct list_record *
+new_record(struct prog_info *pi, int kind, const struct segment_info *seg, const char *text)
+{
+	struct listing *l = pi->listing;
+	struct list_record *r;
+
+	if (l->count == LIST_RECORDS)
+		list_flush(pi);
+	r = &l->records[l->count++];
+	r->kind = kind;
+	r->indent = 0;
+	r->count = 0;
+	r->ident = seg ? seg->ident : ' ';
+	r->addr = seg ? seg->addr : 0;
+	r->len = 0;
+	r->text = -1;
+	if (text) {
+		r->len = strlen(text);
+		r->text = arena_add(pi, text, r->len);
+		if (r->text < 0)
+			r->len = 0;
+	}
+	r->file_num = pi->fi ? pi->fi->include_file->num : -1;
+	r->line_number = pi->fi ? pi->fi->line_number : 0;
+	r->macro_depth = pi->macro_call ? pi->macro_call->nest_level : 0;
+	return (r);
+}
+
+/* True if this line goes to the list file */
+static int
+listing(struct prog_info *pi)
+{
+	return ((pi->pass == PASS_2) && pi->list_on && pi->listing);
+}
+
+/* List text with indent leading spaces. The current list_line is left alone. */
+void
+list_text(struct prog_info *pi, int indent, const char *text)
+{
+	if (!listing(pi) || !text)
+		return;
+	new_record(pi, LIST_TEXT, NULL, text)->indent = indent;
+}
+
+/* List the current source line without an address */
+void
+list_source(struct prog_info *pi, int indent)
+{
+	list_text(pi, indent, pi->list_line);
+	pi->list_line = NULL;
+}
+
+/* List the current source line with the address in seg */
+void
+list_address(struct prog_info *pi, const struct segment_info *seg)
+{
+	if (listing(pi) && pi->list_line)
+		new_record(pi, LIST_ADDR, seg, pi->list_line);
+	pi->list_line = NULL;
+}
+
+/* List the current source line with the count instruction words emitted at
+ * the address in seg */
+void
+list_code(struct prog_info *pi, const struct segment_info *seg, int count, const int words[])
+{
+	struct list_record *r;
+
+	if (listing(pi) && pi->list_line) {
+		r = new_record(pi, LIST_CODE, seg, pi->list_line);
+		r->count = count;
+		r->words[0] = words[0];
+		r->words[1] = (count == 2) ? words[1] : 0;
+	}
+	pi->list_line = NULL;
+}
+
+/* List the current source line as a macro call at the address in seg */
+void
+list_macro_call(struct prog_info *pi, const struct segment_info *seg)
+{
+	if (listing(pi) && pi->list_line)
+		new_record(pi, LIST_MACRO, seg, pi->list_line);
+	pi->list_line = NULL;
+}
+
+/* List one data word at the address in seg */
+void
+list_word(struct prog_info *pi, const struct segment_info *seg, int value)
+{
+	if (listing(pi))
+		new_record(pi, LIST_WORD, seg, NULL)->words[0] = value;
+}
+
+/* Start listing the data bytes of a .DB at the address in seg. The bytes
+ * follow with list_byte(), list_bytes_end() finishes the line. */
+void
+list_bytes(struct prog_info *pi, const struct segment_info *seg)
+{
+	struct list_record *r;
+
+	if (!listing(pi))
+		return;
+	r = new_record(pi, LIST_BYTES, seg, NULL);
+	r->text = pi->listing->arena_len;
+}
+
+void
+list_byte(struct prog_info *pi, int value)
+{
+	struct listing *l = pi->listing;
+	char c = (char)value;
+
+	if (!listing(pi) || !l->count)
+		return;
+	/* A batch is only flushed between records, so the .DB record is last */
+	if (arena_add(pi, &c, 1) >= 0)
+		l->records[l->count - 1].len++;
+}
+
+void
+list_bytes_end(struct prog_info *pi, int padded)
+{
+	if (listing(pi) && pi->listing->count)
+		pi->listing->records[pi->listing->count - 1].count = padded;
+	pi->list_line = NULL;
+}
+
+/* end of listing.c */
@@ -37,6 +37,8 @@
 
 const int ML_DEFINED = 0x01;
 
+#define MAX_REPEAT_COUNT	65536	/* Iterations of one .REPT */
+
 /* Only Windows LIBC does support itoa, so we add this
    function for other systems here manually. Thank you
    Peter Hettkamp for your work. */
@@ -74,14 +76,67 @@ itoa(int num, char *str, const int number_format)
 #endif
 
 
+/* Append line, without its leading space, to the body of macro. A label
+ * ending in "%:" is added to the local labels of the macro. */
+static int
+add_macro_line(struct prog_info *pi, struct macro *macro, struct macro_line ***last_macro_line, char *line)
+{
+	int i;
+	int start;
+	struct macro_line *macro_line;
+	struct macro_label *macro_label;
+
+	i = 0; /* find start of line */
+	while (IS_HOR_SPACE(line[i]) && !IS_END_OR_COMMENT(line[i])) {
+		i++;
+	}
+	start = i;
+	/* find end of line */
+	while (!IS_END_OR_COMMENT(line[i]) && (IS_LABEL(line[i]) || line[i] == ':')) {
+		i++;
+	}
+	if (line[i-1] == ':' && (line[i-2] == '%'
+	                         && (IS_HOR_SPACE(line[i]) || IS_END_OR_COMMENT(line[i])))) {
+		if (macro->first_label) {
+			for (macro_label = macro->first_label; macro_label->next; macro_label=macro_label->next) {}
+			macro_label->next = calloc(1,sizeof(struct macro_label));
+			macro_label = macro_label->next;
+		} else {
+			macro_label = calloc(1,sizeof(struct macro_label));
+			macro->first_label = macro_label;
+		}
+		macro_label->label = malloc(strlen(&line[start])+1);
+		line[i-1] = '\0';
+		strcpy(macro_label->label, &line[start]);
+		line[i-1] = ':';
+		macro_label->running_number = 0;
+		macro_label->flags |= ML_DEFINED;
+		STAT_ALLOC(pi, 2, sizeof(struct macro_label) + strlen(macro_label->label) + 1);
+	}
+
+	macro_line = calloc(1, sizeof(struct macro_line));
+	if (!macro_line) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	**last_macro_line = macro_line;
+	*last_macro_line = &macro_line->next;
+	macro_line->line = malloc(strlen(line) + 1);
+	if (!macro_line->line) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(macro_line->line, &line[start]);
+	STAT_ALLOC(pi, 2, sizeof(struct macro_line) + strlen(line) + 1);
+	return (True);
+}
+
 int
 read_macro(struct prog_info *pi, char *name)
 {
 	int loopok;
 	int i;
-	int start;
 	struct macro *macro;
-	struct macro_line *macro_line;
 	struct macro_line **last_macro_line = NULL;
 	struct macro_label *macro_label;
 
@@ -105,9 +160,10 @@ read_macro(struct prog_info *pi, char *name)
 			return (False);
 		}
 
-		if (pi->last_macro)
+		if (pi->last_macro) {
 			pi->last_macro->next = macro;
-		else
+			macro->num = pi->last_macro->num + 1;
+		} else
 			pi->first_macro = macro;
 		pi->last_macro = macro;
 		macro->name = malloc(strlen(name) + 1);
@@ -116,17 +172,15 @@ read_macro(struct prog_info *pi, char *name)
 			return (False);
 		}
 		strcpy(macro->name, name);
+		STAT_ALLOC(pi, 2, sizeof(struct macro) + strlen(name) + 1);
 		macro->include_file = pi->fi->include_file;
 		macro->first_line_number = pi->fi->line_number;
 		last_macro_line = &macro->first_macro_line;
 	} else { /* pi->pass == PASS_2 */
-		if (pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
-		}
+		list_source(pi, LIST_INDENT);
 		/* reset macro label running numbers */
 		get_next_token(name, TERM_END);
-		macro = get_macro(pi, name);
+		macro = get_macro(pi, name, strlen(name));
 		if (!macro) {
 			print_msg(pi, MSGTYPE_ERROR, "macro inconsistency in '%s'", name);
 			return (True);
@@ -151,53 +205,10 @@ read_macro(struct prog_info *pi, char *name)
 					loopok = False;
 			}
 			if (pi->pass == PASS_1) {
-				if (loopok) {
-					i = 0; /* find start of line */
-					while (IS_HOR_SPACE(pi->fi->buff[i]) && !IS_END_OR_COMMENT(pi->fi->buff[i])) {
-						i++;
-					}
-					start = i;
-					/* find end of line */
-					while (!IS_END_OR_COMMENT(pi->fi->buff[i]) && (IS_LABEL(pi->fi->buff[i]) || pi->fi->buff[i] == ':')) {
-						i++;
-					}
-					if (pi->fi->buff[i-1] == ':' && (pi->fi->buff[i-2] == '%'
-					                                 && (IS_HOR_SPACE(pi->fi->buff[i]) || IS_END_OR_COMMENT(pi->fi->buff[i])))) {
-						if (macro->first_label) {
-							for (macro_label = macro->first_label; macro_label->next; macro_label=macro_label->next) {}
-							macro_label->next = calloc(1,sizeof(struct macro_label));
-							macro_label = macro_label->next;
-						} else {
-							macro_label = calloc(1,sizeof(struct macro_label));
-							macro->first_label = macro_label;
-						}
-						macro_label->label = malloc(strlen(&pi->fi->buff[start])+1);
-						pi->fi->buff[i-1] = '\0';
-						strcpy(macro_label->label, &pi->fi->buff[start]);
-						pi->fi->buff[i-1] = ':';
-						macro_label->running_number = 0;
-						macro_label->flags |= ML_DEFINED;
-					}
-
-					macro_line = calloc(1, sizeof(struct macro_line));
-					if (!macro_line) {
-						print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-						return (False);
-					}
-					*last_macro_line = macro_line;
-					last_macro_line = &macro_line->next;
-					macro_line->line = malloc(strlen(pi->fi->buff) + 1);
-					if (!macro_line->line) {
-						print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-						return (False);
-					}
-					strcpy(macro_line->line, &pi->fi->buff[start]);
-				}
-			} else if (pi->fi->buff && pi->list_file && pi->list_on) {
-				if (pi->fi->buff[i] == ';')
-					fprintf(pi->list_file, "         %s\n", pi->fi->buff);
-				else
-					fprintf(pi->list_file, "          %s\n", pi->fi->buff);
+				if (loopok && !add_macro_line(pi, macro, &last_macro_line, pi->fi->buff))
+					return (False);
+			} else {
+				list_text(pi, (pi->fi->buff[i] == ';') ? LIST_INDENT_SHORT : LIST_INDENT, pi->fi->buff);
 			}
 		} else {
 			if (feof(pi->fi->fp)) {
@@ -213,12 +224,12 @@ read_macro(struct prog_info *pi, char *name)
 }
 
 
-struct macro *get_macro(struct prog_info *pi, char *name)
+struct macro *get_macro(struct prog_info *pi, const char *name, int len)
 {
 	struct macro *macro;
 
 	for (macro = pi->first_macro; macro; macro = macro->next)
-		if (!nocase_strcmp(macro->name, name))
+		if (!nocase_strcmp_n(macro->name, name, len))
 			return (macro);
 	return (NULL);
 }
@@ -227,7 +238,6 @@ void
 append_type(struct prog_info *pi, char *name, int c, char *value)
 {
 	int p, l;
-	struct def *def;
 
 	p = strlen(name);
 	name[p++] = '_';
@@ -244,35 +254,385 @@ append_type(struct prog_info *pi, char *name, int c, char *value)
 		return;
 	}
 
-
-	for (def = pi->first_def; def; def = def->next)
-		if (!nocase_strcmp(def->name, value)) {
-			itoa((c*8),&name[p],10);
-			return;
-		}
+	if (get_def(pi, value, l)) {
+		itoa((c*8),&name[p],10);
+		return;
+	}
 
 	name[p++] = 'i';
 	name[p] = '\0';
 }
 
 
+/* A macro call or repetition being expanded. The arguments are slices of
+ * the calling line, which stays in the buffer of the frame below (or of the
+ * file) until this frame is popped. */
+struct macro_frame {
+	struct macro *macro;		/* Macro, or the body of a repetition */
+	struct macro_call *macro_call;
+	struct macro_line *old_macro_line;	/* Line of the caller to resume */
+	struct token macro_args[MAX_MACRO_ARGS];
+	int macro_arg_count;
+	char *line;			/* Copy of extended [...] arguments or .IRP items */
+	struct token *items;		/* .IRP/.IRPC values of @0, or NULL */
+	int count;			/* Iterations of a repetition, 0 for a macro call */
+	int iteration;
+	int started;
+	double traced;
+	char buff[LINEBUFFER_LENGTH];	/* Current line with arguments replaced */
+};
+
+/* Frame for the next call, allocated once and reused. Frames never move
+ * since the arguments of a call point into the buffer of its caller. */
+static struct macro_frame *
+get_frame(struct prog_info *pi)
+{
+	struct macro_frame **frames;
+	int size;
+
+	if (pi->macro_depth == pi->macro_frames_size) {
+		size = pi->macro_frames_size ? (pi->macro_frames_size * 2) : 16;
+		frames = realloc(pi->macro_frames, size * sizeof(struct macro_frame *));
+		if (!frames) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (NULL);
+		}
+		memset(&frames[pi->macro_frames_size], 0, (size - pi->macro_frames_size) * sizeof(struct macro_frame *));
+		pi->macro_frames = frames;
+		pi->macro_frames_size = size;
+	}
+	if (!pi->macro_frames[pi->macro_depth]) {
+		pi->macro_frames[pi->macro_depth] = malloc(sizeof(struct macro_frame));
+		if (!pi->macro_frames[pi->macro_depth]) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (NULL);
+		}
+	}
+	return (pi->macro_frames[pi->macro_depth]);
+}
+
+/* True if macro_call is the pass 1 record of the call at the current line */
+static int
+is_macro_call(struct prog_info *pi, const struct macro_call *macro_call, int iteration)
+{
+	if ((macro_call->include_file->num != pi->fi->include_file->num)
+	        || (macro_call->line_number != pi->fi->line_number)
+	        || (macro_call->iteration != iteration)
+	        || (macro_call->prev_on_stack != pi->macro_call))
+		return (False);
+	/* Find correct macro_call when using recursion and nesting */
+	return (!pi->macro_call
+	        || ((macro_call->nest_level == (pi->macro_call->nest_level + 1))
+	            && (macro_call->prev_line_index == pi->macro_call->line_index)));
+}
+
+/* Pass 2 replays the calls in pass 1 order, so the record is usually the
+ * one after the last found. Otherwise all records are searched. */
+static struct macro_call *
+find_macro_call(struct prog_info *pi, int iteration)
+{
+	struct macro_call *macro_call = pi->next_macro_call;
+
+	if (!macro_call || !is_macro_call(pi, macro_call, iteration)) {
+		for (macro_call = pi->first_macro_call; macro_call; macro_call = macro_call->next)
+			if (is_macro_call(pi, macro_call, iteration))
+				break;
+		if (!macro_call) {
+			print_msg(pi, MSGTYPE_ERROR, "Internal assembler error");
+			return (NULL);
+		}
+	}
+	pi->next_macro_call = macro_call->next;
+	return (macro_call);
+}
+
+/* Make frame f run macro (or iteration f->iteration of a repetition) as
+ * the callee of pi->macro_call. The record of the call is made in pass 1
+ * and found again in pass 2, where labels defined by the call are kept. */
+static int
+start_call(struct prog_info *pi, struct macro_frame *f, struct macro *macro)
+{
+	struct 	macro_call *macro_call;
+	struct	macro_label *macro_label;
+
+	if (pi->pass == PASS_1) {
+		macro_call = calloc(1, sizeof(struct macro_call));
+		if (!macro_call) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		STAT_ALLOC(pi, 1, sizeof(struct macro_call));
+		if (pi->last_macro_call)
+			pi->last_macro_call->next = macro_call;
+		else
+			pi->first_macro_call = macro_call;
+
+		pi->last_macro_call = macro_call;
+		macro_call->line_number = pi->fi->line_number;
+		macro_call->include_file = pi->fi->include_file;
+		macro_call->iteration = f->iteration;
+		macro_call->prev_on_stack = pi->macro_call;
+
+		if (macro_call->prev_on_stack) {
+			macro_call->nest_level = macro_call->prev_on_stack->nest_level + 1;
+			macro_call->prev_line_index = macro_call->prev_on_stack->line_index;
+		}
+	} else {
+		macro_call = find_macro_call(pi, f->iteration);
+		if (!macro_call)
+			return (False);
+	}
+	macro_call->macro = macro;	/* A repetition body is read again in pass 2 */
+	macro_call->line_index = 0;
+	pi->macro_call = macro_call;
+
+	f->macro = macro;
+	f->macro_call = macro_call;
+	f->started = False;
+	if (f->items)
+		f->macro_args[0] = f->items[f->iteration];
+	for (macro_label = macro->first_label; macro_label; macro_label = macro_label->next) {
+		/* mark all local flags as not yet defined */
+		macro_label->flags &= ~ML_DEFINED;
+	}
+	return (True);
+}
+
+static void
+free_body(struct macro *macro)
+{
+	struct macro_line *macro_line, *next_line;
+	struct macro_label *macro_label, *next_label;
+
+	for (macro_line = macro->first_macro_line; macro_line; macro_line = next_line) {
+		next_line = macro_line->next;
+		free(macro_line->line);
+		free(macro_line);
+	}
+	for (macro_label = macro->first_label; macro_label; macro_label = next_label) {
+		next_label = macro_label->next;
+		free(macro_label->label);
+		free(macro_label);
+	}
+	free(macro);
+}
+
+static void
+pop_frame(struct prog_info *pi)
+{
+	struct macro_frame *f = pi->macro_frames[--pi->macro_depth];
+
+	if (f->count) {
+		free_body(f->macro);
+		free(f->items);
+		f->items = NULL;
+	} else {
+		TRACE_MACRO(pi, f->macro->name, f->traced);
+		PROFILE_EXIT(pi);
+	}
+	if (pi->list_line == f->buff)
+		pi->list_line = NULL;
+	pi->macro_line = f->old_macro_line;
+	pi->macro_call = f->macro_call->prev_on_stack;
+	free(f->line);
+	f->line = NULL;
+}
+
+void
+free_macro_frames(struct prog_info *pi)
+{
+	int i;
+
+	for (i = 0; i < pi->macro_frames_size; i++)
+		free(pi->macro_frames[i]);
+	free(pi->macro_frames);
+	pi->macro_frames = NULL;
+	pi->macro_frames_size = 0;
+	pi->macro_depth = 0;
+}
+
+/* Copy line to buff (of size bytes) up to a comment, replacing the @n
+ * placeholders with the arguments of frame f */
+static int
+replace_args(struct prog_info *pi, const struct macro_frame *f, const char *line, char *buff, int size)
+{
+	int	i;
+	/* Optimized: use direct pointer arithmetic instead of strcat/strncat to avoid O(n²) behavior */
+	char *buff_ptr = buff;
+	char *buff_end = buff + size - 2;	/* Room for '\n' and '\0' */
+
+	for (i = 0; line[i] != '\0'; i++) {
+		/* check for register place holders */
+		if (line[i] == '@') {
+			i++;
+			if (!isdigit(line[i]))
+				print_msg(pi, MSGTYPE_ERROR, "@ must be followed by a number");
+			else if ((line[i] - '0') >= f->macro_arg_count)
+				print_msg(pi, MSGTYPE_ERROR, "Missing macro argument (for @%c)", line[i]);
+			else {
+				/* and replace them with given registers */
+				const struct token *arg = &f->macro_args[line[i] - '0'];
+				if (arg->len > buff_end - buff_ptr)
+					break;
+				memcpy(buff_ptr, arg->start, arg->len);
+				buff_ptr += arg->len;
+			}
+		} else if (line[i] == ';') {
+			*buff_ptr++ = '\n';
+			break;
+		} else if (buff_ptr == buff_end) {
+			break;
+		} else {
+			*buff_ptr++ = line[i];
+		}
+	}
+	*buff_ptr = '\0';  /* Ensure null termination */
+	if ((line[i] != '\0') && (line[i] != ';')) {
+		print_msg(pi, MSGTYPE_ERROR, "Macro line too long after argument substitution");
+		return (False);
+	}
+	return (True);
+}
+
+/* Copy the current macro line into the buffer of frame f, numbering the
+ * local labels and replacing the @n placeholders with the arguments. */
+static int
+substitute_line(struct prog_info *pi, struct macro_frame *f)
+{
+	int 	c, i = 0;
+	char  tmp[7];
+	char	*temp;
+	char	*buff = f->buff;
+	struct	macro_label *macro_label;
+
+	/* here we change jumps/calls within macro that corresponds to macro labels.
+	 * Only in case there is an entry in macro_label list */
+
+	strcpy(buff,"\0");
+	/* Optimized: use function that returns position to avoid redundant strstr() calls */
+	macro_label = get_macro_label_with_pos(pi->macro_line->line, f->macro, &temp);
+	if (macro_label)	{
+		/* test if the right macro label has been found */
+		c = strlen(macro_label->label);
+		if (temp[c] == ':') { /* it is a label definition */
+			macro_label->running_number++;
+			macro_label->flags |= ML_DEFINED;
+			strncpy(buff, macro_label->label, c - 1);
+			buff[c - 1] = 0;
+			i = strlen(buff) + 2; /* we set the process indeafter label */
+			/* add running number to it */
+			strcpy(&buff[c-1],itoa(macro_label->running_number, tmp, 10));
+			strcat(buff, ":\0");
+		} else if (IS_HOR_SPACE(temp[c]) || IS_END_OR_COMMENT(temp[c]))	{ /* it is a jump to a macro defined label */
+			int target_number = macro_label->running_number;
+			if ((macro_label->flags & ML_DEFINED) == 0)
+				/* Allow forward reference if label is not yet defined */
+				target_number++;
+			strcpy(buff,pi->macro_line->line);
+			/* Reuse offset to find position in buff without redundant strstr() */
+			char *label_offset = temp;
+			temp = buff + (label_offset - pi->macro_line->line);
+			i = temp - buff + strlen(macro_label->label);
+			strncpy(temp, macro_label->label, c - 1);
+			strcpy(&temp[c-1], itoa(target_number, tmp, 10));
+		}
+	}
+
+	/* here we check every character of current line */
+	return (replace_args(pi, f, &pi->macro_line->line[i], &buff[i], LINEBUFFER_LENGTH - i));
+}
+
+/* Assemble the lines of the macro calls on the stack above base. A macro
+ * call in one of the lines only pushes its frame, which then runs here
+ * instead of in a nested call, so deep nesting costs no C stack. */
+static int
+run_macros(struct prog_info *pi, int base)
+{
+	int ok = True;
+	struct macro_frame *f;
+
+	while (pi->macro_depth > base) {
+		f = pi->macro_frames[pi->macro_depth - 1];
+		if (!ok) {
+			pop_frame(pi);
+			continue;
+		}
+		if (!f->started) {
+			f->started = True;
+			pi->macro_line = f->macro->first_macro_line;
+		} else if (pi->macro_line)
+			pi->macro_line = pi->macro_line->next;
+		if (!pi->macro_line) {
+			if (++f->iteration < f->count) {
+				pi->macro_call = f->macro_call->prev_on_stack;
+				ok = start_call(pi, f, f->macro);
+			} else
+				pop_frame(pi);
+			continue;
+		}
+
+		f->macro_call->line_index++;
+		if (GET_ARG_I(pi->args, ARG_LISTMAC))
+			pi->list_line = f->buff;
+		else
+			pi->list_line = NULL;
+		if (!substitute_line(pi, f)) {
+			ok = False;
+			continue;
+		}
+
+		pi->defer_expansion = True;
+		ok = parse_line(pi, f->buff);
+		pi->defer_expansion = False;
+		if (ok) {
+			list_source(pi, LIST_INDENT_SHORT);
+			if (pi->error_count >= pi->max_errors) {
+				print_msg(pi, MSGTYPE_MESSAGE, "Maximum error count reached. Exiting...");
+				ok = False;
+			}
+		}
+	}
+	return (ok);
+}
+
 /* Replace the macro call with mnemonics.  */
 int
-expand_macro(struct prog_info *pi, struct macro *macro, char *rest_line)
+expand_macro(struct prog_info *pi, struct macro *macro, const char *rest_line)
 {
-	int 	ok = True, macro_arg_count = 0, off, a, b = 0, c, i = 0, j = 0;
+	int 	macro_arg_count = 0, off, a, b = 0, c;
+	int	deferred = pi->defer_expansion;
 	char 	*line = NULL;
 	char  *temp;
-	char  *macro_args[MAX_MACRO_ARGS];
-	char  tmp[7];
-	char 	buff[LINEBUFFER_LENGTH];
+	const char *next;
+	struct token *macro_args;
 	char	arg = False;
 	char	*nmn; /* string buffer for 'n'ew 'm'acro 'n'ame */
-	struct 	macro_line *old_macro_line;
-	struct 	macro_call *macro_call;
-	struct	macro_label *macro_label;
+	struct 	macro_frame *f;
+
+	pi->defer_expansion = False;
+	STAT_COUNT(pi, macro_expansions[pi->pass]);
 
-	if (rest_line) {
+	if (pi->macro_depth >= pi->max_macro_depth) {
+		print_msg(pi, MSGTYPE_ERROR, "Macro %s nested more than %d levels deep (see --max_macro_depth)",
+		          macro->name, pi->max_macro_depth);
+		return (False);
+	}
+	f = get_frame(pi);
+	if (!f)
+		return (False);
+	macro_args = f->macro_args;
+
+	/*  here we split up the macro arguments into "macro_args".
+	 *  Plain arguments are slices of rest_line. */
+	if (rest_line && (rest_line[0] != '[')) {
+		for (next = rest_line; next; macro_arg_count++) {
+			if (macro_arg_count == MAX_MACRO_ARGS) {
+				print_msg(pi, MSGTYPE_ERROR, "Too many macro arguments (max %d)", MAX_MACRO_ARGS);
+				return (True);
+			}
+			next = get_operand(next, &macro_args[macro_arg_count]);
+		}
+	} else if (rest_line) {
 		/* we reserve some extra space for extended macro parameters */
 		line = malloc(strlen(rest_line) + 20);
 		if (!line) {
@@ -308,229 +668,330 @@ expand_macro(struct prog_info *pi, struct macro *macro, char *rest_line)
 		strcpy(&line[b],"\n"); /* set CR/LF at the end of the line */
 
 
-		/*  here we split up the macro arguments into "macro_args"
-		 *  Extended macro code interpreter added by TW 2002 */
+		/*  Extended macro code interpreter added by TW 2002.
+		 *  It works on its own copy of the line. */
 
 		temp = line;
 		/* test for advanced parameters */
-		if (temp[0] == '[') {  /* there must be "[" " then "]", else it is garbage */
-			if (!strchr(temp, ']')) {
-				print_msg(pi, MSGTYPE_ERROR, "found no closing ']'");
-				return (False);
-			}
+		if (!strchr(temp, ']')) {  /* there must be "[" " then "]", else it is garbage */
+			print_msg(pi, MSGTYPE_ERROR, "found no closing ']'");
+			free(line);
+			return (False);
+		}
 
-			/* Okay now we are within the advanced code interpreter */
+		/* Okay now we are within the advanced code interpreter */
 
-			temp++; /* skip the first bracket */
-			nmn = malloc(LINEBUFFER_LENGTH);
-			if (!nmn) {
-				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-				return (False);
-			}
-			strcpy(nmn,macro->name); /* create a new macro name buffer */
-			c = 1; /* byte counter */
-			arg = True; /* loop flag */
+		temp++; /* skip the first bracket */
+		nmn = malloc(LINEBUFFER_LENGTH);
+		if (!nmn) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			free(line);
+			return (False);
+		}
+		strcpy(nmn,macro->name); /* create a new macro name buffer */
+		c = 1; /* byte counter */
+		arg = True; /* loop flag */
 
-			while (arg) {
-				while (IS_HOR_SPACE(temp[0])) { /* skip leading spaces */
-					temp++;
+		while (arg) {
+			while (IS_HOR_SPACE(temp[0])) { /* skip leading spaces */
+				temp++;
+			}
+			off = 0; /* pointer offset */
+			do {
+				if ((macro_arg_count == MAX_MACRO_ARGS) && ((temp[off] == ':') || (temp[off] == ',') || (temp[off] == ']'))) {
+					print_msg(pi, MSGTYPE_ERROR, "Too many macro arguments (max %d)", MAX_MACRO_ARGS);
+					free(nmn);
+					free(line);
+					return (True);
 				}
-				off = 0; /* pointer offset */
-				do {
-					switch (temp[off]) { /* test current character code */
-					case ':':
-						temp[off] = '\0';
-						if (off > 0) {
-							c++;
-							macro_args[macro_arg_count++] = temp;
-						} else {
-							print_msg(pi, MSGTYPE_ERROR, "missing register before ':'",nmn);
-							return (False);
-						}
-						break;
-					case ']':
-						arg = False;
-					case ',':
-						a = off;
-						do temp[a--] = '\0';
-						while (IS_HOR_SPACE(temp[a]));
-						if (off > 0) {
-							macro_args[macro_arg_count++] = temp;
-							append_type(pi, nmn, c, temp);
-							c = 1;
-						} else {
-							append_type(pi, nmn, 0, temp);
-							c = 1;
-						}
-						break;
-
-					default:
-						off++;
+				switch (temp[off]) { /* test current character code */
+				case ':':
+					temp[off] = '\0';
+					if (off > 0) {
+						c++;
+						macro_args[macro_arg_count].start = temp;
+						macro_args[macro_arg_count++].len = off;
+					} else {
+						print_msg(pi, MSGTYPE_ERROR, "missing register before ':'",nmn);
+						free(nmn);
+						free(line);
+						return (False);
+					}
+					break;
+				case ']':
+					arg = False;
+					[[fallthrough]];
+				case ',':
+					a = off;
+					do temp[a--] = '\0';
+					while (IS_HOR_SPACE(temp[a]));
+					if (off > 0) {
+						macro_args[macro_arg_count].start = temp;
+						macro_args[macro_arg_count++].len = strlen(temp);
+						append_type(pi, nmn, c, temp);
+						c = 1;
+					} else {
+						append_type(pi, nmn, 0, temp);
+						c = 1;
 					}
-				} while (temp[off] != '\0');
+					break;
 
-				if (arg) temp = &temp[off+1];
-				else break;
-			}
+				default:
+					off++;
+				}
+			} while (temp[off] != '\0');
 
-			macro = get_macro(pi,nmn);
-			if (macro == NULL) {
-				print_msg(pi, MSGTYPE_ERROR, "Macro %s is not defined !",nmn);
-				return (False);
-			}
+			if (arg) temp = &temp[off+1];
+			else break;
+		}
+
+		macro = get_macro(pi, nmn, strlen(nmn));
+		if (macro == NULL) {
+			print_msg(pi, MSGTYPE_ERROR, "Macro %s is not defined !",nmn);
 			free(nmn);
+			free(line);
+			return (False);
 		}
-		/* or else, we handle the macro as normal macro */
-		else {
-			line = malloc(strlen(rest_line) + 1);
-			if (!line) {
-				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-				return (False);
+		free(nmn);
+	}
+
+	if (pi->pass == PASS_2)
+		list_macro_call(pi, pi->cseg);
+	f->macro_arg_count = macro_arg_count;
+	f->line = line;
+	f->items = NULL;
+	f->count = 0;
+	f->iteration = 0;
+	f->old_macro_line = pi->macro_line;
+	if (!start_call(pi, f, macro)) {
+		free(line);
+		return (False);
+	}
+	pi->macro_depth++;
+	PROFILE_ENTER(pi, PROFILE_MACRO, macro->num);
+	f->traced = TRACE_CLOCK(pi);
+
+	if (deferred)
+		return (True);
+	return (run_macros(pi, pi->macro_depth - 1));
+}
+
+/* True if line starts with the directive keyword */
+static int
+is_directive(const char *line, const char *keyword)
+{
+	struct token tok;
+
+	get_token(line, &tok);
+	return ((tok.kind == TOKEN_DIRECTIVE) && !nocase_strcmp_n(keyword, tok.start + 1, tok.len - 1));
+}
+
+/* Copy line to buff with every word equal to the len characters at name
+ * replaced by @0 */
+static int
+replace_name(struct prog_info *pi, const char *line, const char *name, int len, char *buff)
+{
+	int i, j = 0, k;
+
+	for (i = 0; line[i] != '\0'; ) {
+		if (IS_LABEL(line[i]) && ((i == 0) || !IS_LABEL(line[i - 1]))) {
+			for (k = i; IS_LABEL(line[k]); k++);
+			if ((k - i == len) && !nocase_strncmp(&line[i], name, len)) {
+				if (j + 2 >= LINEBUFFER_LENGTH)
+					break;
+				buff[j++] = '@';
+				buff[j++] = '0';
+				i = k;
+				continue;
 			}
-			strcpy(line, rest_line);
-			temp = line;
-			while (temp) {
-				macro_args[macro_arg_count++] = temp;
-				temp = get_next_token(temp, TERM_COMMA);
+			while (i < k) {
+				if (j + 1 >= LINEBUFFER_LENGTH)
+					break;
+				buff[j++] = line[i++];
 			}
-		}
+			if (i < k)
+				break;
+		} else if (j + 1 >= LINEBUFFER_LENGTH) {
+			break;
+		} else
+			buff[j++] = line[i++];
 	}
+	buff[j] = '\0';
+	if (line[i] != '\0') {
+		print_msg(pi, MSGTYPE_ERROR, "Line too long after replacing %.*s", len, name);
+		return (False);
+	}
+	return (True);
+}
 
-	if (pi->pass == PASS_1) {
-		macro_call = calloc(1, sizeof(struct macro_call));
-		if (!macro_call) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-			return (False);
-		}
-		if (pi->last_macro_call)
-			pi->last_macro_call->next = macro_call;
-		else
-			pi->first_macro_call = macro_call;
-
-		pi->last_macro_call = macro_call;
-		macro_call->line_number = pi->fi->line_number;
-		macro_call->include_file = pi->fi->include_file;
-		macro_call->macro = macro;
-		macro_call->prev_on_stack = pi->macro_call;
+/* Read the lines up to the .ENDR that closes a repetition into the body of
+ * macro, from the macro being expanded or from the source file. Arguments
+ * of the macro are replaced, and for .IRP/.IRPC the symbol by @0. */
+static int
+read_repeat_body(struct prog_info *pi, struct macro *macro, const char *name, int len)
+{
+	int depth = 0;
+	char *line;
+	char buff[LINEBUFFER_LENGTH], replaced[LINEBUFFER_LENGTH];
+	struct macro_line **last_macro_line = &macro->first_macro_line;
+	const struct macro_frame *caller = NULL;
 
-		if (macro_call->prev_on_stack) {
-			macro_call->nest_level = macro_call->prev_on_stack->nest_level + 1;
-			macro_call->prev_line_index = macro_call->prev_on_stack->line_index;
-		}
-	} else {
-		for (macro_call = pi->first_macro_call; macro_call; macro_call = macro_call->next) {
-			if ((macro_call->include_file->num == pi->fi->include_file->num) && (macro_call->line_number == pi->fi->line_number)) {
-				if (pi->macro_call) {
-					/* Find correct macro_call when using recursion and nesting */
-					if (macro_call->prev_on_stack == pi->macro_call)
-						if ((macro_call->nest_level == (pi->macro_call->nest_level + 1)) && (macro_call->prev_line_index == pi->macro_call->line_index))
-							break;
-				} else break;
+	if (pi->macro_line)
+		caller = pi->macro_frames[pi->macro_depth - 1];
+	for (;;) {
+		if (caller) {
+			pi->macro_line = pi->macro_line->next;
+			if (!pi->macro_line) {
+				print_msg(pi, MSGTYPE_ERROR, "Found no closing .ENDR in macro");
+				return (False);
 			}
+			pi->macro_call->line_index++;
+			if (!replace_args(pi, caller, pi->macro_line->line, buff, LINEBUFFER_LENGTH))
+				return (False);
+			line = buff;
+		} else {
+			if (!fgets_new(pi, pi->fi->buff, LINEBUFFER_LENGTH, pi->fi->fp)) {
+				if (feof(pi->fi->fp))
+					print_msg(pi, MSGTYPE_ERROR, "Found no closing .ENDR");
+				else
+					perror(pi->fi->include_file->name);
+				return (False);
+			}
+			pi->fi->line_number++;
+			line = pi->fi->buff;
+			list_text(pi, LIST_INDENT, line);
 		}
-		if (pi->list_line && pi->list_on) {
-			fprintf(pi->list_file, "%c:%06lx   +  %s\n",
-			        pi->cseg->ident, pi->cseg->addr, pi->list_line);
-			pi->list_line = NULL;
+		if (is_directive(line, "ENDR")) {
+			if (depth-- == 0)
+				return (True);
+		} else if (is_directive(line, "REPT") || is_directive(line, "IRP") || is_directive(line, "IRPC"))
+			depth++;
+		if (name) {
+			if (!replace_name(pi, line, name, len, replaced))
+				return (False);
+			line = replaced;
 		}
+		if (!add_macro_line(pi, macro, &last_macro_line, line))
+			return (False);
 	}
+}
 
-	macro_call->line_index = 0;
-	pi->macro_call = macro_call;
-	old_macro_line = pi->macro_line;
+/* .REPT count, .IRP symbol, values... and .IRPC symbol, characters: read
+ * the body once and push a frame that runs it for each iteration, with @0
+ * (the symbol) set to the next value. */
+int
+read_repeat(struct prog_info *pi, int kind, char *next)
+{
+	int	deferred = pi->defer_expansion;
+	int	count = 0, len = 0, i, errors;
+	const char *name = NULL, *data;
+	struct	token tok;
+	struct	macro *macro;
+	struct	macro_frame *f;
 
-	for (macro_label = macro->first_label; macro_label; macro_label = macro_label->next) {
-		/* mark all local flags as not yet defined */
-		macro_label->flags &= ~ML_DEFINED;
+	pi->defer_expansion = False;
+	if (pi->pass == PASS_2)
+		list_macro_call(pi, pi->cseg);
+	else
+		list_source(pi, LIST_INDENT);
+	if (pi->macro_depth >= pi->max_macro_depth) {
+		print_msg(pi, MSGTYPE_ERROR, "Repetition nested more than %d levels deep (see --max_macro_depth)",
+		          pi->max_macro_depth);
+		return (False);
 	}
+	f = get_frame(pi);
+	if (!f)
+		return (False);
+	f->line = NULL;
+	f->items = NULL;
 
-	for (pi->macro_line = macro->first_macro_line; pi->macro_line && ok; pi->macro_line = pi->macro_line->next) {
-		macro_call->line_index++;
-		if (GET_ARG_I(pi->args, ARG_LISTMAC))
-			pi->list_line = buff;
-		else
-			pi->list_line = NULL;
-
-		/* here we change jumps/calls within macro that corresponds to macro labels.
-		 * Only in case there is an entry in macro_label list */
-
-		strcpy(buff,"\0");
-		/* Optimized: use function that returns position to avoid redundant strstr() calls */
-		macro_label = get_macro_label_with_pos(pi->macro_line->line, macro, &temp);
-		if (macro_label)	{
-			/* test if the right macro label has been found */
-			c = strlen(macro_label->label);
-			if (temp[c] == ':') { /* it is a label definition */
-				macro_label->running_number++;
-				macro_label->flags |= ML_DEFINED;
-				strncpy(buff, macro_label->label, c - 1);
-				buff[c - 1] = 0;
-				i = strlen(buff) + 2; /* we set the process indeafter label */
-				/* add running number to it */
-				strcpy(&buff[c-1],itoa(macro_label->running_number, tmp, 10));
-				strcat(buff, ":\0");
-			} else if (IS_HOR_SPACE(temp[c]) || IS_END_OR_COMMENT(temp[c]))	{ /* it is a jump to a macro defined label */
-				int target_number = macro_label->running_number;
-				if ((macro_label->flags & ML_DEFINED) == 0)
-					/* Allow forward reference if label is not yet defined */
-					target_number++;
-				strcpy(buff,pi->macro_line->line);
-				/* Reuse offset to find position in buff without redundant strstr() */
-				char *label_offset = temp;
-				temp = buff + (label_offset - pi->macro_line->line);
-				i = temp - buff + strlen(macro_label->label);
-				strncpy(temp, macro_label->label, c - 1);
-				strcpy(&temp[c-1], itoa(target_number, tmp, 10));
-			}
-		} else {
-			i = 0;
+	if (!next) {
+		print_msg(pi, MSGTYPE_ERROR, "%s needs an operand", (kind == REPEAT_REPT) ? ".REPT" : ".IRP");
+	} else if (kind == REPEAT_REPT) {
+		get_next_token(next, TERM_END);
+		/* An undefined symbol is reported, but may leave count unset */
+		errors = pi->error_count;
+		if (!get_expr(pi, next, &count))
+			return (False);
+		if (pi->error_count > errors) {
+			count = 0;
+		} else if (count < 0) {
+			print_msg(pi, MSGTYPE_ERROR, ".REPT count must be nonnegative");
+			count = 0;
+		} else if (count > MAX_REPEAT_COUNT) {
+			print_msg(pi, MSGTYPE_ERROR, ".REPT count %d is above %d", count, MAX_REPEAT_COUNT);
+			count = 0;
 		}
-
-		/* here we check every character of current line */
-		/* Optimized: use direct pointer arithmetic instead of strcat/strncat to avoid O(n²) behavior */
-		char *buff_ptr = &buff[i];
-		for (j = i; pi->macro_line->line[i] != '\0'; i++) {
-			/* check for register place holders */
-			if (pi->macro_line->line[i] == '@') {
-				i++;
-				if (!isdigit(pi->macro_line->line[i]))
-					print_msg(pi, MSGTYPE_ERROR, "@ must be followed by a number");
-				else if ((pi->macro_line->line[i] - '0') >= macro_arg_count)
-					print_msg(pi, MSGTYPE_ERROR, "Missing macro argument (for @%c)", pi->macro_line->line[i]);
-				else {
-					/* and replace them with given registers */
-					const char *arg = macro_args[pi->macro_line->line[i] - '0'];
-					size_t arg_len = strlen(arg);
-					memcpy(buff_ptr, arg, arg_len);
-					buff_ptr += arg_len;
-				}
-			} else if (pi->macro_line->line[i] == ';') {
-				*buff_ptr++ = '\n';
-				*buff_ptr = '\0';
-				break;
+	} else {
+		data = get_operand(next, &tok);
+		name = tok.start;
+		for (len = 0; (len < tok.len) && IS_LABEL(name[len]); len++);
+		if (!len || (len != tok.len)) {
+			print_msg(pi, MSGTYPE_ERROR, "Illegal symbol name '%.*s'", tok.len, tok.start);
+			len = 0;
+		} else if (data) {
+			/* The values are referenced by @0 until the frame is popped */
+			f->line = malloc_strcpy(data);
+			f->items = malloc((strlen(data) + 1) * sizeof(struct token));
+			if (!f->line || !f->items) {
+				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+				free(f->line);
+				free(f->items);
+				return (False);
+			}
+			if (kind == REPEAT_IRP) {
+				for (data = f->line; data; count++)
+					data = get_operand(data, &f->items[count]);
 			} else {
-				*buff_ptr++ = pi->macro_line->line[i];
+				get_operand(f->line, &tok);
+				if ((tok.kind == TOKEN_STRING) && (tok.len >= 2)) {
+					tok.start++;
+					tok.len -= 2;
+				}
+				for (i = 0; i < tok.len; i++, count++) {
+					f->items[count].start = &tok.start[i];
+					f->items[count].len = 1;
+				}
 			}
 		}
-		*buff_ptr = '\0';  /* Ensure null termination */
+	}
 
-		ok = parse_line(pi, buff);
-		if (ok) {
-			if ((pi->pass == PASS_2) && pi->list_line && pi->list_on)
-				fprintf(pi->list_file, "         %s\n", pi->list_line);
-			if (pi->error_count >= pi->max_errors) {
-				print_msg(pi, MSGTYPE_MESSAGE, "Maximum error count reached. Exiting...");
-				ok = False;
-				break;
-			}
-		}
+	macro = calloc(1, sizeof(struct macro));
+	if (!macro) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		free(f->line);
+		free(f->items);
+		return (False);
+	}
+	if (pi->macro_line) {
+		macro->include_file = pi->macro_call->macro->include_file;
+		macro->first_line_number = pi->macro_call->macro->first_line_number + pi->macro_call->line_index;
+	} else {
+		macro->include_file = pi->fi->include_file;
+		macro->first_line_number = pi->fi->line_number;
+	}
+	if (!read_repeat_body(pi, macro, len ? name : NULL, len) || (count == 0)) {
+		free_body(macro);
+		free(f->line);
+		free(f->items);
+		return (True);
 	}
 
-	pi->macro_line = old_macro_line;
-	pi->macro_call = macro_call->prev_on_stack;
-	if (rest_line)
-		free(line);
-	return (ok);
+	f->macro_arg_count = f->items ? 1 : 0;
+	f->count = count;
+	f->iteration = 0;
+	f->old_macro_line = pi->macro_line;
+	if (!start_call(pi, f, macro)) {
+		free_body(macro);
+		free(f->line);
+		free(f->items);
+		return (False);
+	}
+	pi->macro_depth++;
+
+	if (deferred)
+		return (True);
+	return (run_macros(pi, pi->macro_depth - 1));
 }
 
 struct macro_label *get_macro_label(char *line, struct macro *macro)
@@ -25,53 +25,258 @@
  *     www: https://github.com/Ro5bert/avra
  */
 
+/* The map file lists every constant (C), variable (V) and label (L) with
+ * its value. Symbols are collected into one array, optionally sorted, and
+ * formatted into a buffer that is written with fwrite(). --mapjson writes
+ * the same symbols as JSON lines, one object per symbol. */
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "misc.h"
 #include "avra.h"
 #include "args.h"
 
-char *Space(char *n);
+#define MAP_BUFFER	(64 * 1024)	/* Output buffer size */
 
-void
-write_map_file(struct prog_info *pi)
-{
+struct map_symbol {
+	const char *name;
+	int len;
+	int value;
+	char type;		/* C, V or L */
+	int order;		/* Position in the map without sorting */
+};
+
+struct map_writer {
 	FILE *fp;
-	struct label *label;
-	char Filename[200];
+	char out[MAP_BUFFER];
+	int out_len;
+};
 
-	if (!pi->map_on) {
-		return;
+static void
+map_flush(struct map_writer *w)
+{
+	if (w->out_len)
+		fwrite(w->out, 1, w->out_len, w->fp);
+	w->out_len = 0;
+}
+
+static void
+map_text(struct map_writer *w, const char *text, int len)
+{
+	if (w->out_len + len > MAP_BUFFER) {
+		map_flush(w);
+		if (len > MAP_BUFFER) {
+			fwrite(text, 1, len, w->fp);
+			return;
+		}
 	}
+	memcpy(&w->out[w->out_len], text, len);
+	w->out_len += len;
+}
 
-	strcpy(Filename, GET_ARG_P(pi->args, ARG_MAPFILE));
-	fp = fopen(Filename,"w");
-	if (fp == NULL) {
-		fprintf(stderr,"Error: cannot create map file\n");
-		return;
+static void
+map_char(struct map_writer *w, char c)
+{
+	if (w->out_len == MAP_BUFFER)
+		map_flush(w);
+	w->out[w->out_len++] = c;
+}
+
+/* Like printf("%04x") of an int */
+static void
+map_hex(struct map_writer *w, unsigned int value)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buf[2 * sizeof(unsigned int)];
+	int n = 0;
+
+	do {
+		buf[sizeof(buf) - 1 - n++] = hex[value & 0x0f];
+		value >>= 4;
+	} while (value || (n < 4));
+	map_text(w, &buf[sizeof(buf) - n], n);
+}
+
+/* Like printf("%d") */
+static void
+map_dec(struct map_writer *w, int value)
+{
+	char buf[12];
+	unsigned int u = value;
+	int n = 0;
+
+	if (value < 0)
+		u = -u;
+	do {
+		buf[sizeof(buf) - 1 - n++] = '0' + (u % 10);
+		u /= 10;
+	} while (u);
+	if (value < 0)
+		buf[sizeof(buf) - 1 - n++] = '-';
+	map_text(w, &buf[sizeof(buf) - n], n);
+}
+
+static void
+map_line(struct map_writer *w, const struct map_symbol *sym)
+{
+	map_text(w, sym->name, sym->len);
+	if (sym->len < 1)
+		map_text(w, "\t\t\t", 3);
+	else if (sym->len < 8)
+		map_text(w, "\t\t", 2);
+	else
+		map_char(w, '\t');
+	map_char(w, sym->type);
+	map_char(w, '\t');
+	map_hex(w, sym->value);
+	map_char(w, '\t');
+	map_dec(w, sym->value);
+	map_char(w, '\n');
+}
+
+static void
+json_line(struct map_writer *w, const struct map_symbol *sym)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+	unsigned char c;
+
+	map_text(w, "{\"name\":\"", 9);
+	for (i = 0; i < sym->len; i++) {
+		c = sym->name[i];
+		if ((c == '"') || (c == '\\')) {
+			map_char(w, '\\');
+			map_char(w, c);
+		} else if (c < 0x20) {
+			map_text(w, "\\u00", 4);
+			map_char(w, hex[c >> 4]);
+			map_char(w, hex[c & 0x0f]);
+		} else
+			map_char(w, c);
 	}
-	for (label = pi->first_constant; label; label = label->next)
-		fprintf(fp,"%s%sC\t%04x\t%d\n",label->name,Space(label->name),label->value,label->value);
+	map_text(w, "\",\"type\":\"", 10);
+	map_char(w, sym->type);
+	map_text(w, "\",\"value\":", 10);
+	map_dec(w, sym->value);
+	map_text(w, "}\n", 2);
+}
 
-	for (label = pi->first_variable; label; label = label->next)
-		fprintf(fp,"%s%sV\t%04x\t%d\n",label->name,Space(label->name),label->value,label->value);
+static int
+compare_addr(const void *a, const void *b)
+{
+	const struct map_symbol *x = a, *y = b;
 
-	for (label = pi->first_label; label; label = label->next)
-		fprintf(fp,"%s%sL\t%04x\t%d\n",label->name,Space(label->name),label->value,label->value);
+	if (x->value != y->value)
+		return ((x->value < y->value) ? -1 : 1);
+	return (x->order - y->order);
+}
+
+static int
+compare_name(const void *a, const void *b)
+{
+	const struct map_symbol *x = a, *y = b;
+	int r;
+
+	r = nocase_strcmp(x->name, y->name);
+	if (r)
+		return (r);
+	return (x->order - y->order);
+}
+
+static int
+collect(struct map_symbol *syms, int count, struct label *label, char type)
+{
+	for (; label; label = label->next, count++) {
+		syms[count].name = label->name;
+		syms[count].len = strlen(label->name);
+		syms[count].value = label->value;
+		syms[count].type = type;
+		syms[count].order = count;
+	}
+	return (count);
+}
+
+static int
+count_labels(struct label *label)
+{
+	int count = 0;
 
-	fprintf(fp,"\n");
-	fclose(fp);
-	return;
+	for (; label; label = label->next)
+		count++;
+	return (count);
 }
 
-char *
-Space(char *n)
+static void
+write_symbols(struct prog_info *pi, const char *filename, const char *what,
+              struct map_symbol *syms, int count, int json)
 {
+	struct map_writer *w;
 	int i;
 
-	i = strlen(n);
-	if (i < 1) return "\t\t\t";
-	if (i < 8) return "\t\t";
-	return "\t";
+	w = malloc(sizeof(struct map_writer));
+	if (!w) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+	w->fp = open_output(filename, "w");
+	if (w->fp == NULL) {
+		fprintf(stderr, "Error: cannot create %s file\n", what);
+		free(w);
+		return;
+	}
+	w->out_len = 0;
+	for (i = 0; i < count; i++) {
+		if (json)
+			json_line(w, &syms[i]);
+		else
+			map_line(w, &syms[i]);
+	}
+	if (!json)
+		map_char(w, '\n');
+	map_flush(w);
+	fclose(w->fp);
+	free(w);
+}
+
+void
+write_map_file(struct prog_info *pi)
+{
+	struct map_symbol *syms;
+	const char *mapfile, *jsonfile;
+	int count;
+
+	if (!pi->map_on) {
+		return;
+	}
+	mapfile = GET_ARG_P(pi->args, ARG_MAPFILE);
+	jsonfile = GET_ARG_P(pi->args, ARG_MAPJSON);
+
+	count = count_labels(pi->first_constant) + count_labels(pi->first_variable)
+	        + count_labels(pi->first_label);
+	syms = malloc((count ? count : 1) * sizeof(struct map_symbol));
+	if (!syms) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+	count = collect(syms, 0, pi->first_constant, 'C');
+	count = collect(syms, count, pi->first_variable, 'V');
+	count = collect(syms, count, pi->first_label, 'L');
+
+	switch (GET_ARG_I(pi->args, ARG_MAPSORT)) {
+	case MAPSORT_ADDR:
+		qsort(syms, count, sizeof(struct map_symbol), compare_addr);
+		break;
+	case MAPSORT_NAME:
+		qsort(syms, count, sizeof(struct map_symbol), compare_name);
+		break;
+	}
+
+	if (mapfile)
+		write_symbols(pi, mapfile, "map", syms, count, False);
+	if (jsonfile)
+		write_symbols(pi, jsonfile, "JSON map", syms, count, True);
+	free(syms);
 }
 
 /* end of map.c */
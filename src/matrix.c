@@ -0,0 +1,282 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/* --device_matrix assembles one source for a list of devices. An entry is
+ * a device name, optionally followed by :symbol[=value] for each symbol to
+ * define; an entry without a device keeps the one of the source. Every
+ * entry is assembled in a process of its own, as many at a time as there
+ * are processors. The messages of each are collected in a temporary file
+ * and printed in the order of the list once all are done. The output files
+ * of an entry have its name inserted before their extension. */
+
+#define _POSIX_C_SOURCE 200809L	/* fileno() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "misc.h"
+#include "avra.h"
+#include "args.h"
+
+#ifndef _WIN32
+
+struct matrix_entry {
+	char *spec;		/* Copy of the entry, cut at the colons */
+	const char *device;	/* NULL to keep the device of the source */
+	char *name;		/* Inserted into the output file names */
+	FILE *log;		/* Messages of the assembly */
+	pid_t pid;
+	int failed;
+};
+
+/* Options naming an output file (or, for --delta, a file per device) */
+static const int named_files[] = {
+	ARG_OUTFILE, ARG_EEPFILE, ARG_DEBUGFILE, ARG_LISTFILE, ARG_MAPFILE,
+	ARG_MAPJSON, ARG_STATSJSON, ARG_PROFILE, ARG_TRACE, ARG_DELTA
+};
+
+/* filename with ".name" inserted before its extension, or appended */
+static char *
+insert_name(const char *filename, const char *name)
+{
+	const char *base, *dot;
+	char *result;
+	size_t len;
+
+	base = strrchr(filename, '/');
+	dot = strrchr(base ? base : filename, '.');
+	len = dot ? (size_t)(dot - filename) : strlen(filename);
+	result = malloc(strlen(filename) + strlen(name) + 2);
+	if (result)
+		sprintf(result, "%.*s.%s%s", (int)len, filename, name, dot ? dot : "");
+	return (result);
+}
+
+/* Split the --device_matrix lists into entries */
+static struct matrix_entry *
+read_entries(struct args *args, int *count)
+{
+	struct data_list *list;
+	struct matrix_entry *entries, *e;
+	char *copy, *spec, *next, *colon;
+	int n = 0, i, j;
+
+	for (list = GET_ARG_LIST(args, ARG_DEVICE_MATRIX); list; list = list->next)
+		for (spec = (char *)list->data, n++; (spec = strchr(spec, ',')); spec++, n++);
+	if ((entries = calloc(n, sizeof(struct matrix_entry))) == NULL)
+		return (NULL);
+	i = 0;
+	for (list = GET_ARG_LIST(args, ARG_DEVICE_MATRIX); list; list = list->next) {
+		if ((copy = malloc(strlen(list->data) + 1)) == NULL)
+			return (NULL);
+		strcpy(copy, list->data);
+		for (spec = copy; spec; spec = next, i++) {
+			if ((next = strchr(spec, ',')))
+				*next++ = '\0';
+			e = &entries[i];
+			e->spec = spec;
+			if ((colon = strchr(spec, ':')))
+				*colon = '\0';
+			e->device = *spec ? spec : NULL;
+			if ((e->name = malloc(strlen(spec) + 16)) == NULL)
+				return (NULL);
+			strcpy(e->name, *spec ? spec : "config");
+			for (j = 0; j < i; j++) {
+				if (!strcmp(entries[j].name, e->name)) {
+					sprintf(e->name + strlen(e->name), "-%d", i + 1);
+					break;
+				}
+			}
+			if (colon)
+				*colon = ':';
+		}
+	}
+	*count = n;
+	return (entries);
+}
+
+/* Assemble entry e in this (child) process */
+static int
+assemble_entry(struct args *args, struct matrix_entry *e, double started, double parsed)
+{
+	const char *source = args->first_data->data;
+	char *output_name, *base, *symbol, *next;
+	size_t i;
+
+	for (i = 0; i < sizeof(named_files) / sizeof(named_files[0]); i++) {
+		if (GET_ARG_P(args, named_files[i]))
+			SET_ARG_P(args, named_files[i], insert_name(GET_ARG_P(args, named_files[i]), e->name));
+	}
+	symbol = strchr(e->spec, ':');
+	for (; symbol; symbol = next) {
+		*symbol++ = '\0';
+		if ((next = strchr(symbol, ':')))
+			*next = '\0';
+		if (*symbol && !add_arg(&args->arg[ARG_DEFINE].data.dl, symbol))
+			return (EXIT_FAILURE);
+		if (next)
+			*next = ':';
+	}
+	/* Named like the source without .asm, which open_out_files() drops */
+	if ((base = malloc(strlen(source) + 1)) == NULL)
+		return (EXIT_FAILURE);
+	strcpy(base, source);
+	i = strlen(base);
+	if ((i >= 4) && !nocase_strcmp(&base[i - 4], ".asm"))
+		base[i - 4] = '\0';
+	if ((output_name = malloc(strlen(base) + strlen(e->name) + 2)) == NULL)
+		return (EXIT_FAILURE);
+	sprintf(output_name, "%s.%s", base, e->name);
+	return (assemble_source(args, e->device, output_name, started, parsed));
+}
+
+static int
+start_entry(struct args *args, struct matrix_entry *e, double started, double parsed)
+{
+	int status;
+
+	if ((e->log = tmpfile()) == NULL) {
+		perror("tmpfile");
+		return (False);
+	}
+	fflush(stdout);
+	fflush(stderr);
+	e->pid = fork();
+	if (e->pid < 0) {
+		perror("fork");
+		return (False);
+	}
+	if (e->pid == 0) {
+		dup2(fileno(e->log), STDOUT_FILENO);
+		dup2(fileno(e->log), STDERR_FILENO);
+		status = assemble_entry(args, e, started, parsed);
+		fflush(stdout);
+		fflush(stderr);
+		_exit(status);
+	}
+	return (True);
+}
+
+int
+device_matrix(struct args *args, double started, double parsed)
+{
+	struct matrix_entry *entries;
+	int count, i, next, running, jobs, status, failed;
+	size_t n, k;
+	pid_t pid;
+	char buff[4096];
+
+	if (!args->first_data) {
+		printf("Error: You need to specify a file to assemble\n");
+		return (EXIT_FAILURE);
+	}
+	if (!strcmp(args->first_data->data, "-")) {
+		printf("Error: --device_matrix can't read the source from stdin\n");
+		return (EXIT_FAILURE);
+	}
+	for (k = 0; k < sizeof(named_files) / sizeof(named_files[0]); k++) {
+		if (GET_ARG_P(args, named_files[k]) && !strcmp(GET_ARG_P(args, named_files[k]), "-")) {
+			printf("Error: --device_matrix can't write its output files to stdout\n");
+			return (EXIT_FAILURE);
+		}
+	}
+	if ((entries = read_entries(args, &count)) == NULL) {
+		printf("Error: Unable to allocate memory\n");
+		return (EXIT_FAILURE);
+	}
+	jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs < 1)
+		jobs = 1;
+	next = running = 0;
+	while ((next < count) || running) {
+		while ((running < jobs) && (next < count)) {
+			if (start_entry(args, &entries[next], started, parsed))
+				running++;
+			else
+				entries[next].failed = True;
+			next++;
+		}
+		if (!running)
+			continue;
+		pid = wait(&status);
+		if ((pid < 0) && (errno == EINTR))
+			continue;
+		if (pid < 0)
+			perror("wait");
+		for (i = 0; i < count; i++) {
+			if (entries[i].pid <= 0)
+				continue;
+			if (pid < 0) {
+				/* No children left to wait for, none of these reported back */
+				entries[i].failed = True;
+			} else if (entries[i].pid == pid) {
+				entries[i].failed = !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS);
+			} else
+				continue;
+			entries[i].pid = 0;
+			running--;
+		}
+	}
+	failed = 0;
+	for (i = 0; i < count; i++) {
+		printf("\n=== %s ===\n", entries[i].name);
+		if (entries[i].log) {
+			rewind(entries[i].log);
+			while ((n = fread(buff, 1, sizeof(buff), entries[i].log)) > 0)
+				fwrite(buff, 1, n, stdout);
+			fclose(entries[i].log);
+		}
+		if (entries[i].failed)
+			failed++;
+	}
+	if (failed)
+		printf("\nDevice matrix: %d of %d builds failed.\n", failed, count);
+	else
+		printf("\nDevice matrix: %d builds complete.\n", count);
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+#else
+
+int
+device_matrix(struct args *args, double started, double parsed)
+{
+	printf("Error: --device_matrix is not supported on this platform\n");
+	return (EXIT_FAILURE);
+}
+
+#endif
+
+/* end of matrix.c */
@@ -188,132 +188,168 @@ enum {
 	MNEMONIC_END
 };
 
+/* Operand formats. Every instruction_list[] entry names the format of its
+ * operands, and the format decides how many operands are required, how many
+ * words the instruction takes and which encoder packs the operands into the
+ * opcode. */
+enum {
+	OPFMT_NONE = 0,	/* no operands */
+	OPFMT_LPM,	/* none, or Rd, Z/Z+ */
+	OPFMT_S,	/* s */
+	OPFMT_SER,	/* Rd (r16 - r31) */
+	OPFMT_RD,	/* Rd */
+	OPFMT_RD_TWICE,	/* Rd, encoded as Rd, Rd */
+	OPFMT_BRANCH,	/* k, relative -64 <= k <= 63 */
+	OPFMT_RJMP,	/* k, relative -2048 <= k <= 2047 */
+	OPFMT_JMP,	/* k, 22 bit absolute */
+	OPFMT_S_BRANCH,	/* s, k */
+	OPFMT_RD_RR,	/* Rd, Rr */
+	OPFMT_MOVW,	/* Rd, Rr (even registers) */
+	OPFMT_MULS,	/* Rd, Rr (r16 - r31) */
+	OPFMT_MULSU,	/* Rd, Rr (r16 - r23) */
+	OPFMT_ADIW,	/* Rd, K (r24, r26, r28, r30) */
+	OPFMT_RD_K,	/* Rd, K (r16 - r31) */
+	OPFMT_RD_B,	/* Rd, b */
+	OPFMT_IN,	/* Rd, P */
+	OPFMT_OUT,	/* P, Rr */
+	OPFMT_P_B,	/* P, b */
+	OPFMT_LDS,	/* Rd, k */
+	OPFMT_STS,	/* k, Rr */
+	OPFMT_LD,	/* Rd, X/Y/Z */
+	OPFMT_ST,	/* X/Y/Z, Rr */
+	OPFMT_LDD,	/* Rd, Y+q/Z+q */
+	OPFMT_STD,	/* Y+q/Z+q, Rr */
+	OPFMT_Z_RD,	/* Z, Rd */
+	OPFMT_COUNT
+};
+
 struct instruction {
 	char *mnemonic;
 	int opcode;
 	int flag;	/* Device flags meaning the instruction is not supported */
+	int format;	/* OPFMT_* */
 };
 
 struct instruction instruction_list[] = {
-	{"nop",   0x0000,          0},
-	{"sec",   0x9408,          0},
-	{"clc",   0x9488,          0},
-	{"sen",   0x9428,          0},
-	{"cln",   0x94a8,          0},
-	{"sez",   0x9418,          0},
-	{"clz",   0x9498,          0},
-	{"sei",   0x9478,          0},
-	{"cli",   0x94f8,          0},
-	{"ses",   0x9448,          0},
-	{"cls",   0x94c8,          0},
-	{"sev",   0x9438,          0},
-	{"clv",   0x94b8,          0},
-	{"set",   0x9468,          0},
-	{"clt",   0x94e8,          0},
-	{"seh",   0x9458,          0},
-	{"clh",   0x94d8,          0},
-	{"sleep", 0x9588,          0},
-	{"wdr",   0x95a8,          0},
-	{"ijmp",  0x9409,  DF_TINY1X},
-	{"eijmp", 0x9419, DF_NO_EIJMP},
-	{"icall", 0x9509,  DF_TINY1X},
-	{"eicall",0x9519, DF_NO_EICALL},
-	{"ret",   0x9508,          0},
-	{"reti",  0x9518,          0},
-	{"spm",   0x95e8, DF_NO_SPM},
-	{"espm",  0x95f8, DF_NO_ESPM},
-	{"break", 0x9598, DF_NO_BREAK},
-	{"lpm",   0x95c8, DF_NO_LPM},
-	{"elpm",  0x95d8, DF_NO_ELPM},
-	{"bset",  0x9408,          0},
-	{"bclr",  0x9488,          0},
-	{"ser",   0xef0f,          0},
-	{"com",   0x9400,          0},
-	{"neg",   0x9401,          0},
-	{"inc",   0x9403,          0},
-	{"dec",   0x940a,          0},
-	{"lsr",   0x9406,          0},
-	{"ror",   0x9407,          0},
-	{"asr",   0x9405,          0},
-	{"swap",  0x9402,          0},
-	{"push",  0x920f,  DF_TINY1X},
-	{"pop",   0x900f,  DF_TINY1X},
-	{"tst",   0x2000,          0},
-	{"clr",   0x2400,          0},
-	{"lsl",   0x0c00,          0},
-	{"rol",   0x1c00,          0},
-	{"breq",  0xf001,          0},
-	{"brne",  0xf401,          0},
-	{"brcs",  0xf000,          0},
-	{"brcc",  0xf400,          0},
-	{"brsh",  0xf400,          0},
-	{"brlo",  0xf000,          0},
-	{"brmi",  0xf002,          0},
-	{"brpl",  0xf402,          0},
-	{"brge",  0xf404,          0},
-	{"brlt",  0xf004,          0},
-	{"brhs",  0xf005,          0},
-	{"brhc",  0xf405,          0},
-	{"brts",  0xf006,          0},
-	{"brtc",  0xf406,          0},
-	{"brvs",  0xf003,          0},
-	{"brvc",  0xf403,          0},
-	{"brie",  0xf007,          0},
-	{"brid",  0xf407,          0},
-	{"rjmp",  0xc000,          0},
-	{"rcall", 0xd000,          0},
-	{"jmp",   0x940c,  DF_NO_JMP},
-	{"call",  0x940e,  DF_NO_JMP},
-	{"brbs",  0xf000,          0},
-	{"brbc",  0xf400,          0},
-	{"add",   0x0c00,          0},
-	{"adc",   0x1c00,          0},
-	{"sub",   0x1800,          0},
-	{"sbc",   0x0800,          0},
-	{"and",   0x2000,          0},
-	{"or",    0x2800,          0},
-	{"eor",   0x2400,          0},
-	{"cp",    0x1400,          0},
-	{"cpc",   0x0400,          0},
-	{"cpse",  0x1000,          0},
-	{"mov",   0x2c00,          0},
-	{"mul",   0x9c00, DF_NO_MUL},
-	{"movw",  0x0100, DF_NO_MOVW},
-	{"muls",  0x0200, DF_NO_MUL},
-	{"mulsu", 0x0300, DF_NO_MUL},
-	{"fmul",  0x0308, DF_NO_MUL},
-	{"fmuls", 0x0380, DF_NO_MUL},
-	{"fmulsu",0x0388, DF_NO_MUL},
-	{"adiw",  0x9600,  DF_TINY1X | DF_AVR8L},
-	{"sbiw",  0x9700,  DF_TINY1X | DF_AVR8L},
-	{"subi",  0x5000,          0},
-	{"sbci",  0x4000,          0},
-	{"andi",  0x7000,          0},
-	{"ori",   0x6000,          0},
-	{"sbr",   0x6000,          0},
-	{"cpi",   0x3000,          0},
-	{"ldi",   0xe000,          0},
-	{"cbr",   0x7000,          0},
-	{"sbrc",  0xfc00,          0},
-	{"sbrs",  0xfe00,          0},
-	{"bst",   0xfa00,          0},
-	{"bld",   0xf800,          0},
-	{"in",    0xb000,          0},
-	{"out",   0xb800,          0},
-	{"sbic",  0x9900,          0},
-	{"sbis",  0x9b00,          0},
-	{"sbi",   0x9a00,          0},
-	{"cbi",   0x9800,          0},
-	{"lds",   0x9000,  DF_TINY1X | DF_AVR8L},
-	{"sts",   0x9200,  DF_TINY1X | DF_AVR8L},
-	{"ld",    0,          0},
-	{"st",    0,          0},
-	{"ldd",   0,  DF_TINY1X},
-	{"std",   0,  DF_TINY1X},
-	{"xch",   0,  DF_NO_RMW},
-	{"las",   0,  DF_NO_RMW},
-	{"lac",   0,  DF_NO_RMW},
-	{"lat",   0,  DF_NO_RMW},
+	{"nop",   0x0000,          0, OPFMT_NONE},
+	{"sec",   0x9408,          0, OPFMT_NONE},
+	{"clc",   0x9488,          0, OPFMT_NONE},
+	{"sen",   0x9428,          0, OPFMT_NONE},
+	{"cln",   0x94a8,          0, OPFMT_NONE},
+	{"sez",   0x9418,          0, OPFMT_NONE},
+	{"clz",   0x9498,          0, OPFMT_NONE},
+	{"sei",   0x9478,          0, OPFMT_NONE},
+	{"cli",   0x94f8,          0, OPFMT_NONE},
+	{"ses",   0x9448,          0, OPFMT_NONE},
+	{"cls",   0x94c8,          0, OPFMT_NONE},
+	{"sev",   0x9438,          0, OPFMT_NONE},
+	{"clv",   0x94b8,          0, OPFMT_NONE},
+	{"set",   0x9468,          0, OPFMT_NONE},
+	{"clt",   0x94e8,          0, OPFMT_NONE},
+	{"seh",   0x9458,          0, OPFMT_NONE},
+	{"clh",   0x94d8,          0, OPFMT_NONE},
+	{"sleep", 0x9588,          0, OPFMT_NONE},
+	{"wdr",   0x95a8,          0, OPFMT_NONE},
+	{"ijmp",  0x9409,  DF_TINY1X, OPFMT_NONE},
+	{"eijmp", 0x9419, DF_NO_EIJMP, OPFMT_NONE},
+	{"icall", 0x9509,  DF_TINY1X, OPFMT_NONE},
+	{"eicall",0x9519, DF_NO_EICALL, OPFMT_NONE},
+	{"ret",   0x9508,          0, OPFMT_NONE},
+	{"reti",  0x9518,          0, OPFMT_NONE},
+	{"spm",   0x95e8, DF_NO_SPM, OPFMT_NONE},
+	{"espm",  0x95f8, DF_NO_ESPM, OPFMT_NONE},
+	{"break", 0x9598, DF_NO_BREAK, OPFMT_NONE},
+	{"lpm",   0x95c8, DF_NO_LPM, OPFMT_LPM},
+	{"elpm",  0x95d8, DF_NO_ELPM, OPFMT_LPM},
+	{"bset",  0x9408,          0, OPFMT_S},
+	{"bclr",  0x9488,          0, OPFMT_S},
+	{"ser",   0xef0f,          0, OPFMT_SER},
+	{"com",   0x9400,          0, OPFMT_RD},
+	{"neg",   0x9401,          0, OPFMT_RD},
+	{"inc",   0x9403,          0, OPFMT_RD},
+	{"dec",   0x940a,          0, OPFMT_RD},
+	{"lsr",   0x9406,          0, OPFMT_RD},
+	{"ror",   0x9407,          0, OPFMT_RD},
+	{"asr",   0x9405,          0, OPFMT_RD},
+	{"swap",  0x9402,          0, OPFMT_RD},
+	{"push",  0x920f,  DF_TINY1X, OPFMT_RD},
+	{"pop",   0x900f,  DF_TINY1X, OPFMT_RD},
+	{"tst",   0x2000,          0, OPFMT_RD_TWICE},
+	{"clr",   0x2400,          0, OPFMT_RD_TWICE},
+	{"lsl",   0x0c00,          0, OPFMT_RD_TWICE},
+	{"rol",   0x1c00,          0, OPFMT_RD_TWICE},
+	{"breq",  0xf001,          0, OPFMT_BRANCH},
+	{"brne",  0xf401,          0, OPFMT_BRANCH},
+	{"brcs",  0xf000,          0, OPFMT_BRANCH},
+	{"brcc",  0xf400,          0, OPFMT_BRANCH},
+	{"brsh",  0xf400,          0, OPFMT_BRANCH},
+	{"brlo",  0xf000,          0, OPFMT_BRANCH},
+	{"brmi",  0xf002,          0, OPFMT_BRANCH},
+	{"brpl",  0xf402,          0, OPFMT_BRANCH},
+	{"brge",  0xf404,          0, OPFMT_BRANCH},
+	{"brlt",  0xf004,          0, OPFMT_BRANCH},
+	{"brhs",  0xf005,          0, OPFMT_BRANCH},
+	{"brhc",  0xf405,          0, OPFMT_BRANCH},
+	{"brts",  0xf006,          0, OPFMT_BRANCH},
+	{"brtc",  0xf406,          0, OPFMT_BRANCH},
+	{"brvs",  0xf003,          0, OPFMT_BRANCH},
+	{"brvc",  0xf403,          0, OPFMT_BRANCH},
+	{"brie",  0xf007,          0, OPFMT_BRANCH},
+	{"brid",  0xf407,          0, OPFMT_BRANCH},
+	{"rjmp",  0xc000,          0, OPFMT_RJMP},
+	{"rcall", 0xd000,          0, OPFMT_RJMP},
+	{"jmp",   0x940c,  DF_NO_JMP, OPFMT_JMP},
+	{"call",  0x940e,  DF_NO_JMP, OPFMT_JMP},
+	{"brbs",  0xf000,          0, OPFMT_S_BRANCH},
+	{"brbc",  0xf400,          0, OPFMT_S_BRANCH},
+	{"add",   0x0c00,          0, OPFMT_RD_RR},
+	{"adc",   0x1c00,          0, OPFMT_RD_RR},
+	{"sub",   0x1800,          0, OPFMT_RD_RR},
+	{"sbc",   0x0800,          0, OPFMT_RD_RR},
+	{"and",   0x2000,          0, OPFMT_RD_RR},
+	{"or",    0x2800,          0, OPFMT_RD_RR},
+	{"eor",   0x2400,          0, OPFMT_RD_RR},
+	{"cp",    0x1400,          0, OPFMT_RD_RR},
+	{"cpc",   0x0400,          0, OPFMT_RD_RR},
+	{"cpse",  0x1000,          0, OPFMT_RD_RR},
+	{"mov",   0x2c00,          0, OPFMT_RD_RR},
+	{"mul",   0x9c00, DF_NO_MUL, OPFMT_RD_RR},
+	{"movw",  0x0100, DF_NO_MOVW, OPFMT_MOVW},
+	{"muls",  0x0200, DF_NO_MUL, OPFMT_MULS},
+	{"mulsu", 0x0300, DF_NO_MUL, OPFMT_MULSU},
+	{"fmul",  0x0308, DF_NO_MUL, OPFMT_MULSU},
+	{"fmuls", 0x0380, DF_NO_MUL, OPFMT_MULSU},
+	{"fmulsu",0x0388, DF_NO_MUL, OPFMT_MULSU},
+	{"adiw",  0x9600,  DF_TINY1X | DF_AVR8L, OPFMT_ADIW},
+	{"sbiw",  0x9700,  DF_TINY1X | DF_AVR8L, OPFMT_ADIW},
+	{"subi",  0x5000,          0, OPFMT_RD_K},
+	{"sbci",  0x4000,          0, OPFMT_RD_K},
+	{"andi",  0x7000,          0, OPFMT_RD_K},
+	{"ori",   0x6000,          0, OPFMT_RD_K},
+	{"sbr",   0x6000,          0, OPFMT_RD_K},
+	{"cpi",   0x3000,          0, OPFMT_RD_K},
+	{"ldi",   0xe000,          0, OPFMT_RD_K},
+	{"cbr",   0x7000,          0, OPFMT_RD_K},
+	{"sbrc",  0xfc00,          0, OPFMT_RD_B},
+	{"sbrs",  0xfe00,          0, OPFMT_RD_B},
+	{"bst",   0xfa00,          0, OPFMT_RD_B},
+	{"bld",   0xf800,          0, OPFMT_RD_B},
+	{"in",    0xb000,          0, OPFMT_IN},
+	{"out",   0xb800,          0, OPFMT_OUT},
+	{"sbic",  0x9900,          0, OPFMT_P_B},
+	{"sbis",  0x9b00,          0, OPFMT_P_B},
+	{"sbi",   0x9a00,          0, OPFMT_P_B},
+	{"cbi",   0x9800,          0, OPFMT_P_B},
+	{"lds",   0x9000,  DF_TINY1X | DF_AVR8L, OPFMT_LDS},
+	{"sts",   0x9200,  DF_TINY1X | DF_AVR8L, OPFMT_STS},
+	{"ld",    0,          0, OPFMT_LD},
+	{"st",    0,          0, OPFMT_ST},
+	{"ldd",   0,  DF_TINY1X, OPFMT_LDD},
+	{"std",   0,  DF_TINY1X, OPFMT_STD},
+	{"xch",   0x9204, DF_NO_RMW, OPFMT_Z_RD},
+	{"las",   0x9205, DF_NO_RMW, OPFMT_Z_RD},
+	{"lac",   0x9206, DF_NO_RMW, OPFMT_Z_RD},
+	{"lat",   0x9207, DF_NO_RMW, OPFMT_Z_RD},
 	{"count", 0,          0},
 	{"lpm",   0x9004, DF_NO_LPM|DF_NO_LPM_X},
 	{"lpm",   0x9005, DF_NO_LPM|DF_NO_LPM_X},
@@ -343,413 +379,743 @@ struct instruction instruction_list[] = {
 	{"std",   0x8200, DF_TINY1X},
 	{"lds",   0xa000, DF_TINY1X},
 	{"sts",   0xa800, DF_TINY1X},
-	{"xch",   0x9204, DF_NO_RMW},
-	{"las",   0x9205, DF_NO_RMW},
-	{"lac",   0x9206, DF_NO_RMW},
-	{"lat",   0x9207, DF_NO_RMW},
 	{"end", 0, 0}
 };
 
+/* An instruction being encoded. The encoders may switch mnemonic to one of
+ * the addressing mode variants after MNEMONIC_COUNT; the opcode bits of the
+ * final mnemonic are or'ed in afterwards. */
+struct encoding {
+	int mnemonic;
+	int opcode;
+	int opcode2;
+	int words;
+};
+
+/* Encoder results */
+enum {
+	ENCODE_FATAL = 0,	/* stop assembling */
+	ENCODE_OK,
+	ENCODE_SKIP		/* error already reported, emit nothing */
+};
+
+typedef int (*encoder)(struct prog_info *pi, struct encoding *enc, const struct token op[]);
+
+struct operand_format {
+	int operands;	/* operands required */
+	int words;	/* size in words, except on AVR8L where all are one word */
+	encoder encode;
+};
+
+static const char *
+enc_name(const struct encoding *enc)
+{
+	return (instruction_list[enc->mnemonic].mnemonic);
+}
+
+static int
+encode_none(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	return (ENCODE_OK);
+}
+
+static int
+encode_lpm(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!op[0].start)	/* LPM without operands, r0 implied */
+		return (ENCODE_OK);
+	if (!op[1].start) {
+		print_msg(pi, MSGTYPE_ERROR, "%s needs a second operand", enc_name(enc));
+		return (ENCODE_SKIP);
+	}
+	i = get_register(pi, &op[0]);
+	enc->opcode = i << 4;
+	i = get_indirect(pi, &op[1]);
+	if (i == 6) /* Means Z */
+		enc->mnemonic = (enc->mnemonic == MNEMONIC_LPM) ? MNEMONIC_LPM_Z : MNEMONIC_ELPM_Z;
+	else if (i == 7) /* Means Z+ */
+		enc->mnemonic = (enc->mnemonic == MNEMONIC_LPM) ? MNEMONIC_LPM_ZP : MNEMONIC_ELPM_ZP;
+	else {
+		print_msg(pi, MSGTYPE_ERROR, "Unsupported operand: %.*s", op[1].len, op[1].start);
+		return (ENCODE_SKIP);
+	}
+	return (ENCODE_OK);
+}
+
+static int
+encode_s(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_bitnum(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	enc->opcode = i << 4;
+	return (ENCODE_OK);
+}
+
+static int
+encode_ser(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	if (i < 16) {
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", enc_name(enc));
+		i &= 0x0f;
+	}
+	enc->opcode = i << 4;
+	return (ENCODE_OK);
+}
+
+static int
+encode_rd(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	enc->opcode = get_register(pi, &op[0]) << 4;
+	return (ENCODE_OK);
+}
+
+static int
+encode_rd_twice(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	enc->opcode = (i << 4) | ((i & 0x10) << 5) | (i & 0x0f);
+	return (ENCODE_OK);
+}
+
+static int
+encode_branch(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_expr_token(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	i -= pi->cseg->addr + 1;
+	if ((i < -64) || (i > 63))
+		print_msg(pi, MSGTYPE_ERROR, "Branch out of range (-64 <= k <= 63)");
+	enc->opcode = (i & 0x7f) << 3;
+	return (ENCODE_OK);
+}
+
+static int
+encode_rjmp(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_expr_token(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	i -= pi->cseg->addr + 1;
+	if (((i < -2048) || (i > 2047)) && (pi->device->flash_size != 4096))
+		print_msg(pi, MSGTYPE_ERROR, "Relative address out of range (-2048 <= k <= 2047)");
+	enc->opcode = i & 0x0fff;
+	return (ENCODE_OK);
+}
+
+static int
+encode_jmp(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_expr_token(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	if ((i < 0) || (i > 4194303))
+		print_msg(pi, MSGTYPE_ERROR, "Address out of range (0 <= k <= 4194303)");
+	enc->opcode = ((i & 0x3e0000) >> 13) | ((i & 0x010000) >> 16);
+	enc->opcode2 = i & 0xffff;
+	enc->words = 2;
+	return (ENCODE_OK);
+}
+
+static int
+encode_s_branch(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_bitnum(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	enc->opcode = i;
+	if (!get_expr_token(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	i -= pi->cseg->addr + 1;
+	if ((i < -64) || (i > 63))
+		print_msg(pi, MSGTYPE_ERROR, "Branch out of range (-64 <= k <= 63)");
+	enc->opcode |= (i & 0x7f) << 3;
+	return (ENCODE_OK);
+}
+
+static int
+encode_rd_rr(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	enc->opcode = i << 4;
+	i = get_register(pi, &op[1]);
+	enc->opcode |= ((i & 0x10) << 5) | (i & 0x0f);
+	return (ENCODE_OK);
+}
+
+static int
+encode_movw(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	if ((i & 1) == 1)
+		print_msg(pi, MSGTYPE_ERROR, "%s must use a even numbered register for Rd", enc_name(enc));
+	enc->opcode = (i >> 1) << 4;
+	i = get_register(pi, &op[1]);
+	if ((i & 1) == 1)
+		print_msg(pi, MSGTYPE_ERROR, "%s must use a even numbered register for Rr", enc_name(enc));
+	enc->opcode |= i >> 1;
+	return (ENCODE_OK);
+}
+
+static int
+encode_muls(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	if (i < 16)
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", enc_name(enc));
+	enc->opcode = (i & 0x0f) << 4;
+	i = get_register(pi, &op[1]);
+	if (i < 16)
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", enc_name(enc));
+	enc->opcode |= (i & 0x0f);
+	return (ENCODE_OK);
+}
+
+static int
+encode_mulsu(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	if ((i < 16) || (i >= 24))
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use registers (r16 - r23)", enc_name(enc));
+	enc->opcode = (i & 0x07) << 4;
+	i = get_register(pi, &op[1]);
+	if ((i < 16) || (i >= 24))
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use registers (r16 - r23)", enc_name(enc));
+	enc->opcode |= (i & 0x07);
+	return (ENCODE_OK);
+}
+
+static int
+encode_adiw(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	if (!((i == 24) || (i == 26) || (i == 28) || (i == 30)))
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use registers R24, R26, R28 or R30", enc_name(enc));
+	enc->opcode = ((i - 24) >> 1) << 4;
+	if (!get_expr_token(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	if ((i < 0) || (i > 63))
+		print_msg(pi, MSGTYPE_ERROR, "Constant out of range (0 <= k <= 63)");
+	enc->opcode |= ((i & 0x30) << 2) | (i & 0x0f);
+	return (ENCODE_OK);
+}
+
+static int
+encode_rd_k(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	if (i < 16)
+		print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", enc_name(enc));
+	enc->opcode = (i & 0x0f) << 4;
+	if (!get_expr_token(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	if ((i < -128) || (i > 255))
+		print_msg(pi, MSGTYPE_WARNING, "Constant out of range (-128 <= k <= 255). Will be masked");
+	if (enc->mnemonic == MNEMONIC_CBR)
+		i = ~i;
+	enc->opcode |= ((i & 0xf0) << 4) | (i & 0x0f);
+	return (ENCODE_OK);
+}
+
+static int
+encode_rd_b(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	i = get_register(pi, &op[0]);
+	enc->opcode = i << 4;
+	if (!get_bitnum(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	enc->opcode |= i;
+	return (ENCODE_OK);
+}
+
+/* Both IN and OUT take a six bit I/O address split as PP....PPPP */
+static int
+get_io_address(struct prog_info *pi, const struct token *tok, int *ret)
+{
+	int i;
+
+	if (!get_expr_token(pi, tok, &i))
+		return (False);
+	if ((i < 0) || (i > 63))
+		print_msg(pi, MSGTYPE_ERROR, "I/O out of range (0 <= P <= 63)");
+	*ret = ((i & 0x30) << 5) | (i & 0x0f);
+	return (True);
+}
+
+static int
+encode_in(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	enc->opcode = get_register(pi, &op[0]) << 4;
+	if (!get_io_address(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	enc->opcode |= i;
+	return (ENCODE_OK);
+}
+
+static int
+encode_out(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	if (!get_io_address(pi, &op[0], &enc->opcode))
+		return (ENCODE_FATAL);
+	enc->opcode |= get_register(pi, &op[1]) << 4;
+	return (ENCODE_OK);
+}
+
+static int
+encode_p_b(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_expr_token(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	if ((i < 0) || (i > 31))
+		print_msg(pi, MSGTYPE_ERROR, "I/O out of range (0 <= P <= 31)");
+	enc->opcode = i << 3;
+	if (!get_bitnum(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	enc->opcode |= i;
+	return (ENCODE_OK);
+}
+
+/* Pack the data address of LDS/STS. AVR8L has one word LDS/STS with the
+ * high nibble of k in funny order, everything else a second word. */
+static void
+put_sram_address(struct prog_info *pi, struct encoding *enc, int i)
+{
+	if (pi->device->flag & DF_AVR8L) {
+		if ((i < 0x40) || (i > 0xbf))
+			print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0x40 <= k <= 0xbf)");
+		enc->opcode |= ((i & 0x40) << 2) | ((i & 0x30) << 5) | (i & 0x0f);
+	} else {
+		if ((i < 0) || (i > 65535))
+			print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0 <= k <= 65535)");
+		enc->opcode2 = i;
+		enc->words = 2;
+	}
+}
+
+static int
+encode_lds(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	enc->opcode = get_register(pi, &op[0]) << 4;
+	if (pi->device->flag & DF_AVR8L) {
+		enc->mnemonic = MNEMONIC_LDS_AVR8L;
+		enc->opcode &= 0x00f0;
+	}
+	if (!get_expr_token(pi, &op[1], &i))
+		return (ENCODE_FATAL);
+	put_sram_address(pi, enc, i);
+	return (ENCODE_OK);
+}
+
+static int
+encode_sts(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	if (!get_expr_token(pi, &op[0], &i))
+		return (ENCODE_FATAL);
+	if (pi->device->flag & DF_AVR8L)
+		enc->mnemonic = MNEMONIC_STS_AVR8L;
+	put_sram_address(pi, enc, i);
+	i = get_register(pi, &op[1]);
+	if (pi->device->flag & DF_AVR8L)
+		enc->opcode |= ((i << 4) & 0x00f0);
+	else
+		enc->opcode = i << 4;
+	return (ENCODE_OK);
+}
+
+static int
+encode_ld(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	enc->opcode = get_register(pi, &op[0]) << 4;
+	enc->mnemonic = MNEMONIC_LD_X + get_indirect(pi, &op[1]);
+	return (ENCODE_OK);
+}
+
+static int
+encode_st(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	enc->mnemonic = MNEMONIC_ST_X + get_indirect(pi, &op[0]);
+	enc->opcode = get_register(pi, &op[1]) << 4;
+	return (ENCODE_OK);
+}
+
+/* Parse the Y+q/Z+q operand of LDD/STD. Selects the y_variant or z_variant
+ * mnemonic and returns the displacement packed as q.qq..qqq in ret. */
+static int
+get_displacement(struct prog_info *pi, struct encoding *enc, const struct token *tok,
+                 const char *which, int y_variant, int z_variant, int *ret)
+{
+	struct token disp;
+	int i;
+
+	if (tolower(TOKEN_AT(tok, 0)) == 'z')
+		enc->mnemonic = z_variant;
+	else if (tolower(TOKEN_AT(tok, 0)) == 'y')
+		enc->mnemonic = y_variant;
+	else
+		print_msg(pi, MSGTYPE_ERROR, "Garbage in %s operand (%.*s)", which, tok->len, tok->start);
+	for (i = 1; (TOKEN_AT(tok, i) != '\0') && (TOKEN_AT(tok, i) != '+'); i++);
+	if (TOKEN_AT(tok, i) == '\0')	{
+		print_msg(pi, MSGTYPE_ERROR, "Garbage in %s operand (%.*s)", which, tok->len, tok->start);
+		return (False);
+	}
+	disp.start = tok->start + i + 1;
+	disp.len = tok->len - i - 1;
+	if (!get_expr_token(pi, &disp, &i))
+		return (False);
+	if ((i < 0) || (i > 63))
+		print_msg(pi, MSGTYPE_ERROR, "Displacement out of range (0 <= q <= 63)");
+	*ret = ((i & 0x20) << 8) | ((i & 0x18) << 7) | (i & 0x07);
+	return (True);
+}
+
+static int
+encode_ldd(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	int i;
+
+	enc->opcode = get_register(pi, &op[0]) << 4;
+	if (!get_displacement(pi, enc, &op[1], "second", MNEMONIC_LDD_Y, MNEMONIC_LDD_Z, &i))
+		return (ENCODE_FATAL);
+	enc->opcode |= i;
+	return (ENCODE_OK);
+}
+
+static int
+encode_std(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	if (!get_displacement(pi, enc, &op[0], "first", MNEMONIC_STD_Y, MNEMONIC_STD_Z, &enc->opcode))
+		return (ENCODE_FATAL);
+	enc->opcode |= get_register(pi, &op[1]) << 4;
+	return (ENCODE_OK);
+}
+
+/* RMW instructions XCH, LAS, LAC and LAT only take Z */
+static int
+encode_z_rd(struct prog_info *pi, struct encoding *enc, const struct token op[])
+{
+	if (get_indirect(pi, &op[0]) != 6)
+		print_msg(pi, MSGTYPE_ERROR, "%s only supports Z register addressing", enc_name(enc));
+	enc->opcode = get_register(pi, &op[1]) << 4;
+	return (ENCODE_OK);
+}
+
+static const struct operand_format operand_formats[OPFMT_COUNT] = {
+	[OPFMT_NONE]     = {0, 1, encode_none},
+	[OPFMT_LPM]      = {0, 1, encode_lpm},
+	[OPFMT_S]        = {1, 1, encode_s},
+	[OPFMT_SER]      = {1, 1, encode_ser},
+	[OPFMT_RD]       = {1, 1, encode_rd},
+	[OPFMT_RD_TWICE] = {1, 1, encode_rd_twice},
+	[OPFMT_BRANCH]   = {1, 1, encode_branch},
+	[OPFMT_RJMP]     = {1, 1, encode_rjmp},
+	[OPFMT_JMP]      = {1, 2, encode_jmp},
+	[OPFMT_S_BRANCH] = {2, 1, encode_s_branch},
+	[OPFMT_RD_RR]    = {2, 1, encode_rd_rr},
+	[OPFMT_MOVW]     = {2, 1, encode_movw},
+	[OPFMT_MULS]     = {2, 1, encode_muls},
+	[OPFMT_MULSU]    = {2, 1, encode_mulsu},
+	[OPFMT_ADIW]     = {2, 1, encode_adiw},
+	[OPFMT_RD_K]     = {2, 1, encode_rd_k},
+	[OPFMT_RD_B]     = {2, 1, encode_rd_b},
+	[OPFMT_IN]       = {2, 1, encode_in},
+	[OPFMT_OUT]      = {2, 1, encode_out},
+	[OPFMT_P_B]      = {2, 1, encode_p_b},
+	[OPFMT_LDS]      = {2, 2, encode_lds},
+	[OPFMT_STS]      = {2, 2, encode_sts},
+	[OPFMT_LD]       = {2, 1, encode_ld},
+	[OPFMT_ST]       = {2, 1, encode_st},
+	[OPFMT_LDD]      = {2, 1, encode_ldd},
+	[OPFMT_STD]      = {2, 1, encode_std},
+	[OPFMT_Z_RD]     = {2, 1, encode_z_rd},
+};
+
+/* Encode instruction mnemonic (as returned by get_mnemonic_type()) with its
+ * count operands into words[]. Operands beyond count are ignored. Relative
+ * branches are encoded against pi->cseg->addr. Returns the number of words
+ * (1 or 2), 0 if an error was reported and nothing should be emitted, or -1
+ * if assembly has to stop. */
+int
+encode_instruction(struct prog_info *pi, int mnemonic, const struct token operands[], int count, int words[2])
+{
+	const struct operand_format *format = &operand_formats[instruction_list[mnemonic].format];
+	struct token op[2] = {{NULL, 0, TOKEN_END}, {NULL, 0, TOKEN_END}};
+	struct encoding enc = {mnemonic, 0, 0, 1};
+	char temp[MAX_MNEMONIC_LEN + 1];
+	int i;
+
+	if (count < format->operands) {
+		print_msg(pi, MSGTYPE_ERROR, count ? "%s needs a second operand" : "%s needs an operand",
+		          instruction_list[mnemonic].mnemonic);
+		return (0);
+	}
+	for (i = 0; (i < count) && (i < 2); i++)
+		op[i] = operands[i];
+	switch (format->encode(pi, &enc, op)) {
+	case ENCODE_FATAL:
+		return (-1);
+	case ENCODE_SKIP:
+		return (0);
+	}
+	if (pi->device->flag & instruction_list[enc.mnemonic].flag)	{
+		strncpy(temp, instruction_list[enc.mnemonic].mnemonic, MAX_MNEMONIC_LEN);
+		temp[MAX_MNEMONIC_LEN] = '\0';
+		print_msg(pi, MSGTYPE_ERROR, "%s instruction is not supported on %s",
+		          my_strupr(temp), pi->device->name);
+	}
+	words[0] = enc.opcode | instruction_list[enc.mnemonic].opcode;
+	words[1] = enc.opcode2;
+	return (enc.words);
+}
+
+/* JMP, CALL and the conditional branches are sized by --relax */
+static int
+relaxable(struct prog_info *pi, int mnemonic)
+{
+	int format = instruction_list[mnemonic].format;
+
+	return (pi->relax && ((format == OPFMT_JMP) || (format == OPFMT_BRANCH) || (format == OPFMT_S_BRANCH)));
+}
+
+/* CPSE, SBRC, SBRS, SBIC and SBIS skip the next instruction, so a branch
+ * after them can't be turned into two */
+static int
+is_skip(int mnemonic)
+{
+	return ((mnemonic == MNEMONIC_CPSE) || (mnemonic == MNEMONIC_SBRC) || (mnemonic == MNEMONIC_SBRS)
+	        || (mnemonic == MNEMONIC_SBIC) || (mnemonic == MNEMONIC_SBIS));
+}
+
+/* Relative jump k in reach of RJMP and RCALL, see encode_rjmp() */
+static int
+rjmp_reach(struct prog_info *pi, int k)
+{
+	return (((k >= -2048) && (k <= 2047)) || (pi->device->flash_size == 4096));
+}
+
+/* Encode a JMP, CALL or conditional branch of --relax in the words of its
+ * site. While relax() settles the code the site grows to the size its
+ * target needs: RJMP or RCALL for a target in reach, else JMP or CALL. A
+ * branch out of reach becomes the inverted branch over an RJMP, or over a
+ * JMP. Devices without JMP only get the relative forms, which report the
+ * targets out of reach. */
+static int
+encode_relaxed(struct prog_info *pi, int mnemonic, struct relax_site *site,
+               const struct token operands[], int count, int words[3])
+{
+	int format = instruction_list[mnemonic].format;
+	const struct token *target = &operands[(format == OPFMT_S_BRANCH) ? 1 : 0];
+	int no_jmp = pi->device->flag & DF_NO_JMP;
+	int i, k, needed, bit = 0;
+
+	if (count < operand_formats[format].operands)
+		return (encode_instruction(pi, mnemonic, operands, count, words));
+	if (!get_expr_token(pi, target, &i))
+		return (-1);
+	k = i - (pi->cseg->addr + 1);
+	if (site->jump)
+		needed = (no_jmp || rjmp_reach(pi, k)) ? 1 : 2;
+	else if (((k >= -64) && (k <= 63)) || site->fixed)
+		needed = 1;
+	else
+		needed = (no_jmp || rjmp_reach(pi, k - 1)) ? 2 : 3;
+	if (pi->relaxing && (needed > site->words)) {
+		site->words = needed;
+		pi->relax_changed = True;
+	}
+	if (site->jump) {
+		if (site->words == 1)
+			mnemonic = (mnemonic == MNEMONIC_JMP) ? MNEMONIC_RJMP : MNEMONIC_RCALL;
+		return (encode_instruction(pi, mnemonic, operands, count, words));
+	}
+	if (site->words == 1)
+		return (encode_instruction(pi, mnemonic, operands, count, words));
+	if ((format == OPFMT_S_BRANCH) && !get_bitnum(pi, &operands[0], &bit))
+		return (-1);
+	/* BRBS and BRBC differ in bit 10, and skip the jump after them */
+	words[0] = (instruction_list[mnemonic].opcode ^ 0x0400) | bit | ((site->words - 1) << 3);
+	pi->cseg->addr++;
+	i = encode_instruction(pi, (site->words == 2) ? MNEMONIC_RJMP : MNEMONIC_JMP, target, 1, &words[1]);
+	pi->cseg->addr--;
+	return ((i > 0) ? i + 1 : i);
+}
 
 /* We try to parse the command name. Is it a assembler mnemonic or anything else ?
  * If so, it may be a macro. */
 
 int
-parse_mnemonic(struct prog_info *pi)
+parse_mnemonic(struct prog_info *pi, const char *line)
 {
 	int mnemonic;
+	int count = 0;
+	int words;
 	int i;
-	int opcode = 0;
-	int opcode2 = 0;
-	int instruction_long = False;
-	char *operand1;
-	char *operand2;
+	int opcode[3];
+	int len;
+	const char *rest;
+	const char *next;
+	struct token operands[2];
 	struct macro *macro;
-	char temp[MAX_MNEMONIC_LEN + 1];
+	struct relax_site *site = NULL;
+	int skip_before = pi->skip_before;
 
-	operand1 = get_next_token(pi->fi->scratch, TERM_SPACE);  /* we get the first word on line */
-	mnemonic = get_mnemonic_type(pi);
+	/* we get the first word on line, and the rest of the line after it */
+	for (len = 0; !IS_HOR_SPACE(line[len]) && !IS_END_OR_COMMENT(line[len]); len++);
+	for (rest = &line[len]; IS_HOR_SPACE(*rest); rest++);
+	if (IS_END_OR_COMMENT(*rest))
+		rest = NULL;
+	mnemonic = get_mnemonic_type(line, len);
 	if (mnemonic == -1) {				/* if -1 this must be a macro name */
-		macro = get_macro(pi, pi->fi->scratch); /* and so, we try to get the corresponding macro struct. */
+		macro = get_macro(pi, line, len); /* and so, we try to get the corresponding macro struct. */
 		if (macro) {
-			return (expand_macro(pi, macro, operand1)); /* we expand the macro */
+			return (expand_macro(pi, macro, rest)); /* we expand the macro */
 		} else { 				/* if we cant find a name, this is a unknown word. */
-			print_msg(pi, MSGTYPE_ERROR, "Unknown mnemonic/macro: %s", pi->fi->scratch);
+			print_msg(pi, MSGTYPE_ERROR, "Unknown mnemonic/macro: %.*s", len, line);
 			return (True);
 		}
 	}
-	if (pi->pass == PASS_2) {
-		if (mnemonic <= MNEMONIC_BREAK) {
-			if (operand1) {
-				print_msg(pi, MSGTYPE_WARNING, "Garbage after instruction %s: %s", instruction_list[mnemonic].mnemonic, operand1);
-			}
-			opcode = 0;			/* No operand */
-		} else if (mnemonic <= MNEMONIC_ELPM) {
-			if (operand1) {
-				operand2 = get_next_token(operand1, TERM_COMMA);
-				if (!operand2) {
-					print_msg(pi, MSGTYPE_ERROR, "%s needs a second operand", instruction_list[mnemonic].mnemonic);
-					return (True);
-				}
-				get_next_token(operand2, TERM_END);
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				i = get_indirect(pi, operand2);
-				if (i == 6) { /* Means Z */
-					if (mnemonic == MNEMONIC_LPM)
-						mnemonic = MNEMONIC_LPM_Z;
-					else if (mnemonic == MNEMONIC_ELPM)
-						mnemonic = MNEMONIC_ELPM_Z;
-				} else if (i == 7) { /* Means Z+ */
-					if (mnemonic == MNEMONIC_LPM)
-						mnemonic = MNEMONIC_LPM_ZP;
-					else if (mnemonic == MNEMONIC_ELPM)
-						mnemonic = MNEMONIC_ELPM_ZP;
-				} else {
-					print_msg(pi, MSGTYPE_ERROR, "Unsupported operand: %s", operand2);
-					return (True);
-				}
-			} else
-				opcode = 0;
-		} else {
-			if (!operand1) {
-				print_msg(pi, MSGTYPE_ERROR, "%s needs an operand", instruction_list[mnemonic].mnemonic);
-				return (True);
-			}
-			operand2 = get_next_token(operand1, TERM_COMMA);
-			if (mnemonic >= MNEMONIC_BRBS) {
-				if (!operand2) {
-					print_msg(pi, MSGTYPE_ERROR, "%s needs a second operand", instruction_list[mnemonic].mnemonic);
-					return (True);
-				}
-				get_next_token(operand2, TERM_END);
-			}
-			if (mnemonic <= MNEMONIC_BCLR) {
-				if (!get_bitnum(pi, operand1, &i))
-					return (False);
-				opcode = i << 4;
-			} else if (mnemonic <= MNEMONIC_ROL) {
-				i = get_register(pi, operand1);
-				if ((mnemonic == MNEMONIC_SER) && (i < 16)) {
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", instruction_list[mnemonic].mnemonic);
-					i &= 0x0f;
-				}
-				opcode = i << 4;
-				if (mnemonic >= MNEMONIC_TST)
-					opcode |= ((i & 0x10) << 5) | (i & 0x0f);
-			} else if (mnemonic <= MNEMONIC_RCALL) {
-				if (!get_expr(pi, operand1, &i))
-					return (False);
-				i -= pi->cseg->addr + 1;
-				if (mnemonic <= MNEMONIC_BRID) {
-					if ((i < -64) || (i > 63))
-						print_msg(pi, MSGTYPE_ERROR, "Branch out of range (-64 <= k <= 63)");
-					opcode = (i & 0x7f) << 3;
-				} else {
-					if (((i < -2048) || (i > 2047)) && (pi->device->flash_size != 4096))
-						print_msg(pi, MSGTYPE_ERROR, "Relative address out of range (-2048 <= k <= 2047)");
-					opcode = i & 0x0fff;
-				}
-			} else if (mnemonic <= MNEMONIC_CALL) {
-				if (!get_expr(pi, operand1, &i))
-					return (False);
-				if ((i < 0) || (i > 4194303))
-					print_msg(pi, MSGTYPE_ERROR, "Address out of range (0 <= k <= 4194303)");
-				opcode = ((i & 0x3e0000) >> 13) | ((i & 0x010000) >> 16);
-				opcode2 = i & 0xffff;
-				instruction_long = True;
-			} else if (mnemonic <= MNEMONIC_BRBC) {
-				if (!get_bitnum(pi, operand1, &i))
-					return (False);
-				opcode = i;
-				if (!get_expr(pi, operand2, &i))
-					return (False);
-				i -= pi->cseg->addr + 1;
-				if ((i < -64) || (i > 63))
-					print_msg(pi, MSGTYPE_ERROR, "Branch out of range (-64 <= k <= 63)");
-				opcode |= (i & 0x7f) << 3;
-			} else if (mnemonic <= MNEMONIC_MUL) {
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				i = get_register(pi, operand2);
-				opcode |= ((i & 0x10) << 5) | (i & 0x0f);
-			} else if (mnemonic <= MNEMONIC_MOVW) {
-				i = get_register(pi, operand1);
-				/* Optimization: use bitwise AND for parity check instead of modulo */
-				if ((i & 1) == 1)
-					print_msg(pi, MSGTYPE_ERROR, "%s must use a even numbered register for Rd", instruction_list[mnemonic].mnemonic);
-				opcode = (i >> 1) << 4;  /* Optimization: use bit shift for division by 2 */
-				i = get_register(pi, operand2);
-				if ((i & 1) == 1)
-					print_msg(pi, MSGTYPE_ERROR, "%s must use a even numbered register for Rr", instruction_list[mnemonic].mnemonic);
-				opcode |= i >> 1;  /* Optimization: use bit shift for division by 2 */
-			} else if (mnemonic <= MNEMONIC_MULS) {
-				i = get_register(pi, operand1);
-				if (i < 16)
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", instruction_list[mnemonic].mnemonic);
-				opcode = (i & 0x0f) << 4;
-				i = get_register(pi, operand2);
-				if (i < 16)
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", instruction_list[mnemonic].mnemonic);
-				opcode |= (i & 0x0f);
-			} else if (mnemonic <= MNEMONIC_FMULSU) {
-				i = get_register(pi, operand1);
-				if ((i < 16) || (i >= 24))
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use registers (r16 - r23)", instruction_list[mnemonic].mnemonic);
-				opcode = (i & 0x07) << 4;
-				i = get_register(pi, operand2);
-				if ((i < 16) || (i >= 24))
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use registers (r16 - r23)", instruction_list[mnemonic].mnemonic);
-				opcode |= (i & 0x07);
-			} else if (mnemonic <= MNEMONIC_SBIW) {
-				i = get_register(pi, operand1);
-				if (!((i == 24) || (i == 26) || (i == 28) || (i == 30)))
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use registers R24, R26, R28 or R30", instruction_list[mnemonic].mnemonic);
-				opcode = ((i - 24) >> 1) << 4;  /* Optimization: use bit shift for division by 2 */
-				if (!get_expr(pi, operand2, &i))
-					return (False);
-				if ((i < 0) || (i > 63))
-					print_msg(pi, MSGTYPE_ERROR, "Constant out of range (0 <= k <= 63)");
-				opcode |= ((i & 0x30) << 2) | (i & 0x0f);
-			} else if (mnemonic <= MNEMONIC_CBR) {
-				i = get_register(pi, operand1);
-				if (i < 16)
-					print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", instruction_list[mnemonic].mnemonic);
-				opcode = (i & 0x0f) << 4;
-				if (!get_expr(pi, operand2, &i))
-					return (False);
-				if ((i < -128) || (i > 255))
-					print_msg(pi, MSGTYPE_WARNING, "Constant out of range (-128 <= k <= 255). Will be masked");
-				if (mnemonic == MNEMONIC_CBR)
-					i = ~i;
-				opcode |= ((i & 0xf0) << 4) | (i & 0x0f);
-			} else if (mnemonic <= MNEMONIC_BLD) {
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				if (!get_bitnum(pi, operand2, &i))
-					return (False);
-				opcode |= i;
-			} else if (mnemonic == MNEMONIC_IN) {
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				if (!get_expr(pi, operand2, &i))
-					return (False);
-				if ((i < 0) || (i > 63))
-					print_msg(pi, MSGTYPE_ERROR, "I/O out of range (0 <= P <= 63)");
-				opcode |= ((i & 0x30) << 5) | (i & 0x0f);
-			} else if (mnemonic == MNEMONIC_OUT) {
-				if (!get_expr(pi, operand1, &i))
-					return (False);
-				if ((i < 0) || (i > 63))
-					print_msg(pi, MSGTYPE_ERROR, "I/O out of range (0 <= P <= 63)");
-				opcode = ((i & 0x30) << 5) | (i & 0x0f);
-				i = get_register(pi, operand2);
-				opcode |= i << 4;
-			} else if (mnemonic <= MNEMONIC_CBI) {
-				if (!get_expr(pi, operand1, &i))
-					return (False);
-				if ((i < 0) || (i > 31))
-					print_msg(pi, MSGTYPE_ERROR, "I/O out of range (0 <= P <= 31)");
-				opcode = i << 3;
-				if (!get_bitnum(pi, operand2, &i))
-					return (False);
-				opcode |= i;
-			} else if (mnemonic == MNEMONIC_LDS) {
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				/* AVR8L has one word LDS. High nibble of k in funny order */
-				if (pi->device->flag & DF_AVR8L) {
-					mnemonic = MNEMONIC_LDS_AVR8L;
-					opcode &= 0x00f0;
-				}
-				if (!get_expr(pi, operand2, &i))
-					return (False);
-				if (pi->device->flag & DF_AVR8L) {
-					if ((i < 0x40) || (i > 0xbf))
-						print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0x40 <= k <= 0xbf)");
-					opcode |= ((i & 0x40) << 2) | ((i & 0x30) << 5) | (i & 0x0f);
-				} else {
-					if ((i < 0) || (i > 65535))
-						print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0 <= k <= 65535)");
-					opcode2 = i;
-					instruction_long = True;
-				}
-			} else if (mnemonic == MNEMONIC_STS) {
-				if (!get_expr(pi, operand1, &i))
-					return (False);
-				/* AVR8L has one word STS. High nibble of k in funny order */
-				if (pi->device->flag & DF_AVR8L) {
-					mnemonic = MNEMONIC_STS_AVR8L;
-					if ((i < 0x40) || (i > 0xbf))
-						print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0x40 <= k <= 0xbf)");
-					opcode |= ((i & 0x40) << 2) | ((i & 0x30) << 5) | (i & 0x0f);
-				} else {
-					if ((i < 0) || (i > 65535))
-						print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0 <= k <= 65535)");
-					opcode2 = i;
-					instruction_long = True;
-				}
-				i = get_register(pi, operand2);
-				if (pi->device->flag & DF_AVR8L)
-					opcode |= ((i << 4) & 0x00f0);
-				else
-					opcode = i << 4;
-			} else if (mnemonic == MNEMONIC_LD) {
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				mnemonic = MNEMONIC_LD_X + get_indirect(pi, operand2);
-			} else if (mnemonic == MNEMONIC_ST) {
-				mnemonic = MNEMONIC_ST_X + get_indirect(pi, operand1);
-				i = get_register(pi, operand2);
-				opcode = i << 4;
-			} else if (mnemonic == MNEMONIC_LDD) {
-				i = get_register(pi, operand1);
-				opcode = i << 4;
-				if (tolower(operand2[0]) == 'z')
-					mnemonic = MNEMONIC_LDD_Z;
-				else if (tolower(operand2[0]) == 'y')
-					mnemonic = MNEMONIC_LDD_Y;
-				else
-					print_msg(pi, MSGTYPE_ERROR, "Garbage in second operand (%s)", operand2);
-				for (i = 1; (operand2[i] != '\0') && (operand2[i] != '+'); i++);
-				if (operand2[i] == '\0')	{
-					print_msg(pi, MSGTYPE_ERROR, "Garbage in second operand (%s)", operand2);
-					return (False);
-				}
-				if (!get_expr(pi, &operand2[i + 1], &i))
-					return (False);
-				if ((i < 0) || (i > 63))
-					print_msg(pi, MSGTYPE_ERROR, "Displacement out of range (0 <= q <= 63)");
-				opcode |= ((i & 0x20) << 8) | ((i & 0x18) << 7) | (i & 0x07);
-			} else if (mnemonic == MNEMONIC_STD) {
-				if (tolower(operand1[0]) == 'z')
-					mnemonic = MNEMONIC_STD_Z;
-				else if (tolower(operand1[0]) == 'y')
-					mnemonic = MNEMONIC_STD_Y;
-				else
-					print_msg(pi, MSGTYPE_ERROR, "Garbage in first operand (%s)", operand1);
-				for (i = 1; (operand1[i] != '\0') && (operand1[i] != '+'); i++);
-				if (operand1[i] == '\0')	{
-					print_msg(pi, MSGTYPE_ERROR, "Garbage in first operand (%s)", operand1);
-					return (False);
-				}
-				if (!get_expr(pi, &operand1[i + 1], &i))
-					return (False);
-				if ((i < 0) || (i > 63))
-					print_msg(pi, MSGTYPE_ERROR, "Displacement out of range (0 <= q <= 63)");
-				opcode = ((i & 0x20) << 8) | ((i & 0x18) << 7) | (i & 0x07);
-				i = get_register(pi, operand2);
-				opcode |= i << 4;
-		} else if (mnemonic >= MNEMONIC_XCH && mnemonic <= MNEMONIC_LAT) {
-			/* RMW instructions: XCH, LAS, LAC, LAT Z,Rd */
-			/* First operand should be Z register */
-			i = get_indirect(pi, operand1);
-			if (i != 6) { /* 6 = Z register for indirect addressing */
-				print_msg(pi, MSGTYPE_ERROR, "%s only supports Z register addressing", instruction_list[mnemonic].mnemonic);
-			}
-			/* Second operand is the destination register */
-			i = get_register(pi, operand2);
-			opcode = i << 4;
-			} else
-				print_msg(pi, MSGTYPE_ERROR, "Shit! Missing opcode check [%d]...", mnemonic);
-		}
-		if (pi->device->flag & instruction_list[mnemonic].flag)	{
-			strncpy(temp, instruction_list[mnemonic].mnemonic, MAX_MNEMONIC_LEN);
-			print_msg(pi, MSGTYPE_ERROR, "%s instruction is not supported on %s",
-			          my_strupr(temp), pi->device->name);
-		}
-		opcode |= instruction_list[mnemonic].opcode;
-		if (pi->list_on && pi->list_line) {
-			if (instruction_long)
-				fprintf(pi->list_file, "%c:%06lx %04x %04x %s\n",
-				        pi->cseg->ident, pi->cseg->addr, opcode, opcode2, pi->list_line);
-			else
-				fprintf(pi->list_file, "%c:%06lx %04x      %s\n",
-				        pi->cseg->ident, pi->cseg->addr, opcode, pi->list_line);
-			pi->list_line = NULL;
-		}
-		if (pi->cseg->hfi) {
-			write_prog_word(pi, pi->cseg->addr, opcode);
-			if (instruction_long)
-				write_prog_word(pi, pi->cseg->addr + 1, opcode2);
-		}
-		if (instruction_long)
-			pi->cseg->addr += 2; /* XXX advance */
+	pi->skip_before = is_skip(mnemonic);
+	if (relaxable(pi, mnemonic) && ((site = relax_site(pi)) == NULL))
+		return (False);
+	if (pi->pass == PASS_1) {
+		if (site) {
+			site->jump = (instruction_list[mnemonic].format == OPFMT_JMP);
+			site->fixed = skip_before;
+			words = site->words;
+		} else if (pi->device->flag & DF_AVR8L)
+			words = 1;
 		else
-			pi->cseg->addr ++;
-	} else { /* Pass 1 */
-		if (pi->device->flag & DF_AVR8L)
-			mnemonic = MNEMONIC_LDS_AVR8L;
-		if ((mnemonic == MNEMONIC_JMP) || (mnemonic == MNEMONIC_CALL)
-		        || (mnemonic == MNEMONIC_LDS) || (mnemonic == MNEMONIC_STS)) {
-			pi->cseg->addr += 2;
-			pi->cseg->count += 2;
+			words = operand_formats[instruction_list[mnemonic].format].words;
+		pi->cseg->addr += words;
+		pi->cseg->count += words;
+		return (True);
+	}
+	if (rest) {
+		if (instruction_list[mnemonic].format == OPFMT_NONE) {
+			print_msg(pi, MSGTYPE_WARNING, "Garbage after instruction %s: %s", instruction_list[mnemonic].mnemonic, rest);
 		} else {
-			pi->cseg->addr++;
-			pi->cseg->count++;
+			next = get_operand(rest, &operands[count++]);
+			if (next)
+				get_operand(next, &operands[count++]);
 		}
 	}
+	if (site)
+		words = encode_relaxed(pi, mnemonic, site, operands, count, opcode);
+	else
+		words = encode_instruction(pi, mnemonic, operands, count, opcode);
+	if (words < 0)
+		return (False);
+	if (words == 0) {
+		/* The error is reported, but the code after it keeps its place */
+		pi->cseg->addr += site ? site->words : 0;
+		return (True);
+	}
+	list_code(pi, pi->cseg, (words > 2) ? 2 : words, opcode);
+	if (pi->cseg->hfi) {
+		for (i = 0; i < words; i++)
+			write_prog_word(pi, pi->cseg->addr + i, opcode[i]);
+	}
+	pi->cseg->addr += words;
+	if (words > 2) {
+		/* The second word of the JMP after an inverted branch */
+		pi->cseg->addr--;
+		list_word(pi, pi->cseg, opcode[2]);
+		pi->cseg->addr++;
+	}
 	return (True);
 }
 
+/* Look up the n character mnemonic at name. Only the first MNEMONIC_COUNT
+ * entries are real mnemonics, the rest are the internal variants. */
 int
-get_mnemonic_type(struct prog_info *pi)
+get_mnemonic_type(const char *name, int len)
 {
-	char *mnemonic;
-
-	mnemonic = my_strlwr(pi->fi->scratch);
-
 	/* Optimization: use pointer-based traversal instead of array indexing */
 	const struct instruction *instr = instruction_list;
-	int index = 0;
-	while (instr->mnemonic != NULL) {
-		if (!strcmp(mnemonic, instr->mnemonic)) {
+	int index;
+
+	if (len > MAX_MNEMONIC_LEN)
+		return (-1);
+	for (index = 0; index < MNEMONIC_COUNT; index++, instr++) {
+		if (!nocase_strcmp_n(instr->mnemonic, name, len))
 			return (index);
-		}
-		instr++;
-		index++;
 	}
 	return (-1);
 }
 
 
 int
-get_register(struct prog_info *pi, char *data)
+get_register(struct prog_info *pi, const struct token *tok)
 {
-	char *second_reg;
+	const char *data = tok->start;
+	int len = tok->len;
+	int i;
 	int reg = 0;
 	struct def *def;
+	struct token name;
 
 	/* Check for any occurence of r1:r0 pairs, and if so skip to second register */
-	second_reg = strchr(data, ':');
-	if (second_reg != NULL)
-		data = second_reg + 1;
-
-	/* Optimization: check cache for recently accessed register definitions */
-	if (pi->cached_register_def && pi->cached_register_name &&
-	    !nocase_strcmp(pi->cached_register_name, data)) {
-		return (pi->cached_register_def->reg);
-	}
-
-	/* Linear search through defined registers */
-	for (def = pi->first_def; def; def = def->next)
-		if (!nocase_strcmp(def->name, data)) {
-			/* Cache this result for future lookups */
-			pi->cached_register_def = def;
-			pi->cached_register_name = data;
-			reg = def->reg;
-			return (reg);
+	for (i = 0; i < len; i++)
+		if (data[i] == ':') {
+			data += i + 1;
+			len -= i + 1;
+			break;
 		}
-	if ((tolower(data[0]) == 'r') && isdigit(data[1])) {
-		reg = atoi(&data[1]);
+	name.start = data;
+	name.len = len;
+
+	reg = literal_register(data, len);
+	if (reg != -1)
+		return (reg);
+	reg = 0;
+	def = get_def(pi, data, len);
+	if (def)
+		return (def->reg);
+	if ((tolower(TOKEN_AT(&name, 0)) == 'r') && isdigit(TOKEN_AT(&name, 1))) {
+		for (i = 1; isdigit(TOKEN_AT(&name, i)); i++)
+			reg = reg * 10 + (data[i] - '0');
 		if (reg > 31)
 			print_msg(pi, MSGTYPE_ERROR, "R%d is not a valid register", reg);
 		return (reg);
 	}
-	if (data[1] != '\0') {
-		print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", data);
+	if (TOKEN_AT(&name, 1) != '\0') {
+		print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", len, data);
 	}
-	switch (data[0]) {
+	switch (TOKEN_AT(&name, 0)) {
 	case 'x':
 		reg = 26;
 		break;
@@ -760,7 +1126,7 @@ get_register(struct prog_info *pi, char *data)
 		reg = 30;
 		break;
 	default:
-		print_msg(pi, MSGTYPE_ERROR, "No register associated with %s", data);
+		print_msg(pi, MSGTYPE_ERROR, "No register associated with %.*s", len, data);
 	}
 	if ((reg < 16) && (pi->device->flag & DF_AVR8L))
 		print_msg(pi, MSGTYPE_ERROR, "%s can only use a high registers (r16 - r31)", pi->device->name);
@@ -768,10 +1134,39 @@ get_register(struct prog_info *pi, char *data)
 	return (reg);
 }
 
+/* Return the register number of a literal r0 - r31, x, y or z of n
+ * characters, or -1. Register aliases are not consulted. */
+int
+literal_register(const char *name, int len)
+{
+	int reg;
+
+	if (len == 1) {
+		switch (name[0]) {
+		case 'x':
+			return (26);
+		case 'y':
+			return (28);
+		case 'z':
+			return (30);
+		}
+		return (-1);
+	}
+	if ((len > 3) || ((name[0] != 'r') && (name[0] != 'R')) || !isdigit(name[1]))
+		return (-1);
+	reg = name[1] - '0';
+	if (len == 3) {
+		if (!isdigit(name[2]))
+			return (-1);
+		reg = reg * 10 + (name[2] - '0');
+	}
+	return ((reg < 32) ? reg : -1);
+}
+
 int
-get_bitnum(struct prog_info *pi, char *data, int *ret)
+get_bitnum(struct prog_info *pi, const struct token *tok, int *ret)
 {
-	if (!get_expr(pi, data, ret))
+	if (!get_expr_token(pi, tok, ret))
 		return (False);
 	if ((*ret < 0) || (*ret > 7)) {
 		print_msg(pi, MSGTYPE_ERROR, "Operand out of range (0 <= s <= 7)");
@@ -782,16 +1177,16 @@ get_bitnum(struct prog_info *pi, char *data, int *ret)
 
 
 int
-get_indirect(struct prog_info *pi, char *operand)
+get_indirect(struct prog_info *pi, const struct token *tok)
 {
 	int i = 1;
 
-	switch (tolower(operand[0])) {
+	switch (tolower(TOKEN_AT(tok, 0))) {
 	case '-':
-		while (IS_HOR_SPACE(operand[i])) i++;
-		if (operand[i + 1] != '\0')
-			print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", operand);
-		switch (tolower(operand[i])) {
+		while (IS_HOR_SPACE(TOKEN_AT(tok, i))) i++;
+		if (TOKEN_AT(tok, i + 1) != '\0')
+			print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", tok->len, tok->start);
+		switch (tolower(TOKEN_AT(tok, i))) {
 		case 'x':
 			if (pi->device->flag & DF_NO_XREG)
 				print_msg(pi, MSGTYPE_ERROR, "X register is not supported on %s", pi->device->name);
@@ -803,48 +1198,48 @@ get_indirect(struct prog_info *pi, char *operand)
 		case 'z':
 			return (8);
 		default:
-			print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", operand);
+			print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", tok->len, tok->start);
 			return (0);
 		}
 	case 'x':
 		if (pi->device->flag & DF_NO_XREG)
 			print_msg(pi, MSGTYPE_ERROR, "X register is not supported on %s", pi->device->name);
-		while (IS_HOR_SPACE(operand[i])) i++;
-		if (operand[i] == '+') {
-			if (operand[i + 1] != '\0')
-				print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", operand);
+		while (IS_HOR_SPACE(TOKEN_AT(tok, i))) i++;
+		if (TOKEN_AT(tok, i) == '+') {
+			if (TOKEN_AT(tok, i + 1) != '\0')
+				print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", tok->len, tok->start);
 			return (1);
-		} else if (operand[i] == '\0')
+		} else if (TOKEN_AT(tok, i) == '\0')
 			return (0);
 		else
-			print_msg(pi, MSGTYPE_ERROR, "Garbage after operand (%s)", operand);
+			print_msg(pi, MSGTYPE_ERROR, "Garbage after operand (%.*s)", tok->len, tok->start);
 		return (0);
 	case 'y':
 		if (pi->device->flag & DF_NO_YREG)
 			print_msg(pi, MSGTYPE_ERROR, "Y register is not supported on %s", pi->device->name);
-		while (IS_HOR_SPACE(operand[i])) i++;
-		if (operand[i] == '+') {
-			if (operand[i + 1] != '\0')
-				print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", operand);
+		while (IS_HOR_SPACE(TOKEN_AT(tok, i))) i++;
+		if (TOKEN_AT(tok, i) == '+') {
+			if (TOKEN_AT(tok, i + 1) != '\0')
+				print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", tok->len, tok->start);
 			return (4);
-		} else if (operand[i] == '\0')
+		} else if (TOKEN_AT(tok, i) == '\0')
 			return (3);
 		else
-			print_msg(pi, MSGTYPE_ERROR, "Garbage after operand (%s)", operand);
+			print_msg(pi, MSGTYPE_ERROR, "Garbage after operand (%.*s)", tok->len, tok->start);
 		return (0);
 	case 'z':
-		while (IS_HOR_SPACE(operand[i])) i++;
-		if (operand[i] == '+') {
-			if (operand[i + 1] != '\0')
-				print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", operand);
+		while (IS_HOR_SPACE(TOKEN_AT(tok, i))) i++;
+		if (TOKEN_AT(tok, i) == '+') {
+			if (TOKEN_AT(tok, i + 1) != '\0')
+				print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", tok->len, tok->start);
 			return (7);
-		} else if (operand[i] == '\0')
+		} else if (TOKEN_AT(tok, i) == '\0')
 			return (6);
 		else
-			print_msg(pi, MSGTYPE_ERROR, "Garbage after operand (%s)", operand);
+			print_msg(pi, MSGTYPE_ERROR, "Garbage after operand (%.*s)", tok->len, tok->start);
 		return (0);
 	default:
-		print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%s)", operand);
+		print_msg(pi, MSGTYPE_ERROR, "Garbage in operand (%.*s)", tok->len, tok->start);
 	}
 	return (0);
 }
@@ -852,12 +1247,11 @@ get_indirect(struct prog_info *pi, char *operand)
 /* Return 1 if instruction name is supported by the current device,
  * 0 if unsupported, -1 if it is invalid */
 int
-is_supported(struct prog_info *pi, char *name)
+is_supported(struct prog_info *pi, const char *name, int len)
 {
 	int mnemonic;
 
-	strncpy(pi->fi->scratch,name,MAX_MNEMONIC_LEN);
-	mnemonic = get_mnemonic_type(pi);
+	mnemonic = get_mnemonic_type(name, len);
 	if (mnemonic == -1) return -1;
 	if (pi->device->flag & instruction_list[mnemonic].flag) return 0;
 	return 1;
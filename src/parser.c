@@ -81,10 +81,78 @@ fgets_new(struct prog_info *pi, char *s, int size, FILE *stream)
 			ungetc(c,stream);
 		}
 	}
+	if (pi->stats)
+		stats_file_line(pi);
 	return s;
 }
 
 
+/* First include_file of filename, or NULL if it was not read yet */
+struct include_file *
+find_include_file(struct prog_info *pi, const char *filename)
+{
+	struct include_file *include_file;
+
+	include_file = pi->include_hash[nocase_hash(filename, strlen(filename)) & (INCLUDE_HASH_SIZE - 1)];
+	for (; include_file; include_file = include_file->hash_next) {
+		if (!strcmp(include_file->name, filename))
+			break;
+	}
+	return (include_file);
+}
+
+/* Include guard detection. A file is guarded if its first statement is
+ * .IFNDEF symbol and its last statement is the .ENDIF that closes it. */
+enum {
+	GUARD_NONE,	/* Not guarded */
+	GUARD_FIRST,	/* No statement yet */
+	GUARD_OPEN,	/* After the .IFNDEF */
+	GUARD_CLOSED	/* After its .ENDIF */
+};
+
+struct guard {
+	int state;
+	int depth;	/* Conditional depth outside of the .IFNDEF */
+	int endif;	/* The current line is a .ENDIF */
+	char *name;	/* Symbol of the .IFNDEF, freed by parse_file() */
+};
+
+/* Follow line before it is parsed */
+static void
+guard_before(struct prog_info *pi, struct guard *g, const char *line)
+{
+	struct token tok, name;
+	const char *p;
+
+	p = get_token(line, &tok);
+	if (tok.kind == TOKEN_END)
+		return;
+	g->endif = (tok.kind == TOKEN_DIRECTIVE) && (tok.len == 6) && !nocase_strncmp(&tok.start[1], "endif", 5);
+	if (g->state == GUARD_FIRST) {
+		g->state = GUARD_NONE;
+		if ((tok.kind != TOKEN_DIRECTIVE) || (tok.len != 7) || nocase_strncmp(&tok.start[1], "ifndef", 6))
+			return;
+		p = get_token(p, &name);
+		if ((name.kind != TOKEN_IDENT) || (get_token(p, &tok), tok.kind != TOKEN_END)
+		    || ((g->name = malloc(name.len + 1)) == NULL))
+			return;
+		memcpy(g->name, name.start, name.len);
+		g->name[name.len] = '\0';
+		g->state = GUARD_OPEN;
+		g->depth = pi->conditional_depth;
+	} else if (g->state == GUARD_CLOSED)
+		g->state = GUARD_NONE;
+}
+
+/* Follow line after it was parsed */
+static void
+guard_after(struct prog_info *pi, struct guard *g)
+{
+	if ((g->state == GUARD_OPEN) && (pi->conditional_depth <= g->depth))
+		g->state = g->endif ? GUARD_CLOSED : GUARD_NONE;
+	g->endif = False;
+}
+
 /* Parse given assembler file. */
 int
 parse_file(struct prog_info *pi, const char *filename)
@@ -95,13 +163,16 @@ parse_file(struct prog_info *pi, const char *filename)
 	int ok;
 	int loopok;
 	struct file_info *fi;
-	struct include_file *include_file;
+	struct include_file *include_file, *first;
+	struct macro_line *old_macro_line;
+	struct guard guard;
 	ok = True;
 	if ((fi=malloc(sizeof(struct file_info)))==NULL) {
 		print_msg(pi, MSGTYPE_OUT_OF_MEM,NULL);
 		return (False);
 	}
 	pi->fi = fi;
+	STAT_ALLOC(pi, 1, sizeof(struct file_info));
 	if (pi->pass == PASS_1) {
 		if ((include_file = malloc(sizeof(struct include_file)))==NULL) {
 			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
@@ -109,6 +180,10 @@ parse_file(struct prog_info *pi, const char *filename)
 			return (False);
 		}
 		include_file->next = NULL;
+		include_file->spool = NULL;
+		include_file->hash_next = NULL;
+		include_file->opens[PASS_1] = include_file->opens[PASS_2] = 0;
+		include_file->guard = NULL;
 		if (pi->last_include_file) {
 			pi->last_include_file->next = include_file;
 			include_file->num = pi->last_include_file->num + 1;
@@ -123,11 +198,15 @@ parse_file(struct prog_info *pi, const char *filename)
 			return (False);
 		}
 		strcpy(include_file->name, filename);
-	} else { /* PASS 2 */
-		for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
-			if (!strcmp(include_file->name, filename))
-				break;
+		STAT_ALLOC(pi, 2, sizeof(struct include_file) + strlen(filename) + 1);
+		first = find_include_file(pi, filename);
+		if (!first) {
+			first = include_file;
+			include_file->hash_next = pi->include_hash[nocase_hash(filename, strlen(filename)) & (INCLUDE_HASH_SIZE - 1)];
+			pi->include_hash[nocase_hash(filename, strlen(filename)) & (INCLUDE_HASH_SIZE - 1)] = include_file;
 		}
+	} else { /* PASS 2 */
+		first = include_file = find_include_file(pi, filename);
 	}
 	if (!include_file) {
 		print_msg(pi, MSGTYPE_ERROR, "Internal assembler error");
@@ -140,23 +219,38 @@ parse_file(struct prog_info *pi, const char *filename)
 #if debug == 1
 	printf("Opening %s\n",filename);
 #endif
-	if ((fi->fp = fopen(filename, "r"))==NULL) {
+	if ((fi->fp = open_source(pi, include_file))==NULL) {
 		perror(filename);
 		free(fi);
 		return (False);
 	}
+	PROFILE_ENTER(pi, PROFILE_FILE, include_file->num);
+	TRACE_BEGIN(pi, include_file->name, "include");
+	/* Lines come from this file, and its macros are expanded right away */
+	old_macro_line = pi->macro_line;
+	pi->macro_line = NULL;
+	pi->defer_expansion = False;
+	/* The first time a file is read, look for an include guard around it */
+	guard.state = ((pi->pass == PASS_1) && !first->opens[PASS_1]) ? GUARD_FIRST : GUARD_NONE;
+	guard.depth = 0;
+	guard.endif = False;
+	guard.name = NULL;
+	first->opens[pi->pass]++;
 	loopok = True;
 	while (loopok && !fi->exit_file) {
 		if (fgets_new(pi,fi->buff, LINEBUFFER_LENGTH, fi->fp)) {
 			fi->line_number++;
 			pi->list_line = fi->buff;
+			if (guard.state != GUARD_NONE)
+				guard_before(pi, &guard, fi->buff);
 			ok = parse_line(pi, fi->buff);
+			if (guard.state != GUARD_NONE)
+				guard_after(pi, &guard);
 #if debug == 1
 			printf("parse_line was %i\n", ok);
 #endif
 			if (ok) {
-				if ((pi->pass == PASS_2) && pi->list_line && pi->list_on)
-					fprintf(pi->list_file, "         %s\n", pi->list_line);
+				list_source(pi, LIST_INDENT_SHORT);
 				if (pi->error_count >= pi->max_errors) {
 					print_msg(pi, MSGTYPE_MESSAGE, "Maximum error count reached. Exiting...");
 					loopok = False;
@@ -172,8 +266,18 @@ parse_file(struct prog_info *pi, const char *filename)
 			}
 		}
 	}
+	if ((guard.state == GUARD_CLOSED) && ok && !fi->exit_file) {
+		first->guard = guard.name;
+		first->guard_opens = first->opens[PASS_1];
+		guard.name = NULL;
+	}
+	free(guard.name);
+	TRACE_END(pi, include_file->name, "include");
+	PROFILE_EXIT(pi);
+	pi->macro_line = old_macro_line;
 	fclose(fi->fp);
 	free(fi);
+	pi->fi = NULL;	/* .INCLUDE restores its own file */
 	return (ok);
 }
 
@@ -182,14 +286,16 @@ int
 parse_line(struct prog_info *pi, char *line)
 {
 	char *ptr=NULL;
+	const char *rest;
 	int k;
-	int flag=0, i;
+	int flag=0;
 	int global_label = False;
-	char temp[LINEBUFFER_LENGTH];
 	struct label *label = NULL;
-	struct macro_call *macro_call;
+	char *name;
 	int len;
 
+	STAT_COUNT(pi, lines[pi->pass]);
+	PROFILE_LINE(pi);
 	while (IS_HOR_SPACE(*line)) line++;			/* At first remove leading spaces / tabs */
 	if (IS_END_OR_COMMENT(*line))				/* Skip comment line or empty line */
 		return (True);
@@ -197,12 +303,12 @@ parse_line(struct prog_info *pi, char *line)
 	/* .stabs sometimes contains colon : symbol - might be interpreted as label */
 	if (*line == '.') {					/* minimal slowdown of existing code */
 		if (strncmp(line,".stabs ",7) == 0) {		/* compiler output is always lower case */
-			strcpy(temp,line);			/* TODO : Do we need this temp variable ? Please check */
-			return parse_stabs(pi, temp);
+			strcpy(pi->fi->scratch,line);		/* parse_stabs() tokenizes in place */
+			return parse_stabs(pi, pi->fi->scratch);
 		}
 		if (strncmp(line,".stabn ",7) == 0) {
-			strcpy(temp,line);
-			return parse_stabn(pi, temp);
+			strcpy(pi->fi->scratch,line);
+			return parse_stabn(pi, pi->fi->scratch);
 		}
 	}
 	/* Meta information translation - Optimized with early character check */
@@ -263,84 +369,131 @@ parse_line(struct prog_info *pi, char *line)
 		}
 	}
 
-	strcpy(pi->fi->scratch,line);
-
-	for (i = 0; IS_LABEL(pi->fi->scratch[i]) || (pi->fi->scratch[i] == ':'); i++)
-		if (pi->fi->scratch[i] == ':') {	/* it is a label */
-			pi->fi->scratch[i] = '\0';
-			if (pi->pass == PASS_1) {
-				for (macro_call = pi->macro_call; macro_call; macro_call = macro_call->prev_on_stack) {
-					for (label = pi->macro_call->first_label; label; label = label->next) {
-						if (!nocase_strcmp(label->name, &pi->fi->scratch[0])) {
-							print_msg(pi, MSGTYPE_ERROR, "Can't redefine local label %s", &pi->fi->scratch[0]);
-							break;
-						}
-					}
-				}
-				if (test_label(pi,&pi->fi->scratch[0],"Can't redefine label %s")!=NULL)
-					break;
-				if (test_variable(pi,&pi->fi->scratch[0],"%s have already been defined as a .SET variable")!=NULL)
-					break;
-				if (test_constant(pi,&pi->fi->scratch[0],"%s has already been defined as a .EQU constant")!=NULL)
-					break;
+	/* A name immediately followed by ':' is a label definition */
+	for (rest = line; IS_LABEL(*rest); rest++);
+	if ((rest > line) && (*rest == ':')) {
+		if (pi->pass == PASS_1) {
+			name = malloc_strncpy(line, rest - line);
+			if (!name) {
+				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+				return (False);
+			}
+			/* A macro may reuse the local labels of its callers */
+			if (pi->macro_call && find_label(pi, name, pi->macro_call))
+				print_msg(pi, MSGTYPE_ERROR, "Can't redefine local label %s", name);
+			label = NULL;
+			if ((test_label(pi,name,"Can't redefine label %s")!=NULL)
+			        || (test_variable(pi,name,"%s have already been defined as a .SET variable")!=NULL)
+			        || (test_constant(pi,name,"%s has already been defined as a .EQU constant")!=NULL)) {
+				free(name);
+			} else {
 				label = malloc(sizeof(struct label));
 				if (!label) {
+					free(name);
 					print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
 					return (False);
 				}
-				label->next = NULL;
-				label->name = malloc(strlen(&pi->fi->scratch[0]) + 1);
-				if (!label->name) {
-					print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-					return (False);
-				}
-				strcpy(label->name, &pi->fi->scratch[0]);
+				STAT_ALLOC(pi, 2, sizeof(struct label) + (rest - line) + 1);
+				label->name = name;
 				label->value = pi->segment->addr;
-
-				if (pi->macro_call && !global_label) {
-					if (pi->macro_call->last_label)
-						pi->macro_call->last_label->next = label;
-					else
-						pi->macro_call->first_label = label;
-					pi->macro_call->last_label = label;
-				} else {
-					if (pi->last_label)
-						pi->last_label->next = label;
-					else
-						pi->first_label = label;
-					pi->last_label = label;
-				}
+				add_label(pi, label, global_label ? NULL : pi->macro_call);
 			}
-			i++;
-			while (IS_HOR_SPACE(pi->fi->scratch[i]) && !IS_END_OR_COMMENT(pi->fi->scratch[i])) i++;
-			if (IS_END_OR_COMMENT(pi->fi->scratch[i])) {
-				if ((pi->pass == PASS_2) && pi->list_on) { /* Diff tilpassing */
-					fprintf(pi->list_file, "          %s\n", pi->list_line);
-					pi->list_line = NULL;
-				}
-				return (True);
+		} else if (pi->relaxing) {
+			/* The label moves with the code sized by relax() */
+			*(char *)rest = '\0';
+			label = find_label(pi, line, global_label ? NULL : pi->macro_call);
+			*(char *)rest = ':';
+			if (label && (label->value != pi->segment->addr)) {
+				label->value = pi->segment->addr;
+				pi->relax_changed = True;
 			}
-			/* Optimization: pre-calculate length instead of calling strlen twice */
-		char *src = &pi->fi->scratch[i];
-		size_t src_len = strlen(src) + 1;
-		memmove(pi->fi->scratch, src, src_len);
-			break;
+			label = NULL;
+		}
+		line = (char *)rest + 1;
+		while (IS_HOR_SPACE(*line)) line++;
+		if (IS_END_OR_COMMENT(*line)) {
+			list_source(pi, LIST_INDENT);
+			return (True);
 		}
+	}
 
-	if ((pi->fi->scratch[0] == '.') || (pi->fi->scratch[0] == '#')) {
+	if ((*line == '.') || (*line == '#')) {
 		pi->fi->label = label;
-		flag = parse_directive(pi);
-		if ((pi->pass == PASS_2) && pi->list_on && pi->list_line) { /* Diff tilpassing */
-			fprintf(pi->list_file, "          %s\n", pi->list_line);
-			pi->list_line = NULL;
-		}
+		flag = parse_directive(pi, line);
+		list_source(pi, LIST_INDENT);
 		return (flag);
 	} else {
-		return parse_mnemonic(pi);
+		return parse_mnemonic(pi, line);
 	}
 }
 
 
+/* Read one token from line without modifying it. Leading horizontal space is
+ * skipped. Returns a pointer to the first character after the token. */
+const char *
+get_token(const char *line, struct token *tok)
+{
+	const char *p = line;
+
+	while (IS_HOR_SPACE(*p)) p++;
+	tok->start = p;
+	if (IS_END_OR_COMMENT(*p)) {
+		tok->kind = TOKEN_END;
+	} else if (((*p == '.') || (*p == '#')) && IS_LABEL(p[1])) {
+		tok->kind = TOKEN_DIRECTIVE;
+		for (p++; IS_LABEL(*p); p++);
+	} else if (isdigit((unsigned char)*p) || ((*p == '$') && isxdigit((unsigned char)p[1]))) {
+		tok->kind = TOKEN_NUMBER;
+		for (p++; isalnum((unsigned char)*p); p++);
+	} else if (IS_LABEL(*p)) {
+		tok->kind = TOKEN_IDENT;
+		for (p++; IS_LABEL(*p); p++);
+	} else if ((*p == '"') || (*p == '\'')) {
+		tok->kind = (*p == '"') ? TOKEN_STRING : TOKEN_CHAR;
+		for (p++; (*p != *tok->start) && !IS_ENDLINE(*p); p++);
+		if (*p == *tok->start)
+			p++;
+	} else {
+		tok->kind = TOKEN_PUNCT;
+		p++;
+	}
+	tok->len = p - tok->start;
+	return (p);
+}
+
+/* Non-destructive counterpart of get_next_token(data, TERM_COMMA): tok is set
+ * to the operand at data, trimmed, up to the next comma or comment that is
+ * not inside quotes. Returns the start of the following operand, or NULL if
+ * this was the last one. */
+const char *
+get_operand(const char *data, struct token *tok)
+{
+	int i = 0, j, anti_comma = False;
+
+	while (((data[i] != ',') || anti_comma) && ((data[i] != ';') || anti_comma) && !IS_ENDLINE(data[i])) {
+		if ((data[i] == '\'') || (data[i] == '"'))
+			anti_comma = anti_comma ? False : True;
+		i++;
+	}
+	for (j = i; (j > 0) && IS_HOR_SPACE(data[j - 1]); j--);
+	tok->start = data;
+	tok->len = j;
+	tok->kind = TOKEN_END;
+	if (j > 0) {
+		get_token(data, tok);	/* classify by the first token */
+		tok->start = data;
+		tok->len = j;
+	}
+	if (IS_END_OR_COMMENT(data[i]))
+		return (NULL);
+	i++;
+	while (IS_HOR_SPACE(data[i])) i++;
+	if (IS_END_OR_COMMENT(data[i]))
+		return (NULL);
+	return (&data[i]);
+}
+
+
 /* Get the next token, and terminate the last one.
  * Termination identifier is specified. */
 char *
@@ -0,0 +1,129 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/* --relax sizes every JMP, CALL and conditional branch (a site) to fit its
+ * target. Pass 1 records the sites in source order, all one word. relax()
+ * then repeats pass 2 without output or messages, growing the sites whose
+ * target is out of reach and moving the labels and constants after them,
+ * until a pass changes nothing. Sites never shrink, so this ends. Pass 2
+ * finds its n-th site as the n-th one of pass 1, like the outcomes of the
+ * conditionals. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "avra.h"
+#include "args.h"
+
+/* Record a new site in pass 1, or return the next one in pass 2 */
+struct relax_site *
+relax_site(struct prog_info *pi)
+{
+	struct relax_site *sites;
+	int size;
+
+	if (pi->pass == PASS_2) {
+		if (pi->relax_next >= pi->relax_count) {
+			print_msg(pi, MSGTYPE_ERROR, "Internal assembler error");
+			return (NULL);
+		}
+		return (&pi->relax_sites[pi->relax_next++]);
+	}
+	if (pi->relax_count >= pi->relax_size) {
+		size = pi->relax_size ? pi->relax_size * 2 : 256;
+		sites = realloc(pi->relax_sites, size * sizeof(struct relax_site));
+		if (!sites) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (NULL);
+		}
+		STAT_ALLOC(pi, 1, (size - pi->relax_size) * sizeof(struct relax_site));
+		pi->relax_sites = sites;
+		pi->relax_size = size;
+	}
+	sites = &pi->relax_sites[pi->relax_count++];
+	memset(sites, 0, sizeof(struct relax_site));
+	sites->words = 1;
+	return (sites);
+}
+
+/* Settle the size of the sites after pass 1. A pass that fails leaves the
+ * sizes reached so far, and pass 2 reports the error. */
+void
+relax(struct prog_info *pi)
+{
+	struct segment_info *segments[] = {pi->cseg, pi->dseg, pi->eseg};
+	int error_count = pi->error_count;
+	int warning_count = pi->warning_count;
+	int i, ok;
+
+	if (!pi->relax_count)
+		return;
+	STAT_BEGIN(pi, STAT_PASS_2);
+	pi->relaxing = True;
+	do {
+		for (i = 0; i < 3; i++)
+			segments[i]->relax_orglist = NULL;
+		pi->relax_changed = False;
+		ok = start_pass_2(pi) && def_orglist(pi->cseg)
+		     && parse_file(pi, pi->args->first_data->data) && fix_orglist(pi->segment);
+		pi->error_count = error_count;
+		pi->warning_count = warning_count;
+	} while (ok && pi->relax_changed);
+	pi->relaxing = False;
+	STAT_END(pi, STAT_PASS_2);
+	/* Pass 1 counted every site as one word */
+	for (i = 0; i < pi->relax_count; i++)
+		pi->cseg->count += pi->relax_sites[i].words - 1;
+}
+
+/* Print what --relax saved, a word and a cycle for every JMP or CALL made
+ * relative, and the words it added to the branches out of reach */
+void
+relax_report(struct prog_info *pi)
+{
+	struct relax_site *site;
+	int jumps = 0, relative = 0, extended = 0, added = 0;
+
+	if (!pi->relax)
+		return;
+	for (site = pi->relax_sites; site < pi->relax_sites + pi->relax_count; site++) {
+		if (site->jump) {
+			jumps++;
+			if (site->words == 1)
+				relative++;
+		} else if (site->words > 1) {
+			extended++;
+			added += site->words - 1;
+		}
+	}
+	printf("Relaxation :   %7d of %d JMP/CALL relative, %d words and %d cycles saved, %d branches extended by %d words\n",
+	       relative, jumps, relative, relative, extended, added);
+}
+
+/* end of relax.c */
@@ -0,0 +1,723 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/* --stats collects wall and CPU time of the passes and output writers,
+ * and counts lines, macro expansions, expression evaluations and
+ * allocations while assembling. The report is printed as text after the
+ * assembly, and --statsjson writes it as one JSON object.
+ *
+ * --profile attributes time and parsed lines to every source file and
+ * macro, following the nesting of includes and macro calls. It prints a
+ * hot list and writes the call stacks in the collapsed format of
+ * flamegraph tools.
+ *
+ * --trace writes a timeline of the run as Chrome trace events, which
+ * chrome://tracing and Perfetto display. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "misc.h"
+#include "avra.h"
+#include "args.h"
+
+static const char *const phase_names[STAT_PHASES] = {
+	"pass1", "pass2", "hex", "eep", "obj", "coff", "list", "map"
+};
+
+int
+stats_open(struct prog_info *pi)
+{
+	if (!GET_ARG_I(pi->args, ARG_STATS) && !GET_ARG_P(pi->args, ARG_STATSJSON))
+		return (True);
+	pi->stats = calloc(1, sizeof(struct stats));
+	if (!pi->stats) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	return (True);
+}
+
+void
+stats_close(struct prog_info *pi)
+{
+	if (!pi->stats)
+		return;
+	free(pi->stats->file_lines);
+	free(pi->stats);
+	pi->stats = NULL;
+}
+
+static time_t clock_base;	/* Whole seconds of the first stats_clock() */
+
+/* Wall clock in seconds since the first call */
+double
+stats_clock(void)
+{
+	struct timespec now;
+
+	timespec_get(&now, TIME_UTC);
+	if (!clock_base)
+		clock_base = now.tv_sec;
+	return ((now.tv_sec - clock_base) + now.tv_nsec / 1e9);
+}
+
+/* Start phase for --stats and --trace */
+void
+phase_begin(struct prog_info *pi, int phase)
+{
+	if (pi->stats) {
+		pi->stats->wall_start[phase] = stats_clock();
+		pi->stats->cpu_start[phase] = clock();
+	}
+	if (pi->trace)
+		trace_event(pi, 'B', phase_names[phase], "phase");
+}
+
+/* Phases can be entered more than once, their times add up */
+void
+phase_end(struct prog_info *pi, int phase)
+{
+	if (pi->stats) {
+		pi->stats->wall[phase] += stats_clock() - pi->stats->wall_start[phase];
+		pi->stats->cpu[phase] += (double)(clock() - pi->stats->cpu_start[phase]) / CLOCKS_PER_SEC;
+	}
+	if (pi->trace)
+		trace_event(pi, 'E', phase_names[phase], "phase");
+}
+
+/* Count a source line of the current file in pass 1 */
+void
+stats_file_line(struct prog_info *pi)
+{
+	struct stats *stats = pi->stats;
+	long *file_lines;
+	int num = pi->fi->include_file->num;
+	int count;
+
+	if (pi->pass != PASS_1)
+		return;
+	if (num >= stats->file_count) {
+		for (count = stats->file_count ? stats->file_count : 16; count <= num; count *= 2);
+		file_lines = realloc(stats->file_lines, count * sizeof(long));
+		if (!file_lines)
+			return;
+		memset(&file_lines[stats->file_count], 0, (count - stats->file_count) * sizeof(long));
+		stats->file_lines = file_lines;
+		stats->file_count = count;
+	}
+	stats->file_lines[num]++;
+}
+
+/* Peak resident set size in kilobytes, or -1 if unknown */
+static long
+peak_rss(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		return (-1);
+#ifdef __APPLE__
+	return (usage.ru_maxrss / 1024);
+#else
+	return (usage.ru_maxrss);
+#endif
+#else
+	return (-1);
+#endif
+}
+
+static int
+count_labels(const struct label *label)
+{
+	int count = 0;
+
+	for (; label; label = label->next)
+		count++;
+	return (count);
+}
+
+static int
+count_defs(const struct def *def)
+{
+	int count = 0;
+
+	for (; def; def = def->next)
+		count++;
+	return (count);
+}
+
+static int
+count_macros(const struct macro *macro)
+{
+	int count = 0;
+
+	for (; macro; macro = macro->next)
+		count++;
+	return (count);
+}
+
+static void
+json_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; s++) {
+		if ((*s == '"') || (*s == '\\'))
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+static void
+write_json(struct prog_info *pi, FILE *fp, long rss)
+{
+	struct stats *stats = pi->stats;
+	struct include_file *include_file;
+	int i;
+
+	fprintf(fp, "{\"phases\":{");
+	for (i = 0; i < STAT_PHASES; i++)
+		fprintf(fp, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i ? "," : "",
+		        phase_names[i], stats->wall[i], stats->cpu[i]);
+	fprintf(fp, "},\"lines\":[%ld,%ld],\"files\":[", stats->lines[PASS_1], stats->lines[PASS_2]);
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
+		fprintf(fp, "%s{\"name\":", include_file->num ? "," : "");
+		json_string(fp, include_file->name);
+		fprintf(fp, ",\"lines\":%ld}",
+		        (include_file->num < stats->file_count) ? stats->file_lines[include_file->num] : 0L);
+	}
+	fprintf(fp, "],\"macro_expansions\":[%ld,%ld],\"expressions\":[%ld,%ld],",
+	        stats->macro_expansions[PASS_1], stats->macro_expansions[PASS_2],
+	        stats->expressions[PASS_1], stats->expressions[PASS_2]);
+	fprintf(fp, "\"symbols\":{\"labels\":%d,\"constants\":%d,\"variables\":%d,\"defs\":%d,\"macros\":%d},",
+	        count_labels(pi->first_label), count_labels(pi->first_constant),
+	        count_labels(pi->first_variable), count_defs(pi->first_def), count_macros(pi->first_macro));
+	fprintf(fp, "\"allocations\":%ld,\"alloc_bytes\":%lu,\"peak_rss_kb\":%ld}\n",
+	        stats->allocations, stats->alloc_bytes, rss);
+}
+
+static void
+write_text(struct prog_info *pi, long rss)
+{
+	struct stats *stats = pi->stats;
+	struct include_file *include_file;
+	int i;
+
+	printf("\nStatistics:\n");
+	printf("   Phase         wall (s)     cpu (s)\n");
+	for (i = 0; i < STAT_PHASES; i++)
+		printf("   %-8s  %12.6f %11.6f\n", phase_names[i], stats->wall[i], stats->cpu[i]);
+	printf("   Lines     : %ld (pass 1), %ld (pass 2)\n", stats->lines[PASS_1], stats->lines[PASS_2]);
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next)
+		printf("   %8ld lines  %s\n",
+		       (include_file->num < stats->file_count) ? stats->file_lines[include_file->num] : 0L,
+		       include_file->name);
+	printf("   Macros    : %ld expansions (pass 1), %ld (pass 2)\n",
+	       stats->macro_expansions[PASS_1], stats->macro_expansions[PASS_2]);
+	printf("   Expr      : %ld evaluations (pass 1), %ld (pass 2)\n",
+	       stats->expressions[PASS_1], stats->expressions[PASS_2]);
+	printf("   Symbols   : %d labels, %d constants, %d variables, %d defs, %d macros\n",
+	       count_labels(pi->first_label), count_labels(pi->first_constant),
+	       count_labels(pi->first_variable), count_defs(pi->first_def), count_macros(pi->first_macro));
+	printf("   Memory    : %ld allocations (%lu bytes)", stats->allocations, stats->alloc_bytes);
+	if (rss >= 0)
+		printf(", peak RSS %ld kB", rss);
+	printf("\n");
+}
+
+void
+stats_report(struct prog_info *pi)
+{
+	const char *jsonfile;
+	FILE *fp;
+	long rss;
+
+	if (!pi->stats)
+		return;
+	rss = peak_rss();
+	if (GET_ARG_I(pi->args, ARG_STATS))
+		write_text(pi, rss);
+	jsonfile = GET_ARG_P(pi->args, ARG_STATSJSON);
+	if (jsonfile) {
+		if (!strcmp(jsonfile, "-")) {
+			write_json(pi, stdout, rss);
+		} else if ((fp = fopen(jsonfile, "w"))) {
+			write_json(pi, fp, rss);
+			fclose(fp);
+		} else
+			fprintf(stderr, "Error: cannot create statistics file\n");
+	}
+}
+
+/* Totals of one source file or macro */
+struct profile_entry {
+	double incl;		/* Seconds, nested files and macros included */
+	double excl;
+	long incl_lines;	/* Parsed lines */
+	long excl_lines;
+	long calls;
+	int active;		/* Frames of it on the stack, for recursion */
+};
+
+/* One distinct call stack, for the collapsed output */
+struct profile_node {
+	int kind;		/* PROFILE_FILE or PROFILE_MACRO */
+	int num;
+	int parent;		/* Node indexes, -1 if none */
+	int child;
+	int sibling;
+	double excl;
+};
+
+struct profile_frame {
+	int kind;
+	int num;
+	int node;
+	double start;
+	double child_time;
+	long start_lines;
+	long child_lines;
+};
+
+struct profile {
+	struct profile_entry *entries[2];	/* Per PROFILE_* kind, by num */
+	int entry_count[2];
+	struct profile_node *nodes;
+	int node_count;
+	int node_size;
+	int first_root;
+	struct profile_frame *stack;
+	int depth;
+	int stack_size;
+	long lines;
+};
+
+#define PROFILE_HOT	25	/* Entries in the hot list */
+
+int
+profile_open(struct prog_info *pi)
+{
+	if (!GET_ARG_P(pi->args, ARG_PROFILE))
+		return (True);
+	pi->profile = calloc(1, sizeof(struct profile));
+	if (!pi->profile) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	pi->profile->first_root = -1;
+	return (True);
+}
+
+void
+profile_close(struct prog_info *pi)
+{
+	struct profile *profile = pi->profile;
+
+	if (!profile)
+		return;
+	free(profile->entries[PROFILE_FILE]);
+	free(profile->entries[PROFILE_MACRO]);
+	free(profile->nodes);
+	free(profile->stack);
+	free(profile);
+	pi->profile = NULL;
+}
+
+/* Grow *array of *count elements of size bytes to hold index n, zeroed */
+static int
+grow(void **array, int *count, int size, int n)
+{
+	void *p;
+	int new_count;
+
+	if (n < *count)
+		return (True);
+	for (new_count = *count ? *count : 16; new_count <= n; new_count *= 2);
+	p = realloc(*array, (size_t)new_count * size);
+	if (!p)
+		return (False);
+	memset((char *)p + (size_t)*count * size, 0, (size_t)(new_count - *count) * size);
+	*array = p;
+	*count = new_count;
+	return (True);
+}
+
+/* The child of node parent (-1 for a root) for kind and num */
+static int
+profile_node(struct profile *profile, int parent, int kind, int num)
+{
+	struct profile_node *node;
+	int i;
+
+	i = (parent < 0) ? profile->first_root : profile->nodes[parent].child;
+	for (; i >= 0; i = profile->nodes[i].sibling)
+		if ((profile->nodes[i].kind == kind) && (profile->nodes[i].num == num))
+			return (i);
+	if (!grow((void **)&profile->nodes, &profile->node_size, sizeof(struct profile_node), profile->node_count))
+		return (-1);
+	i = profile->node_count++;
+	node = &profile->nodes[i];
+	node->kind = kind;
+	node->num = num;
+	node->parent = parent;
+	node->child = -1;
+	if (parent < 0) {
+		node->sibling = profile->first_root;
+		profile->first_root = i;
+	} else {
+		node->sibling = profile->nodes[parent].child;
+		profile->nodes[parent].child = i;
+	}
+	return (i);
+}
+
+/* Start a frame of source file or macro num */
+void
+profile_enter(struct prog_info *pi, int kind, int num)
+{
+	struct profile *profile = pi->profile;
+	struct profile_frame *frame;
+	int parent;
+
+	if (!grow((void **)&profile->entries[kind], &profile->entry_count[kind], sizeof(struct profile_entry), num)
+	        || !grow((void **)&profile->stack, &profile->stack_size, sizeof(struct profile_frame), profile->depth)) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		profile_close(pi);
+		return;
+	}
+	parent = profile->depth ? profile->stack[profile->depth - 1].node : -1;
+	frame = &profile->stack[profile->depth++];
+	frame->kind = kind;
+	frame->num = num;
+	frame->node = (parent < 0 && profile->depth > 1) ? -1 : profile_node(profile, parent, kind, num);
+	frame->child_time = 0;
+	frame->child_lines = 0;
+	frame->start_lines = profile->lines;
+	profile->entries[kind][num].calls++;
+	profile->entries[kind][num].active++;
+	frame->start = stats_clock();
+}
+
+/* Count a parsed line */
+void
+profile_line(struct prog_info *pi)
+{
+	pi->profile->lines++;
+}
+
+/* End the innermost frame */
+void
+profile_exit(struct prog_info *pi)
+{
+	struct profile *profile = pi->profile;
+	struct profile_frame *frame;
+	struct profile_entry *entry;
+	double incl;
+	long lines;
+
+	if (!profile->depth)
+		return;
+	frame = &profile->stack[--profile->depth];
+	incl = stats_clock() - frame->start;
+	lines = profile->lines - frame->start_lines;
+	entry = &profile->entries[frame->kind][frame->num];
+	entry->excl += incl - frame->child_time;
+	entry->excl_lines += lines - frame->child_lines;
+	/* A recursive call is already part of the outer frame */
+	if (--entry->active == 0) {
+		entry->incl += incl;
+		entry->incl_lines += lines;
+	}
+	if (frame->node >= 0)
+		profile->nodes[frame->node].excl += incl - frame->child_time;
+	if (profile->depth) {
+		profile->stack[profile->depth - 1].child_time += incl;
+		profile->stack[profile->depth - 1].child_lines += lines;
+	}
+}
+
+static const char *
+profile_name(struct prog_info *pi, int kind, int num)
+{
+	struct include_file *include_file;
+	struct macro *macro;
+
+	if (kind == PROFILE_FILE) {
+		for (include_file = pi->first_include_file; include_file; include_file = include_file->next)
+			if (include_file->num == num)
+				return (include_file->name);
+	} else {
+		for (macro = pi->first_macro; macro; macro = macro->next)
+			if (macro->num == num)
+				return (macro->name);
+	}
+	return ("?");
+}
+
+/* Frame name in a collapsed stack, ';' separates frames */
+static void
+write_frame(FILE *fp, struct prog_info *pi, const struct profile_node *node)
+{
+	const char *name = profile_name(pi, node->kind, node->num);
+
+	if (node->kind == PROFILE_MACRO)
+		fputs("macro:", fp);
+	for (; *name; name++)
+		fputc((*name == ';') ? '_' : *name, fp);
+}
+
+static void
+write_stack(FILE *fp, struct prog_info *pi, int i)
+{
+	const struct profile_node *node = &pi->profile->nodes[i];
+
+	if (node->parent >= 0) {
+		write_stack(fp, pi, node->parent);
+		fputc(';', fp);
+	}
+	write_frame(fp, pi, node);
+}
+
+/* One line per call stack with its exclusive time in microseconds */
+static void
+write_collapsed(struct prog_info *pi, const char *filename)
+{
+	struct profile *profile = pi->profile;
+	FILE *fp;
+	long us;
+	int i;
+
+	fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot create profile file\n");
+		return;
+	}
+	for (i = 0; i < profile->node_count; i++) {
+		us = (long)(profile->nodes[i].excl * 1e6 + 0.5);
+		if (us <= 0)
+			continue;
+		write_stack(fp, pi, i);
+		fprintf(fp, " %ld\n", us);
+	}
+	fclose(fp);
+}
+
+struct profile_hot {
+	const struct profile_entry *entry;
+	int kind;
+	int num;
+};
+
+static int
+compare_hot(const void *a, const void *b)
+{
+	const struct profile_hot *x = a, *y = b;
+
+	if (x->entry->excl != y->entry->excl)
+		return ((x->entry->excl > y->entry->excl) ? -1 : 1);
+	if (x->kind != y->kind)
+		return (x->kind - y->kind);
+	return (x->num - y->num);
+}
+
+void
+profile_report(struct prog_info *pi)
+{
+	struct profile *profile = pi->profile;
+	struct profile_hot *hot;
+	int count = 0, kind, i;
+
+	if (!profile)
+		return;
+	while (profile->depth)
+		profile_exit(pi);
+	hot = malloc((profile->entry_count[PROFILE_FILE] + profile->entry_count[PROFILE_MACRO] + 1)
+	             * sizeof(struct profile_hot));
+	if (!hot) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+	for (kind = PROFILE_FILE; kind <= PROFILE_MACRO; kind++)
+		for (i = 0; i < profile->entry_count[kind]; i++)
+			if (profile->entries[kind][i].calls) {
+				hot[count].entry = &profile->entries[kind][i];
+				hot[count].kind = kind;
+				hot[count++].num = i;
+			}
+	qsort(hot, count, sizeof(struct profile_hot), compare_hot);
+
+	printf("\nProfile (both passes, by exclusive time):\n");
+	printf("   excl (ms)  incl (ms)  excl lines  incl lines    calls  name\n");
+	for (i = 0; (i < count) && (i < PROFILE_HOT); i++)
+		printf("  %10.3f %10.3f %11ld %11ld %8ld  %s%s\n",
+		       hot[i].entry->excl * 1e3, hot[i].entry->incl * 1e3,
+		       hot[i].entry->excl_lines, hot[i].entry->incl_lines, hot[i].entry->calls,
+		       (hot[i].kind == PROFILE_MACRO) ? "macro " : "",
+		       profile_name(pi, hot[i].kind, hot[i].num));
+	free(hot);
+	write_collapsed(pi, GET_ARG_P(pi->args, ARG_PROFILE));
+}
+
+#define TRACE_EVENTS	4096	/* Events buffered before a write */
+
+struct trace_event {
+	double ts;		/* stats_clock() seconds */
+	double dur;		/* Seconds, for complete events */
+	const char *name;	/* Must stay valid until written */
+	const char *cat;
+	char ph;		/* B(egin), E(nd), X (complete) or i(nstant) */
+};
+
+struct trace {
+	FILE *fp;
+	struct trace_event events[TRACE_EVENTS];
+	int count;
+	int written;		/* Events already in the file */
+	double threshold;	/* Shortest macro expansion traced, seconds */
+	long pid;
+};
+
+int
+trace_open(struct prog_info *pi)
+{
+	const char *filename = GET_ARG_P(pi->args, ARG_TRACE);
+	struct trace *trace;
+
+	if (!filename)
+		return (True);
+	trace = calloc(1, sizeof(struct trace));
+	if (!trace) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	trace->fp = fopen(filename, "w");
+	if (!trace->fp) {
+		fprintf(stderr, "Error: cannot create trace file\n");
+		free(trace);
+		return (False);
+	}
+	trace->threshold = GET_ARG_I(pi->args, ARG_TRACE_THRESHOLD) / 1e6;
+#if defined(__unix__) || defined(__APPLE__)
+	trace->pid = getpid();
+#else
+	trace->pid = 1;
+#endif
+	fputs("{\"traceEvents\":[\n", trace->fp);
+	pi->trace = trace;
+	return (True);
+}
+
+/* Write the buffered events */
+static void
+trace_flush(struct trace *trace)
+{
+	const struct trace_event *e;
+	int i;
+
+	for (i = 0; i < trace->count; i++) {
+		e = &trace->events[i];
+		fputs(trace->written++ ? ",\n{\"name\":" : "{\"name\":", trace->fp);
+		json_string(trace->fp, e->name);
+		/* Absolute microseconds, so traces of several runs line up */
+		fprintf(trace->fp, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%ld,\"tid\":1",
+		        e->cat, e->ph, clock_base * 1e6 + e->ts * 1e6, trace->pid);
+		if (e->ph == 'X')
+			fprintf(trace->fp, ",\"dur\":%.3f", e->dur * 1e6);
+		else if (e->ph == 'i')
+			fputs(",\"s\":\"p\"", trace->fp);
+		fputc('}', trace->fp);
+	}
+	trace->count = 0;
+}
+
+static void
+add_event(struct trace *trace, char ph, const char *name, const char *cat, double ts, double dur)
+{
+	struct trace_event *e;
+
+	if (trace->count == TRACE_EVENTS)
+		trace_flush(trace);
+	e = &trace->events[trace->count++];
+	e->ph = ph;
+	e->name = name;
+	e->cat = cat;
+	e->ts = ts;
+	e->dur = dur;
+}
+
+/* Begin (B), end (E) or instant (i) event now */
+void
+trace_event(struct prog_info *pi, char ph, const char *name, const char *cat)
+{
+	add_event(pi->trace, ph, name, cat, stats_clock(), 0);
+}
+
+/* Process start and the argument parsing, timed before the trace existed */
+void
+trace_start(struct prog_info *pi, double started, double parsed)
+{
+	add_event(pi->trace, 'i', "process start", "process", started, 0);
+	add_event(pi->trace, 'X', "parse arguments", "process", started, parsed - started);
+}
+
+/* A macro expansion started at start, if it took long enough */
+void
+trace_macro(struct prog_info *pi, const char *name, double start)
+{
+	double now = stats_clock();
+
+	if (now - start >= pi->trace->threshold)
+		add_event(pi->trace, 'X', name, "macro", start, now - start);
+}
+
+void
+trace_close(struct prog_info *pi)
+{
+	struct trace *trace = pi->trace;
+
+	if (!trace)
+		return;
+	add_event(trace, 'i', "exit", "process", stats_clock(), 0);
+	trace_flush(trace);
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", trace->fp);
+	fclose(trace->fp);
+	free(trace);
+	pi->trace = NULL;
+}
+
+/* end of stats.c */
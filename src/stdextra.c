@@ -62,7 +62,7 @@ nocase_strcmp(const char *s, const char *t)
 
 /* Case insensetive strncmp() - Optimized with inline case conversion */
 int
-nocase_strncmp(char *s, char *t, int n)
+nocase_strncmp(const char *s, const char *t, int n)
 {
 	unsigned char c1, c2;
 	int i;
@@ -78,6 +78,36 @@ nocase_strncmp(char *s, char *t, int n)
 	return (0);
 }
 
+/* Case insensitive compare of the string s with the n characters at t,
+ * which need not be terminated. Returns 0 if they match exactly. */
+int
+nocase_strcmp_n(const char *s, const char *t, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (s[i] == '\0')
+			return (-1);
+		if (to_lower_inline((unsigned char)s[i]) != to_lower_inline((unsigned char)t[i]))
+			return (to_lower_inline((unsigned char)s[i]) - to_lower_inline((unsigned char)t[i]));
+	}
+	return (s[n] != '\0');
+}
+
+/* Case insensitive FNV-1a hash of the n characters at s */
+unsigned int
+nocase_hash(const char *s, int n)
+{
+	unsigned int hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		hash ^= to_lower_inline((unsigned char)s[i]);
+		hash *= 16777619u;
+	}
+	return (hash);
+}
+
 /* Case insensetive strstr() - Optimized with inline case conversion */
 char *
 nocase_strstr(char *s, char *t)
@@ -121,7 +151,7 @@ atox(char *s)
 
 /* n ascii chars to int. */
 int
-atoi_n(char *s, int n)
+atoi_n(const char *s, int n)
 {
 	int i = 0, ret = 0;
 
@@ -135,7 +165,7 @@ atoi_n(char *s, int n)
 
 /* n ascii chars to hex, where 0 < n <= 8. Ignores "0x". */
 int
-atox_n(char *s, int n)
+atox_n(const char *s, int n)
 {
 	int i = 0, ret = 0;
 
@@ -172,6 +202,20 @@ char *malloc_strcpy(const char *src)
 	return dst;
 }
 
+/* malloc + copy of the first n characters of src, always terminated */
+[[nodiscard]]
+char *malloc_strncpy(const char *src, int n)
+{
+	char *dst;
+
+	dst = malloc(n + 1);
+	if (dst) {
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return dst;
+}
+
 /* My own strlwr function since this one only exists in win. */
 /* Optimization: use pointer-based traversal instead of array indexing */
 char *
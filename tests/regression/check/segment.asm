@@ -0,0 +1,5 @@
+; --check segment diagnostics have the source file as location
+.device ATtiny13
+.org 0x1ff
+	nop
+	nop
@@ -0,0 +1,11 @@
+; --check diagnostics: a warning, a warning inside a macro, an error and a note
+.device ATmega8
+.equ x = 300
+.macro m
+	ldi r16, @0
+.endm
+	ldi r16, x
+	m 400
+	rjmp nowhere
+	.db 1,2,3
+.message "checked"
@@ -0,0 +1,21 @@
+; Pass 2 must take the same branch of every conditional as pass 1, even
+; where a symbol is only defined further down.
+.device ATmega8
+.include "guard.inc"
+.include "guard.inc"
+.if defined(LATER)
+	ldi r16, 1
+.elif defined(LATER2)
+	ldi r16, 2
+.else
+	ldi r16, 3
+.endif
+.ifdef LATER
+	ldi r17, 1
+.endif
+.ifndef LATER
+	ldi r17, GUARDVAL
+.endif
+.equ LATER = 1
+.equ LATER2 = 1
+	rjmp PC
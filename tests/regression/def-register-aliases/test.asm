@@ -0,0 +1,21 @@
+; Register aliases must only resolve when the operand names them.
+; A cached .DEF lookup used to be returned for any later operand.
+
+.device atmega8
+
+.def acc = r16
+.def tmp = r17
+
+	ldi	acc, 1		; e001
+	ldi	r18, 2		; e022
+	ldi	tmp, 3		; e013
+	mov	r0, tmp		; 2e01
+	add	acc, r19	; 0f03
+	ld	r4, y+		; 9049
+
+; Moving an alias frees its old register for a new alias
+.def acc = r20
+.def cnt = r16
+	ldi	acc, 4		; e044
+	ldi	cnt, 5		; e005
+	movw	x, z		; 01df
@@ -0,0 +1,10 @@
+; Page 1 changes, page 2 stays and page 3 is no longer used.
+.device ATmega8
+.org 0
+	rjmp main
+.org 0x20
+main:
+	ldi r16, 2
+	rjmp main
+.org 0x40
+	.dw 1, 2, 3
@@ -0,0 +1,20 @@
+; Device constants are defined on first reference, in any case, and must
+; compare equal to __DEVICE__ for the selected device.
+
+.device ATmega8
+
+.if __DEVICE__ == __atmega8__
+	ldi	r16, 1		; e001
+.else
+	ldi	r16, 2
+.endif
+.ifdef __ATtiny13A__
+	ldi	r17, __DEFAULT__	; e010
+.endif
+.ifndef __ATmega8__
+	ldi	r18, 3
+.endif
+.ifdef __NoSuchDevice__
+	ldi	r19, 4
+.endif
+	ldi	r20, defined(__ATmega2560__) + defined(__nope__)	; e041
@@ -0,0 +1,12 @@
+; Assembled by --device_matrix for each device of the test
+.device ATtiny13
+
+.if __DEVICE__ == __ATmega8__
+	ldi r16, 8
+.else
+	ldi r16, 32
+.endif
+.ifdef FOO
+	ldi r17, FOO
+.endif
+	rjmp 0
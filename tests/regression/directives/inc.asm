@@ -0,0 +1,3 @@
+	ldi r22, 7
+.ExIt
+	ldi r22, 0
@@ -0,0 +1,8 @@
+; Directives that can only fail, and one that does not exist.
+
+.device ATmega8
+.EnDm
+.eNdMaCrO
+.EnDr
+.NoSuChDiReCtIvE
+.ErRoR "stop here"
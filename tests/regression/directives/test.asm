@@ -0,0 +1,78 @@
+; Every directive written in mixed case. Each one has to be found by the
+; case insensitive directive lookup for this file to assemble.
+
+.DeViCe ATmega8
+.InClUdEpAtH "."
+#PrAgMa overlap warning
+.CsEgSiZe 0
+.UnDeF NOTHING
+.LiStMaC
+.NoLiSt
+.LiSt
+
+.DeF acc = r16
+.EqU ONE = 1
+.SeT TWO = 2
+.DeFiNe THREE 3
+
+.MaCrO ld_two
+	ldi @0, TWO
+.EnDm
+
+.MaCrO ld_one
+	ldi @0, ONE
+.EnDmAcRo
+
+.CsEg
+.OrG 0
+	ld_two	acc
+	ld_one	r17
+
+.IfDeF ONE
+	ldi r18, THREE
+.ElSe
+	ldi r18, 0
+.EnDiF
+
+.IfNdEf FOUR
+	ldi r19, 4
+.EnDiF
+
+.If ONE == 1
+	ldi r20, 5
+.ElSeIf ONE == 2
+	ldi r20, 0
+.EnDiF
+
+.iF ONE == 1
+	ldi r21, 6
+.ElIf ONE == 3
+	ldi r21, 0
+.EnDiF
+
+.InClUdE "inc.asm"
+
+.OvErLaP
+.NoOvErLaP
+	.Db 1, 2
+	.Dw 0x1234
+	.InCbIn "inc.bin", 1, 2
+.RePt 2
+	inc r22
+.EnDr
+.IrP reg, r23, r24
+	clr reg
+.eNdR
+.IrPc n, 12
+	ldi r25, n
+.ENdr
+
+.DsEg
+buffer:	.ByTe 4
+
+.EsEg
+	.dB 7
+	.iNcBiN "inc.bin"
+
+.MeSsAgE "directives ", ONE
+.WaRnInG "directives warning"
@@ -0,0 +1,11 @@
+; The ATmega8 has flash pages of 32 words. The code at 0x3e crosses into
+; the second page, and the vector at 0 is assembled last.
+.device ATmega8
+.org 0x3e
+main:
+	ldi r16, 1
+	ldi r17, 2
+	ldi r18, 3
+	rjmp main
+.org 0
+	rjmp main
@@ -0,0 +1,6 @@
+; Out of range .INCBIN operands are errors
+.device ATmega8
+	.incbin "blob.bin", 0, -5
+	.incbin "blob.bin", 9
+	.incbin "blob.bin", 2, 6
+	.incbin "blob.bin", 1, 2, 3
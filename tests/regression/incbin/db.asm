@@ -0,0 +1,8 @@
+; The bytes of test.asm written as .DB strings
+.device ATmega8
+	rjmp end
+tbl:	.db "ABCDEFG"
+part:	.db "CDE"
+end:	rjmp tbl
+.eseg
+	.db "BCDEFG"
@@ -0,0 +1,9 @@
+; .INCBIN of a whole file, a slice and a tail, in code and EEPROM.
+; db.asm has the same bytes as .DB strings.
+.device ATmega8
+	rjmp end
+tbl:	.incbin "blob.bin" ; seven bytes, padded
+part:	.incbin "blob.bin", 2, 3
+end:	rjmp tbl
+.eseg
+	.incbin "blob.bin", 1
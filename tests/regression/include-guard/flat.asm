@@ -0,0 +1,8 @@
+.device ATmega8
+	ldi r17, 0x17
+	ldi r16, 0x42
+	ldi r18, 0x18
+	inc r19
+	inc r19
+	ldi r20, 2
+	rjmp PC
@@ -0,0 +1,16 @@
+; Files wrapped in an include guard are opened once. Skipped includes must
+; keep pass 2 in step with the conditionals of pass 1.
+.device ATmega8
+.include "guard.inc"
+.include "twice.inc"
+.include "guard.inc"
+.include "twice.inc"
+.include "self.inc"
+.ifdef LATER
+	ldi r20, 1
+.else
+	ldi r20, 2
+.endif
+.include "guard.inc"
+.equ LATER = 1
+	rjmp PC
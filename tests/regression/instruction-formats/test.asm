@@ -0,0 +1,38 @@
+; One instruction of every operand format, with the expected encoding.
+; XCH, LAS, LAC and LAT used to be encoded without their opcode bits.
+
+.device atmega2560
+
+start:
+	nop			; 0000
+	lpm			; 95c8
+	lpm	r1, z+		; 9015
+	elpm	r2, z		; 9026
+	bset	3		; 9438
+	ser	r17		; ef1f
+	com	r5		; 9450
+	clr	r20		; 2744
+	brne	start		; f7b9
+	rjmp	start		; cff6
+	call	start		; 940e 0000
+	brbs	1, start	; f399
+	add	r1, r31		; 0e1f
+	movw	r2, r30		; 011f
+	muls	r16, r31	; 020f
+	fmulsu	r17, r23	; 039f
+	adiw	r26, 33		; 9691
+	cbr	r18, 0x0f	; 7f20
+	bld	r3, 7		; f837
+	in	r6, 0x3f	; b66f
+	out	0x21, r7	; bc71
+	sbi	0x1f, 2		; 9afa
+	lds	r8, 0x1234	; 9080 1234
+	sts	0x0100, r9	; 9290 0100
+	ld	r10, -x		; 90ae
+	st	y+, r11		; 92b9
+	ldd	r12, z+5	; 80c5
+	std	y+63, r13	; aedf
+	xch	z, r16		; 9304
+	las	z, r17		; 9315
+	lac	z, r18		; 9326
+	lat	z, r19		; 9337
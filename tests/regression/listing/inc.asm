@@ -0,0 +1,2 @@
+	nop
+; last line of inc.asm
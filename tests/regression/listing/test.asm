@@ -0,0 +1,25 @@
+; Every kind of list file line: code, data, macro calls, conditionals,
+; and an include whose last line is a remark (it used to be listed twice).
+
+.device ATmega8
+
+.macro addi
+	subi	@0, -@1
+.endm
+
+.dseg
+buf:	.byte	4
+.cseg
+start:
+	ldi	r16, 1		; one word
+	lds	r17, buf	; two words
+	addi	r16, 2
+.listmac
+	addi	r17, 3
+.if 0
+	nop
+.endif
+table:	.dw	0x1234, 0x5678
+text:	.db	"abc"
+.include "inc.asm"
+	rjmp	start
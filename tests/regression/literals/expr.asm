@@ -0,0 +1,8 @@
+; The values of test.asm as expressions, evaluated by get_expr()
+.device ATmega8
+	.db (10), 5+5, 0x05*2, 0b101<<1, 'A'+0, 0-1, 0-2, 256-1
+	.db ';'+0, ' '+0
+	.dw 999+1, $fffe+1, 0xBEEE+1, 0x8000|1, 'z'+0, 0-32768
+.eseg
+	.db 0+1, 1+1, 2+1, 2*2, 'E'+0
+	.dw 0-1, 0x1230+4
@@ -0,0 +1,9 @@
+; .DB/.DW operands that are single literals take a fast path past the
+; expression parser. expr.asm has the same values as expressions.
+.device ATmega8
+	.db 10, $0a, 0x0A, 0b1010, 'A', -1, - 2 , 255 ; comment
+	.db ';', ' '
+	.dw 1000, $ffff, 0XBEEF, 0b1000000000000001, 'z', -32768
+.eseg
+	.db 1, $2, 0x3, 0b100, 'E'
+	.dw -1, 0x1234
@@ -0,0 +1,10 @@
+.device ATmega128
+
+; The argument grows with every level until the line no longer fits
+.macro unroll
+.if @0 > 0
+	unroll @0-1
+.endif
+.endm
+
+	unroll 5000
@@ -0,0 +1,8 @@
+.device ATmega128
+
+.macro forever
+	nop
+	forever
+.endm
+
+	forever
@@ -0,0 +1,25 @@
+.device ATmega128
+
+; Nested calls with local labels
+.macro inner
+	ldi r16, @0
+l%:	dec r16
+	brne l%
+.endm
+.macro outer
+	inner @0
+	nop
+	inner @1
+.endm
+
+; Recursion ended by a conditional, deeper than the default limit
+.macro countdown
+.if @0 > 0
+	ldi r17, @0
+	countdown @0-1
+.endif
+.endm
+
+start:	outer 3, 4
+	countdown 300
+	rjmp start
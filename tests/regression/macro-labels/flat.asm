@@ -0,0 +1,16 @@
+.device ATmega128
+
+start:	ldi r16, 3
+done1:	dec r16
+	nop
+done2:	dec r16
+	brne done2
+	rjmp done1
+	ldi r16, 3
+done3:	dec r16
+	nop
+done4:	dec r16
+	brne done4
+	rjmp done3
+done:	rjmp start
+	rjmp done
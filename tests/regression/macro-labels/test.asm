@@ -0,0 +1,26 @@
+.device ATmega128
+
+; A label defined in a macro is local to the call. A nested macro sees
+; the local labels of its callers and may define its own with the same
+; name.
+.macro jump_to
+	rjmp @0
+.endm
+
+.macro spin
+	nop
+done:	dec r16
+	brne done
+.endm
+
+.macro outer
+	ldi r16, 3
+done:	dec r16
+	spin
+	jump_to done
+.endm
+
+start:	outer
+	outer
+done:	rjmp start
+	rjmp done
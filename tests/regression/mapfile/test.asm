@@ -0,0 +1,15 @@
+; Map file ordering and the JSON lines map
+.device ATmega8
+
+.equ	zeta = 0x10
+.equ	Alpha = 3
+.set	middle = -2
+
+.dseg
+buffer:	.byte 4
+
+.cseg
+start:	rjmp	loop
+loop:	rjmp	start
+a_quote_free_long_name:
+	nop
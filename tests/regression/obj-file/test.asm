@@ -0,0 +1,9 @@
+; Object file records are written in address order, whatever the order
+; the code was assembled in.
+.device ATmega8
+.org 0x10
+start:
+	ldi r16, 1
+	rjmp start
+.org 0
+	rjmp start
@@ -0,0 +1,2 @@
+; included once, calls a macro
+	twice	r18
@@ -0,0 +1,16 @@
+; --profile attribution of lines to files and nested macros
+.device ATmega8
+
+.macro twice
+	inc	@0
+	inc	@0
+.endm
+
+.macro four
+	twice	@0
+	twice	@0
+.endm
+
+.include "inc.asm"
+	four	r16
+	twice	r17
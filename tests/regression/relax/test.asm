@@ -0,0 +1,25 @@
+; --relax: JMP and CALL in reach become RJMP and RCALL, branches out of
+; reach become an inverted branch over RJMP or JMP
+.device ATmega328P
+
+start:
+	jmp near		; rjmp
+	call far		; out of reach, stays a call
+	breq mid		; brne .+1, rjmp mid
+	brbs 1, far		; brbc 1, .+2, jmp far
+	sbrs r16, 0
+	breq near		; after a skip, stays one word
+	rcall near
+near:
+.equ AFTER_NEAR = near + 1	; moves with near
+	nop
+	rjmp start
+
+.org 0x100
+mid:
+	ret
+
+.org 0x1000
+far:
+	ldi r30, low(AFTER_NEAR)
+	ret
@@ -0,0 +1,28 @@
+.device ATmega128
+
+	nop
+loop1:	dec r16
+	brne loop1
+	nop
+loop2:	dec r16
+	brne loop2
+	nop
+loop3:	dec r16
+	brne loop3
+
+	clr r16
+	ldi r16, 'a'
+	ldi r16, 'b'
+	clr r17
+	ldi r17, 'a'
+	ldi r17, 'b'
+	clr r18
+	ldi r18, 'a'
+	ldi r18, 'b'
+
+	ldi r20, 1
+	ldi r20, 2
+	ldi r20, 3
+	ldi r21, 5
+	ldi r21, 5
+	rjmp PC
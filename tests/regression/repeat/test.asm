@@ -0,0 +1,32 @@
+.device ATmega128
+
+; A repetition inside a macro, arguments replaced
+.macro twice
+	.rept 2
+	ldi @0, @1
+	.endr
+.endm
+
+; Labels are local to each iteration
+	.rept 3
+	nop
+loop:	dec r16
+	brne loop
+	.endr
+
+; Nested, the symbol is also replaced in the inner block
+	.irp reg, r16, r17, r18
+	clr reg
+	.irpc c, "ab"
+	ldi reg, 'c'
+	.endr
+	.endr
+
+	.irpc n, 123
+	ldi r20, n
+	.endr
+	twice r21, 5
+	.rept 0
+	bogus
+	.endr
+	rjmp PC
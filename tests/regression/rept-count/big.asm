@@ -0,0 +1,6 @@
+; A .REPT count above the limit is an error
+.device ATmega8
+
+.rept 0x7fffffff
+	nop
+.endr
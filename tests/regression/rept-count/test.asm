@@ -0,0 +1,9 @@
+; The count of .REPT must not use labels defined after it
+.device ATmega8
+
+before:
+.rept (after - before)
+	nop
+.endr
+after:
+	nop
@@ -0,0 +1,2 @@
+; included once
+	nop
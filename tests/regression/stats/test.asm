@@ -0,0 +1,11 @@
+; --stats counters
+.device ATmega8
+
+.macro twice
+	inc	@0
+	inc	@0
+.endm
+
+.include "inc.asm"
+	twice	r16
+	twice	r17
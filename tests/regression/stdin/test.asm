@@ -0,0 +1,12 @@
+; Read from stdin and write the hex file to stdout
+.device ATmega8
+.equ x = 30
+.macro m
+	ldi r16, @0
+.endm
+start:	ldi r16, x
+	m 40
+	rjmp start
+	.db 1,2
+.eseg
+	.db 5,6
@@ -0,0 +1,9 @@
+; --trace events of includes, phases and macro expansions
+.device ATmega8
+
+.macro twice
+	inc	@0
+	inc	@0
+.endm
+
+	twice	r16